@@ -5,6 +5,7 @@ LOCAL_SRC_FILES := \
 	ControlThread.cpp \
 	PreviewThread.cpp \
 	PictureThread.cpp \
+	PictureEncoder.cpp \
 	VideoThread.cpp \
 	PipeThread.cpp \
 	CameraDriver.cpp \
@@ -13,7 +14,21 @@ LOCAL_SRC_FILES := \
 	CameraHAL.cpp \
 	ColorConverter.cpp \
 	EXIFFields.cpp \
+	ExifTemplate.cpp \
+	ImageScaler.cpp \
 	JpegCompressor.cpp \
+	LibjpegEncoder.cpp \
+	JpegRotator.cpp \
+	FileJpegSink.cpp \
+	SkiaJpegEncoder.cpp \
+	SurfaceJpegEncoder.cpp \
+	IntelParameters.cpp \
+	TimestampFilter.cpp \
+	WorkerPool.cpp \
+	BufferShareRegistry.cpp \
+	TemporalDenoiser.cpp \
+	MultiFrameDenoiser.cpp \
+	VideoStabilizer.cpp \
 
 LOCAL_C_INCLUDES += \
 	frameworks/base/include \
@@ -31,6 +46,7 @@ LOCAL_SHARED_LIBRARIES := \
 	libcutils \
 	libbinder \
 	libskia \
+	libjpeg \
 	libandroid \
 	libui \
 	libs3cjpeg \
@@ -40,3 +56,43 @@ LOCAL_MODULE := camera.$(TARGET_BOARD_PLATFORM)
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
+
+# camera_jpeg_bench: times the JPEG encoders of the HAL outside of a camera session
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	JpegBenchmark.cpp \
+	PictureEncoder.cpp \
+	Callbacks.cpp \
+	ColorConverter.cpp \
+	ExifTemplate.cpp \
+	ImageScaler.cpp \
+	JpegCompressor.cpp \
+	LibjpegEncoder.cpp \
+	JpegRotator.cpp \
+	SkiaJpegEncoder.cpp \
+	SurfaceJpegEncoder.cpp \
+	WorkerPool.cpp \
+	BufferShareRegistry.cpp \
+
+LOCAL_C_INCLUDES += \
+	frameworks/base/include \
+	frameworks/base/include/camera \
+	external/jpeg \
+	hardware/libhardware/include/hardware \
+	external/skia/include/core \
+	external/skia/include/images \
+	external/libs3cjpeg \
+
+LOCAL_SHARED_LIBRARIES := \
+	libcamera_client \
+	libutils \
+	libcutils \
+	libskia \
+	libjpeg \
+	libs3cjpeg \
+
+LOCAL_MODULE := camera_jpeg_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
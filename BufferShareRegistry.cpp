@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_BufferShareRegistry"
+
+#include <string.h>
+#include "BufferShareRegistry.h"
+#include "Callbacks.h"
+#include "LogHelper.h"
+
+namespace android {
+
+Mutex BufferShareRegistry::mInstanceLock;
+BufferShareRegistry* BufferShareRegistry::mInstance = NULL;
+
+BufferShareRegistry* BufferShareRegistry::getInstance()
+{
+    Mutex::Autolock lock(mInstanceLock);
+    if (mInstance == NULL)
+        mInstance = new BufferShareRegistry();
+    return mInstance;
+}
+
+BufferShareRegistry::BufferShareRegistry() :
+    mBufferSize(0)
+    ,mGeneration(0)
+{
+    LOG1("@%s", __FUNCTION__);
+    memset(&mShared, 0, sizeof(mShared));
+}
+
+BufferShareRegistry::~BufferShareRegistry()
+{
+    LOG1("@%s", __FUNCTION__);
+    releaseBuffers();
+}
+
+camera_memory_t* BufferShareRegistry::getSnapshotMemory(int index, int size)
+{
+    LOG1("@%s: index = %d, size = %d", __FUNCTION__, index, size);
+    if (index < 0 || index >= MAX_BURST_BUFFERS || size <= 0)
+        return NULL;
+
+    Mutex::Autolock lock(mLock);
+    // buffers of another size are no use to anyone any more
+    if (size != mBufferSize) {
+        releaseBuffersLocked();
+        mBufferSize = size;
+    }
+
+    CameraBuffer *buf = &mBuffers[index];
+    if (buf->getData() == NULL) {
+        Callbacks::getInstance()->allocateMemory(buf, size);
+        if (buf->getData() == NULL) {
+            ALOGE("No memory for snapshot buffer %d", index);
+            return NULL;
+        }
+    }
+    return buf->getCameraMem();
+}
+
+void BufferShareRegistry::shareBuffers(int num, int width, int height, int format)
+{
+    LOG1("@%s: %d buffers of %dx%d %s", __FUNCTION__, num, width, height, v4l2Fmt2Str(format));
+    Mutex::Autolock lock(mLock);
+    if (num > MAX_BURST_BUFFERS)
+        num = MAX_BURST_BUFFERS;
+
+    // the same as the last shot, the encoders keep their surfaces
+    bool same = num == mShared.num && width == mShared.width &&
+            height == mShared.height && format == mShared.format;
+    for (int i = 0; i < num; i++) {
+        unsigned char *data = (unsigned char *) mBuffers[i].getData();
+        if (data != mShared.data[i])
+            same = false;
+        mShared.data[i] = data;
+    }
+    if (same)
+        return;
+
+    mShared.num = num;
+    mShared.width = width;
+    mShared.height = height;
+    mShared.format = format;
+    mGeneration++;
+}
+
+void BufferShareRegistry::releaseBuffers()
+{
+    LOG1("@%s", __FUNCTION__);
+    Mutex::Autolock lock(mLock);
+    releaseBuffersLocked();
+}
+
+void BufferShareRegistry::releaseBuffersLocked()
+{
+    for (int i = 0; i < MAX_BURST_BUFFERS; i++)
+        mBuffers[i].releaseMemory();
+    mBufferSize = 0;
+    if (mShared.num > 0) {
+        memset(&mShared, 0, sizeof(mShared));
+        mGeneration++;
+    }
+}
+
+int BufferShareRegistry::getSharedBuffers(int generation, SharedBuffers *buffers)
+{
+    Mutex::Autolock lock(mLock);
+    if (generation != mGeneration)
+        *buffers = mShared;
+    return mGeneration;
+}
+
+}; // namespace android
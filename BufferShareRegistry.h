@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_BUFFER_SHARE_REGISTRY_H
+#define ANDROID_LIBCAMERA_BUFFER_SHARE_REGISTRY_H
+
+#include <utils/threads.h>
+#include "CameraCommon.h"
+
+namespace android {
+
+//
+// BufferShareRegistry holds the snapshot buffers shared between the capture
+// and the JPEG encoders. The driver captures into the same memory shot after
+// shot, so the encoders register it once as input surfaces of their backends
+// and encode the pictures of a burst in place rather than copying them in.
+//
+class BufferShareRegistry {
+
+// constructor destructor
+private:
+    BufferShareRegistry();
+public:
+    ~BufferShareRegistry();
+
+// public types
+public:
+
+    // what the encoders see of the shared buffers
+    struct SharedBuffers {
+        unsigned char *data[MAX_BURST_BUFFERS];
+        int num;
+        int width;
+        int height;
+        int format;
+    };
+
+// public methods
+public:
+
+    static BufferShareRegistry* getInstance();
+
+    // Capture side: memory for snapshot buffer index, kept while size stays
+    camera_memory_t* getSnapshotMemory(int index, int size);
+
+    // Capture side: the first num buffers hold width x height pictures in format
+    void shareBuffers(int num, int width, int height, int format);
+
+    // Frees the snapshot memory, the encoders drop their surfaces for it
+    void releaseBuffers();
+
+    /**
+     * Encoder side: returns the generation of the shared buffers, which
+     * changes whenever they do. buffers is filled in unless generation is
+     * already the current one.
+     */
+    int getSharedBuffers(int generation, SharedBuffers *buffers);
+
+// private methods
+private:
+
+    void releaseBuffersLocked();
+
+// private data
+private:
+
+    static Mutex mInstanceLock;
+    static BufferShareRegistry *mInstance;
+
+    // Callbacks is not kept, it is replaced every time the camera opens
+    Mutex mLock;
+    CameraBuffer mBuffers[MAX_BURST_BUFFERS];
+    int mBufferSize;
+    SharedBuffers mShared;
+    int mGeneration;
+
+}; // class BufferShareRegistry
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_BUFFER_SHARE_REGISTRY_H
@@ -110,6 +110,33 @@ void Callbacks::compressedFrameDone(CameraBuffer *buff)
     }
 }
 
+// The screennail JPEG goes out as the postview frame, ahead of its picture
+void Callbacks::screennailDone(CameraBuffer *buff)
+{
+    LOG1("@%s", __FUNCTION__);
+    if ((mMessageFlags & CAMERA_MSG_POSTVIEW_FRAME) && mDataCB != NULL) {
+        LOG1("Sending message: CAMERA_MSG_POSTVIEW_FRAME, buff id = %d", buff->getID());
+        buff->incrementReader();
+        mDataCB(CAMERA_MSG_POSTVIEW_FRAME, buff->getCameraMem(), 0, NULL, mUserToken);
+        buff->decrementReader();
+    }
+}
+
+// Uncompressed pictures are sent without a copy
+void Callbacks::rawFrameDone(CameraBuffer *buff)
+{
+    LOG1("@%s", __FUNCTION__);
+    if ((mMessageFlags & CAMERA_MSG_RAW_IMAGE) && mDataCB != NULL) {
+        LOG1("Sending message: CAMERA_MSG_RAW_IMAGE, buff id = %d", buff->getID());
+        buff->incrementReader();
+        mDataCB(CAMERA_MSG_RAW_IMAGE, buff->getCameraMem(), 0, NULL, mUserToken);
+        buff->decrementReader();
+    } else if ((mMessageFlags & CAMERA_MSG_RAW_IMAGE_NOTIFY) && mNotifyCB != NULL) {
+        LOG1("Sending message: CAMERA_MSG_RAW_IMAGE_NOTIFY");
+        mNotifyCB(CAMERA_MSG_RAW_IMAGE_NOTIFY, 0, 0, mUserToken);
+    }
+}
+
 void Callbacks::cameraError(int err)
 {
     LOG1("@%s", __FUNCTION__);
@@ -145,6 +172,15 @@ void Callbacks::allocateMemory(CameraBuffer *buff, int size)
         buff->setCameraMemory(mGetMemoryCB(-1, size, 1, mUserToken));
 }
 
+// Wraps the first size bytes of an existing ashmem region, the data is not copied
+void Callbacks::allocateMemory(CameraBuffer *buff, int fd, int size)
+{
+    LOG1("@%s: fd = %d, size = %d", __FUNCTION__, fd, size);
+    buff->releaseMemory();
+    if (mGetMemoryCB != NULL)
+        buff->setCameraMemory(mGetMemoryCB(fd, size, 1, mUserToken));
+}
+
 void Callbacks::autofocusDone(bool status)
 {
     LOG1("@%s", __FUNCTION__);
@@ -52,11 +52,14 @@ public:
     void previewFrameDone(CameraBuffer *buff);
     void videoFrameDone(CameraBuffer *buff, nsecs_t timstamp);
     void compressedFrameDone(CameraBuffer *buff);
+    void screennailDone(CameraBuffer *buff);
+    void rawFrameDone(CameraBuffer *buff);
     void cameraError(int err);
     void autofocusDone(bool status);
     void shutterSound();
 
     void allocateMemory(CameraBuffer *buff, int size);
+    void allocateMemory(CameraBuffer *buff, int fd, int size);
     virtual void facesDetected(camera_frame_metadata_t &face_metadata, CameraBuffer* buffer);
 
 private:
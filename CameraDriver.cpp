@@ -20,6 +20,8 @@
 #include "CameraDriver.h"
 #include "Callbacks.h"
 #include "ColorConverter.h"
+#include "IntelParameters.h"
+#include "BufferShareRegistry.h"
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -30,6 +32,9 @@
 
 #define DEFAULT_SENSOR_FPS      15.0
 
+// kernel timestamps older than this are not trusted
+#define MAX_TIMESTAMP_AGE       1000000000LL // 1 second
+
 #define RESOLUTION_14MP_WIDTH   4352
 #define RESOLUTION_14MP_HEIGHT  3264
 #define RESOLUTION_8MP_WIDTH    3264
@@ -86,6 +91,8 @@ CameraDriver::CameraDriver(int cameraId) :
     LOG1("@%s", __FUNCTION__);
 
     mConfig.fps = 30;
+    mConfig.hfr_fps = 0;
+    mConfig.num_buffers = NUM_DEFAULT_BUFFERS;
     mConfig.num_snapshot = 1;
     mConfig.zoom = 0;
 
@@ -177,16 +184,21 @@ void CameraDriver::getDefaultParameters(CameraParameters *params)
     params->set(CameraParameters::KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO, "640x480");
     params->set(CameraParameters::KEY_SUPPORTED_VIDEO_SIZES, ""); // empty string indicates we only support a single stream
 
-    params->set(CameraParameters::KEY_VIDEO_SNAPSHOT_SUPPORTED, CameraParameters::FALSE);
+    params->set(CameraParameters::KEY_VIDEO_SNAPSHOT_SUPPORTED, CameraParameters::TRUE);
+
+    // high frame rate recording
+    params->set(IntelCameraParameters::KEY_RECORDING_FRAME_RATE, NORMAL_FRAME_RATE);
+    params->set(IntelCameraParameters::KEY_SUPPORTED_RECORDING_FRAME_RATES, "30,60,120");
 
     /**
      * SNAPSHOT
      */
     params->set(CameraParameters::KEY_SUPPORTED_PICTURE_SIZES, "640x480");
     params->setPictureSize(mConfig.snapshot.width, mConfig.snapshot.height);
-    params->set(CameraParameters::KEY_SUPPORTED_JPEG_THUMBNAIL_SIZES,"0x0"); // 0x0 indicates "not supported"
-    params->set(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH, 0);
-    params->set(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT, 0);
+    // thumbnails are scaled down from the snapshot, 0x0 disables them
+    params->set(CameraParameters::KEY_SUPPORTED_JPEG_THUMBNAIL_SIZES, "320x240,240x180,160x120,0x0");
+    params->set(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH, 320);
+    params->set(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT, 240);
 
     /**
      * ZOOM
@@ -394,7 +406,7 @@ status_t CameraDriver::startRecording()
             MODE_VIDEO,
             mConfig.preview.padding,
             mConfig.preview.height,
-            NUM_DEFAULT_BUFFERS);
+            mConfig.num_buffers);
     if (ret < 0) {
         ALOGE("Configure device failed!");
         status = UNKNOWN_ERROR;
@@ -506,15 +518,37 @@ int CameraDriver::configureDevice(Mode deviceMode, int w, int h, int numBuffers)
     if (ret < 0)
         return ret;
 
+    int nominalFps = NORMAL_FRAME_RATE;
     ret = v4l2_capture_g_framerate(fd, &mConfig.fps, w, h);
     if (ret < 0) {
         /*Error handler: if driver does not support FPS achieving,
           just give the default value.*/
         mConfig.fps = DEFAULT_SENSOR_FPS;
         ret = 0;
+    } else {
+        nominalFps = static_cast<int>(mConfig.fps + 0.5f);
     }
 
-    status_t status = allocateBuffers(numBuffers);
+    // The sensor keeps its frame interval from one session to the next, so
+    // a high frame rate is undone here rather than when it is turned off.
+    // The interval enumerated first is the nominal one.
+    if (deviceMode == MODE_VIDEO && mConfig.hfr_fps > 0) {
+        ret = v4l2_capture_s_framerate(fd, mConfig.hfr_fps);
+        if (ret < 0) {
+            ALOGE("Sensor cannot run at %dfps", mConfig.hfr_fps);
+            return ret;
+        }
+        mCameraSensor[mCameraId]->hfr_fps = mConfig.hfr_fps;
+    } else if (deviceMode == MODE_VIDEO && mCameraSensor[mCameraId]->hfr_fps > 0) {
+        ret = v4l2_capture_s_framerate(fd, nominalFps);
+        if (ret < 0) {
+            ALOGE("Sensor cannot return to %dfps", nominalFps);
+            return ret;
+        }
+        mCameraSensor[mCameraId]->hfr_fps = 0;
+    }
+
+    status_t status = allocateBuffers(numBuffers, w, h, deviceMode == MODE_CAPTURE);
     if (status != NO_ERROR) {
         ALOGE("error allocating buffers");
         ret = -1;
@@ -651,9 +685,16 @@ status_t CameraDriver::allocateBuffer(int fd, int index)
         return UNKNOWN_ERROR;
     }
 
-    // allocate memory
+    // allocate memory, snapshots go to the same memory every shot
     camBuf->mID = index;
-    mCallbacks->allocateMemory(camBuf, vbuf->length);
+    if (mBufferPool.shared)
+        camBuf->mCamMem = BufferShareRegistry::getInstance()->getSnapshotMemory(index, vbuf->length);
+    else
+        mCallbacks->allocateMemory(camBuf, vbuf->length);
+    if (camBuf->getData() == NULL) {
+        ALOGE("No memory for buffer %d", index);
+        return NO_MEMORY;
+    }
     vbuf->m.userptr = (unsigned int) camBuf->getData();
 
     camBuf->setFormat(mFormat);
@@ -663,7 +704,7 @@ status_t CameraDriver::allocateBuffer(int fd, int index)
     return NO_ERROR;
 }
 
-status_t CameraDriver::allocateBuffers(int numBuffers)
+status_t CameraDriver::allocateBuffers(int numBuffers, int width, int height, bool shared)
 {
     if (mBufferPool.bufs) {
         ALOGE("fail to alloc. non-null buffs");
@@ -687,6 +728,7 @@ status_t CameraDriver::allocateBuffers(int numBuffers)
     }
 
     mBufferPool.bufs = new DriverBuffer[numBuffers];
+    mBufferPool.shared = shared && numBuffers <= MAX_BURST_BUFFERS;
 
     status_t status = NO_ERROR;
     for (int i = 0; i < numBuffers; i++) {
@@ -697,6 +739,10 @@ status_t CameraDriver::allocateBuffers(int numBuffers)
         mBufferPool.numBuffers++;
     }
 
+    // the buffers hold frames of the configured size, not the snapshot size
+    if (mBufferPool.shared)
+        BufferShareRegistry::getInstance()->shareBuffers(numBuffers, width, height, mFormat);
+
     return NO_ERROR;
 
 fail:
@@ -714,7 +760,10 @@ fail:
 status_t CameraDriver::freeBuffer(int index)
 {
     CameraBuffer *camBuf = &mBufferPool.bufs[index].camBuff;
-    camBuf->releaseMemory();
+    if (mBufferPool.shared)
+        camBuf->mCamMem = NULL;
+    else
+        camBuf->releaseMemory();
     return NO_ERROR;
 }
 
@@ -796,13 +845,40 @@ status_t CameraDriver::dequeueBuffer(CameraBuffer **buff, nsecs_t *timestamp)
     *buff = camBuff;
 
     if (timestamp)
-        *timestamp = systemTime();
+        *timestamp = frameTimestamp(vbuff.timestamp);
 
     mBufferPool.numBuffersQueued--;
 
     return NO_ERROR;
 }
 
+/*
+ * Converts the capture time the kernel stamped on a buffer to the
+ * systemTime() clock. Depending on the driver the kernel uses the monotonic
+ * or the wall clock, so both are tried. Falls back to the dequeue time when
+ * the kernel timestamp is missing or unusable.
+ */
+nsecs_t CameraDriver::frameTimestamp(const struct timeval &tv)
+{
+    nsecs_t now = systemTime();
+    nsecs_t kernelTime = seconds_to_nanoseconds(tv.tv_sec) + microseconds_to_nanoseconds(tv.tv_usec);
+
+    if (kernelTime == 0)
+        return now;
+
+    nsecs_t age = now - kernelTime;
+    if (age >= 0 && age < MAX_TIMESTAMP_AGE)
+        return kernelTime;
+
+    // wall clock time stamp, move it to the monotonic clock
+    age = systemTime(SYSTEM_TIME_REALTIME) - kernelTime;
+    if (age >= 0 && age < MAX_TIMESTAMP_AGE)
+        return now - age;
+
+    LOG2("Unusable kernel timestamp %lld, using dequeue time", kernelTime);
+    return now;
+}
+
 int CameraDriver::detectDeviceResolutions()
 {
     LOG1("@%s", __FUNCTION__);
@@ -849,6 +925,33 @@ int CameraDriver::detectDeviceResolutions()
     return 0;
 }
 
+status_t CameraDriver::setHighFrameRate(int fps)
+{
+    LOG1("@%s: fps = %d", __FUNCTION__, fps);
+
+    if (mMode != MODE_NONE) {
+        ALOGE("Frame rate can only be changed while the driver is stopped");
+        return INVALID_OPERATION;
+    }
+
+    if (fps <= NORMAL_FRAME_RATE) {
+        mConfig.hfr_fps = 0;
+        mConfig.num_buffers = NUM_DEFAULT_BUFFERS;
+        return NO_ERROR;
+    }
+
+    // keep about the same amount of time buffered as at the normal rate
+    int numBuffers = NUM_DEFAULT_BUFFERS * fps / NORMAL_FRAME_RATE;
+    if (numBuffers > MAX_HFR_BUFFERS)
+        numBuffers = MAX_HFR_BUFFERS;
+
+    mConfig.hfr_fps = fps;
+    mConfig.num_buffers = numBuffers;
+    LOG1("High frame rate %dfps with %d buffers", fps, numBuffers);
+
+    return NO_ERROR;
+}
+
 status_t CameraDriver::setPreviewFrameSize(int width, int height)
 {
     LOG1("@%s", __FUNCTION__);
@@ -1128,6 +1231,43 @@ int CameraDriver::v4l2_capture_g_framerate(int fd, float *framerate, int width,
     return 0;
 }
 
+int CameraDriver::v4l2_capture_s_framerate(int fd, int fps)
+{
+    LOG1("@%s: fps = %d", __FUNCTION__, fps);
+    struct v4l2_streamparm parm;
+    CLEAR(parm);
+
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(fd, VIDIOC_G_PARM, &parm) < 0) {
+        ALOGE("VIDIOC_G_PARM failed: %s", strerror(errno));
+        return -1;
+    }
+
+    if (!(parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+        ALOGE("Sensor does not support setting the frame interval");
+        return -1;
+    }
+
+    parm.parm.capture.timeperframe.numerator = 1;
+    parm.parm.capture.timeperframe.denominator = fps;
+    if (ioctl(fd, VIDIOC_S_PARM, &parm) < 0) {
+        ALOGE("VIDIOC_S_PARM failed: %s", strerror(errno));
+        return -1;
+    }
+
+    // the driver returns the interval it actually applied
+    struct v4l2_fract *interval = &parm.parm.capture.timeperframe;
+    if (interval->numerator == 0 || interval->denominator == 0) {
+        ALOGE("Invalid frame interval %u/%u", interval->numerator, interval->denominator);
+        return -1;
+    }
+    mConfig.fps = 1.0 * interval->denominator / interval->numerator;
+    LOG1("Sensor frame interval %u/%u (%.2ffps)",
+            interval->numerator, interval->denominator, mConfig.fps);
+
+    return 0;
+}
+
 int CameraDriver::v4l2_capture_s_format(int fd, int w, int h)
 {
     LOG1("@%s", __FUNCTION__);
@@ -1484,6 +1624,7 @@ int CameraDriver::enumerateCameras(){
         }
 
         newDev->fd = -1;
+        newDev->hfr_fps = 0;
 
         //It seems we get all info of a new camera
         ALOGD("%s: Detected camera (%d) %s %s %d",
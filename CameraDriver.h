@@ -116,7 +116,14 @@ public:
     status_t start(Mode mode);
     status_t stop();
 
-    inline int getNumBuffers() { return NUM_DEFAULT_BUFFERS; }
+    // Number of buffers in the preview/recording pool. This grows with the
+    // requested high frame rate so the same time window stays buffered.
+    inline int getNumBuffers() { return mConfig.num_buffers; }
+
+    // Request a high sensor frame rate for MODE_VIDEO. Passing a rate of 30 or
+    // less (or 0) restores the nominal rate when video is next started. Only
+    // valid while stopped.
+    status_t setHighFrameRate(int fps);
 
     status_t getPreviewFrame(CameraBuffer **buff);
     status_t putPreviewFrame(CameraBuffer *buff);
@@ -187,6 +194,8 @@ private:
 
     static const int MAX_CAMERAS         = 8;
     static const int NUM_DEFAULT_BUFFERS = 4;
+    static const int MAX_HFR_BUFFERS     = 16;
+    static const int NORMAL_FRAME_RATE   = 30;
 
     struct FrameInfo {
         int width;      // Frame width
@@ -203,6 +212,8 @@ private:
         FrameInfo snapshot;   // snapshot
         FrameInfo postview;   // postview (thumbnail for capture)
         float fps;            // preview/recording (shared)
+        int hfr_fps;          // requested high frame rate, 0 if disabled
+        int num_buffers;      // number of buffers in the preview/recording pool
         int num_snapshot;     // number of snapshots to take
         int zoom;             // zoom value
     };
@@ -211,6 +222,7 @@ private:
         char *devName;              // device node's name, e.g. /dev/video0
         struct camera_info info;    // camera info defined by Android
         int fd;                     // the file descriptor of device at run time
+        int hfr_fps;                // high frame rate left set on the sensor, 0 if none
 
         /* more fields will be added when we find more 'per camera' data*/
     };
@@ -224,6 +236,7 @@ private:
         int numBuffers;
         int numBuffersQueued;
         DriverBuffer *bufs;
+        bool shared;    // the memory belongs to BufferShareRegistry
     };
 
 // private methods
@@ -250,11 +263,12 @@ private:
 
     // Buffer methods
     status_t allocateBuffer(int fd, int index);
-    status_t allocateBuffers(int numBuffers);
+    status_t allocateBuffers(int numBuffers, int width, int height, bool shared);
     status_t freeBuffer(int index);
     status_t freeBuffers();
     status_t queueBuffer(CameraBuffer *buff, bool init = false);
     status_t dequeueBuffer(CameraBuffer **buff, nsecs_t *timestamp = 0);
+    nsecs_t frameTimestamp(const struct timeval &tv);
 
     status_t v4l2_capture_open(const char *devName);
     status_t v4l2_capture_close(int fd);
@@ -263,6 +277,7 @@ private:
     int set_capture_mode(Mode deviceMode);
     int v4l2_capture_try_format(int fd, int *w, int *h);
     int v4l2_capture_g_framerate(int fd, float * framerate, int width, int height);
+    int v4l2_capture_s_framerate(int fd, int fps);
     int v4l2_capture_s_format(int fd, int w, int h);
     int set_attribute (int fd, int attribute_num,
                                const int value, const char *name);
@@ -17,6 +17,10 @@
 
 #include <camera/CameraParameters.h>
 #include <linux/videodev2.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "ColorConverter.h"
 #include "LogHelper.h"
 
@@ -275,6 +279,90 @@ void NV12ToYV12(int width, int height, void *src, void *dst)
     }
 }
 
+// widest crop window colorConvertCropped can take
+static const int MAX_CROP_WIDTH = 4096;
+
+// dst = a + (b - a) * weight / 256, for weights of 0 to 255
+static void blendRows(const unsigned char *a, const unsigned char *b, int weight,
+        unsigned char *dst, int count)
+{
+    if (weight == 0) {
+        memcpy(dst, a, count);
+        return;
+    }
+
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(256 - weight);
+    const __m128i wb = _mm_set1_epi16(weight);
+    for (; i + 16 <= count; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+        // at most 255 * 256, so the sums fit in 16 bits
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+        _mm_storeu_si128((__m128i *) (dst + i),
+                _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+#endif
+    for (; i < count; i++)
+        dst[i] = (a[i] * (256 - weight) + b[i] * weight) >> 8;
+}
+
+// YUYV crop window to a width x height NV12 (or NV21 if swapUV) frame,
+// bilinear. Positions are in 16.16 fixed point, at the pixel centers.
+static void YUYVCropToNV(int width, int height, int cropX, int cropY,
+        int cropWidth, int cropHeight, bool swapUV, void *src, void *dst)
+{
+    unsigned char row[MAX_CROP_WIDTH * 2];
+    unsigned char *pDstY = (unsigned char *) dst;
+    unsigned char *pDstUV = pDstY + width * height;
+    const unsigned char *pCrop = (unsigned char *) src + (cropY * width + cropX) * 2;
+    int uOffset = swapUV ? 3 : 1;
+    int vOffset = swapUV ? 1 : 3;
+    int stepX = (cropWidth << 16) / width;
+    int stepY = (cropHeight << 16) / height;
+    int pairs = cropWidth / 2;
+
+    for (int i = 0; i < height; i++) {
+        int posY = i * stepY + stepY / 2 - 0x8000;
+        if (posY < 0)
+            posY = 0;
+        int y0 = posY >> 16;
+        int y1 = y0 < cropHeight - 1 ? y0 + 1 : y0;
+        // both chroma and luma of the two source rows at once
+        blendRows(pCrop + y0 * width * 2, pCrop + y1 * width * 2, (posY >> 8) & 0xFF,
+                row, cropWidth * 2);
+
+        int posX = stepX / 2 - 0x8000;
+        for (int j = 0; j < width; j++, posX += stepX) {
+            int p = posX < 0 ? 0 : posX;
+            int x0 = p >> 16;
+            int x1 = x0 < cropWidth - 1 ? x0 + 1 : x0;
+            int a = row[x0 * 2];
+            *pDstY++ = a + (((row[x1 * 2] - a) * ((p >> 8) & 0xFF)) >> 8);
+        }
+
+        // 4:2:0 chroma, skip odd numbered rows
+        if ((i % 2) == 0) {
+            posX = stepX / 2 - 0x8000;
+            for (int j = 0; j < width / 2; j++, posX += stepX) {
+                int p = posX < 0 ? 0 : posX;
+                int x0 = p >> 16;
+                int x1 = x0 < pairs - 1 ? x0 + 1 : x0;
+                int f = (p >> 8) & 0xFF;
+                int u = row[x0 * 4 + uOffset];
+                int v = row[x0 * 4 + vOffset];
+                *pDstUV++ = u + (((row[x1 * 4 + uOffset] - u) * f) >> 8);
+                *pDstUV++ = v + (((row[x1 * 4 + vOffset] - v) * f) >> 8);
+            }
+        }
+    }
+}
+
 static status_t colorConvertYUYV(int dstFormat, int width, int height, void *src, void *dst)
 {
     switch (dstFormat) {
@@ -336,6 +424,35 @@ status_t colorConvert(int srcFormat, int dstFormat, int width, int height, void
     };
 }
 
+status_t colorConvertCropped(int srcFormat, int dstFormat, int width, int height,
+        int cropX, int cropY, int cropWidth, int cropHeight, void *src, void *dst)
+{
+    if (cropX == 0 && cropY == 0 && cropWidth == width && cropHeight == height)
+        return colorConvert(srcFormat, dstFormat, width, height, src, dst);
+
+    if (srcFormat != V4L2_PIX_FMT_YUYV || (cropX & 1) || (cropWidth & 1)
+            || cropWidth > MAX_CROP_WIDTH || cropWidth < 2 || cropHeight < 1
+            || cropX < 0 || cropY < 0
+            || cropX + cropWidth > width || cropY + cropHeight > height) {
+        ALOGE("unsupported cropped conversion");
+        return BAD_VALUE;
+    }
+
+    switch (dstFormat) {
+    case V4L2_PIX_FMT_NV12:
+        YUYVCropToNV(width, height, cropX, cropY, cropWidth, cropHeight, false, src, dst);
+        break;
+    case V4L2_PIX_FMT_NV21:
+        YUYVCropToNV(width, height, cropX, cropY, cropWidth, cropHeight, true, src, dst);
+        break;
+    default:
+        ALOGE("Invalid color format (dest)");
+        return BAD_VALUE;
+    };
+
+    return NO_ERROR;
+}
+
 const char *cameraParametersFormat(int v4l2Format)
 {
     switch (v4l2Format) {
@@ -23,6 +23,12 @@ namespace android {
 
 status_t colorConvert(int srcFormat, int dstFormat, int width, int height, void *src, void *dst);
 
+// Same as colorConvert but the destination is the cropWidth x cropHeight
+// window of the source at (cropX, cropY), scaled to the full width x height.
+// Only YUYV to NV12/NV21 is supported and cropX and cropWidth must be even.
+status_t colorConvertCropped(int srcFormat, int dstFormat, int width, int height,
+        int cropX, int cropY, int cropWidth, int cropHeight, void *src, void *dst);
+
 const char *cameraParametersFormat(int v4l2Format);
 int V4L2Format(const char *cameraParamsFormat);
 
@@ -21,9 +21,11 @@
 #include "PictureThread.h"
 #include "CameraDriver.h"
 #include "Callbacks.h"
+#include "BufferShareRegistry.h"
 #include "ColorConverter.h"
 #include "FaceDetectorFactory.h"
 #include "EXIFFields.h"
+#include "IntelParameters.h"
 #include <utils/Vector.h>
 #include <math.h>
 
@@ -34,6 +36,34 @@ namespace android {
  */
 #define ASPECT_TOLERANCE 0.001
 
+/*
+ * PREVIEW_FRAME_RATE: preview rate kept while recording at a high frame rate
+ */
+#define PREVIEW_FRAME_RATE 30
+
+/*
+ * MAX_SNAPSHOT_COPIES: maximum number of frame copies that can be in flight
+ * to PictureThread at the same time
+ */
+#define MAX_SNAPSHOT_COPIES 2
+
+/*
+ * Returns true if value is one of the entries of a comma separated list
+ */
+static bool isValueInList(int value, const char *list)
+{
+    while (list != NULL && *list != '\0') {
+        char *end;
+        long entry = strtol(list, &end, 10);
+        if (end == list)
+            return false;
+        if (entry == value)
+            return true;
+        list = (*end == ',') ? end + 1 : NULL;
+    }
+    return false;
+}
+
 ControlThread::ControlThread(int cameraId) :
     Thread(true) // callbacks may call into java
     ,mDriver(new CameraDriver(cameraId))
@@ -45,12 +75,17 @@ ControlThread::ControlThread(int cameraId) :
     ,mState(STATE_STOPPED)
     ,mThreadRunning(false)
     ,mCallbacks(Callbacks::getInstance())
+    ,mBufferShare(BufferShareRegistry::getInstance())
     ,mNumBuffers(mDriver->getNumBuffers())
     ,m_pFaceDetector(0)
     ,mFaceDetectionActive(false)
     ,mThumbSupported(false)
-    ,mLastRecordingBuff(0)
+    ,mVideoSnapshotRequested(false)
+    ,mPreviewAfterCapture(false)
+    ,mLastRecordingTimestamp(0)
     ,mCameraFormat(mDriver->getFormat())
+    ,mPreviewDecimation(1)
+    ,mFrameCount(0)
 {
     LOG1("@%s: cameraId = %d", __FUNCTION__, cameraId);
 
@@ -99,9 +134,12 @@ ControlThread::~ControlThread()
     mPipeThread->requestExitAndWait();
     mPipeThread.clear();
 
+    freeSnapshotCopyBuffers();
+
     if (mDriver != NULL) {
         delete mDriver;
     }
+    mBufferShare->releaseBuffers();
     if (mCallbacks != NULL) {
         delete mCallbacks;
     }
@@ -119,6 +157,7 @@ void ControlThread::initDefaultParams()
     // get default params from CameraDriver and JPEG encoder
     mDriver->getDefaultParameters(&mParameters);
     mPictureThread->getDefaultParameters(&mParameters);
+    mPipeThread->getDefaultParameters(&mParameters);
 
     // preview format
     mParameters.setPreviewFormat(CameraParameters::PIXEL_FORMAT_YUV420SP);
@@ -132,6 +171,20 @@ void ControlThread::initDefaultParams()
     // video format
     mParameters.set(CameraParameters::KEY_VIDEO_FRAME_FORMAT,
             CameraParameters::PIXEL_FORMAT_YUV420SP);
+
+    // pictures are JPEG or the frames of the sensor as they are
+    const char *rawFormat = cameraParametersFormat(mCameraFormat);
+    if (rawFormat != NULL) {
+        char pictureFormats[100] = {0};
+        snprintf(pictureFormats, sizeof(pictureFormats), "%s,%s",
+                CameraParameters::PIXEL_FORMAT_JPEG, rawFormat);
+        mParameters.set(CameraParameters::KEY_SUPPORTED_PICTURE_FORMATS, pictureFormats);
+    }
+    updatePictureStride(&mParameters);
+
+    // multi-frame noise reduction
+    mParameters.set(IntelCameraParameters::KEY_MFNR_FRAMES, "0");
+    mParameters.set(IntelCameraParameters::KEY_SUPPORTED_MFNR_FRAMES, "0,4,6,8");
 }
 
 status_t ControlThread::setPreviewWindow(struct preview_stream_ops *window)
@@ -284,6 +337,42 @@ bool ControlThread::isThumbSupported(State state)
     return supported;
 }
 
+// Whether pictures skip JPEG and are sent as the sensor delivers them
+bool ControlThread::isRawPicture()
+{
+    const char *format = mParameters.getPictureFormat();
+    return format != NULL && strcmp(format, CameraParameters::PIXEL_FORMAT_JPEG) != 0 &&
+            V4L2Format(format) == mCameraFormat;
+}
+
+// Snapshot rows are not padded
+void ControlThread::updatePictureStride(CameraParameters *params)
+{
+    int width, height;
+    params->getPictureSize(&width, &height);
+    int stride = mCameraFormat == V4L2_PIX_FMT_YUYV ? width * 2 : width;
+    params->set(IntelCameraParameters::KEY_PICTURE_STRIDE, stride);
+}
+
+/*
+ * getScreennail: fills in the screennail of still pictures, which is left
+ * 0x0 if it is off or not smaller than the picture
+ */
+void ControlThread::getScreennail(State state, int pictureWidth, int pictureHeight,
+        PictureThread::Image *screennail)
+{
+    int width = 0, height = 0;
+    const char *size = mParameters.get(IntelCameraParameters::KEY_SCREENNAIL_SIZE);
+    if ((state == STATE_PREVIEW_STILL || state == STATE_CAPTURE) && size != NULL &&
+            sscanf(size, "%dx%d", &width, &height) == 2 &&
+            width > 0 && height > 0 && width < pictureWidth && height < pictureHeight) {
+        screennail->format = mCameraFormat;
+        screennail->quality = mParameters.getInt(CameraParameters::KEY_JPEG_QUALITY);
+        screennail->width = width;
+        screennail->height = height;
+    }
+}
+
 status_t ControlThread::gatherExifInfo(const CameraParameters *params, bool flash, exif_attribute_t *exif)
 {
     status_t status = NO_ERROR;
@@ -550,6 +639,13 @@ status_t ControlThread::returnConversionBuffer(CameraBuffer *buff)
 {
     status_t status = NO_ERROR;
 
+    for (size_t i = 0; i < mSnapshotCopies.size(); i++) {
+        if (mSnapshotCopies[i] == buff) {
+            mFreeSnapshotCopies.push(buff);
+            return status;
+        }
+    }
+
     if (mConversionBuffers == 0)
         return status;
 
@@ -562,6 +658,137 @@ status_t ControlThread::returnConversionBuffer(CameraBuffer *buff)
     return DEAD_OBJECT;
 }
 
+CameraBuffer* ControlThread::getSnapshotCopyBuffer(int size)
+{
+    LOG1("@%s: size = %d", __FUNCTION__, size);
+    CameraBuffer *buff;
+
+    // reuse a copy that is big enough
+    for (size_t i = 0; i < mFreeSnapshotCopies.size(); i++) {
+        buff = mFreeSnapshotCopies[i];
+        if (buff->getData() != 0 && buff->mSize >= size) {
+            mFreeSnapshotCopies.removeAt(i);
+            return buff;
+        }
+    }
+
+    if (!mFreeSnapshotCopies.isEmpty()) {
+        // resize one of the free copies
+        buff = mFreeSnapshotCopies.editTop();
+        mFreeSnapshotCopies.pop();
+    } else if ((int) mSnapshotCopies.size() < MAX_SNAPSHOT_COPIES) {
+        buff = new CameraBuffer;
+        buff->mID = mSnapshotCopies.size();
+        buff->mType = BUFFER_TYPE_INTERMEDIATE;
+        buff->mOwner = this;
+        mSnapshotCopies.push(buff);
+    } else {
+        ALOGE("All %d snapshot copies are in use", MAX_SNAPSHOT_COPIES);
+        return 0;
+    }
+
+    mCallbacks->allocateMemory(buff, size);
+    if (buff->getData() == 0) {
+        ALOGE("No memory for snapshot copy");
+        buff->mSize = 0;
+        mFreeSnapshotCopies.push(buff);
+        return 0;
+    }
+    buff->mSize = size;
+
+    return buff;
+}
+
+// Returns a copy of buff for PictureThread, or 0 if all copies are in use
+CameraBuffer* ControlThread::copySnapshot(CameraBuffer *buff)
+{
+    int size = buff->getCameraMem()->size;
+    CameraBuffer *copy = getSnapshotCopyBuffer(size);
+    if (copy == 0)
+        return 0;
+
+    memcpy(copy->getData(), buff->getData(), size);
+    copy->setFormat(mCameraFormat);
+    return copy;
+}
+
+void ControlThread::freeSnapshotCopyBuffers()
+{
+    LOG1("@%s", __FUNCTION__);
+    for (size_t i = 0; i < mSnapshotCopies.size(); i++) {
+        mSnapshotCopies[i]->releaseMemory();
+        delete mSnapshotCopies[i];
+    }
+    mSnapshotCopies.clear();
+    mFreeSnapshotCopies.clear();
+}
+
+/*
+ * mergeSnapshots: takes numFrames - 1 more frames from the driver right after
+ * the snapshot and merges them into it. Each frame goes back to the driver
+ * once it is merged, so the burst needs no more capture buffers. The picture
+ * keeps the frames merged so far if the burst breaks off.
+ */
+void ControlThread::mergeSnapshots(CameraBuffer *snapshot, int numFrames, int width, int height)
+{
+    LOG1("@%s: %d frames", __FUNCTION__, numFrames);
+    nsecs_t startTime = systemTime();
+    if (mMultiFrameDenoiser.setConfig(mCameraFormat, width, height) != NO_ERROR ||
+            mMultiFrameDenoiser.start(snapshot->getData()) != NO_ERROR) {
+        ALOGW("No multi-frame noise reduction, taking a single frame");
+        return;
+    }
+
+    nsecs_t captureTime = 0;
+    int merged = 1;
+    while (merged < numFrames) {
+        CameraBuffer *frame;
+        nsecs_t captureStart = systemTime();
+        if (mDriver->getSnapshot(&frame) != NO_ERROR) {
+            ALOGE("Error in grabbing burst frame %d!", merged);
+            break;
+        }
+        captureTime += systemTime() - captureStart;
+
+        status_t status = mMultiFrameDenoiser.add(frame->getData());
+        if (mDriver->putSnapshot(frame) != NO_ERROR)
+            ALOGE("Error in putting burst frame!");
+        if (status != NO_ERROR)
+            break;
+        merged++;
+    }
+    mMultiFrameDenoiser.finish();
+
+    nsecs_t totalTime = systemTime() - startTime;
+    ALOGD("%d frames merged in %ums (capture %ums), %ums per added frame",
+            merged,
+            (unsigned)(totalTime / 1000000),
+            (unsigned)(captureTime / 1000000),
+            merged > 1 ? (unsigned)(totalTime / (merged - 1) / 1000000) : 0);
+}
+
+status_t ControlThread::takeVideoSnapshot(CameraBuffer *buff, nsecs_t timestamp)
+{
+    LOG1("@%s: buff id = %d", __FUNCTION__, buff->getID());
+    status_t status = NO_ERROR;
+
+    // PictureThread makes the copy, so recording frames are not held up by it
+    CameraBuffer *copy = getSnapshotCopyBuffer(buff->getCameraMem()->size);
+    if (copy == 0)
+        return NO_MEMORY;
+    copy->setFormat(mCameraFormat);
+    LOG1("Video snapshot from frame at interval %ums",
+            (unsigned)((timestamp - mLastRecordingTimestamp) / 1000000));
+
+    status = mPictureThread->encodeCopy(buff, copy);
+    if (status != NO_ERROR) {
+        ALOGE("Error sending video snapshot to PictureThread");
+        mFreeSnapshotCopies.push(copy);
+    }
+
+    return status;
+}
+
 void ControlThread::sendCommand(int32_t cmd, int32_t arg1, int32_t arg2)
 {
     Message msg;
@@ -638,6 +865,45 @@ status_t ControlThread::startPreviewCore(bool videoMode)
     }
 
     mPipeThread->setConfig(mCameraFormat, previewFormat, previewWidth, previewHeight);
+    status = mPipeThread->setTemporalNoiseReduction(videoMode &&
+            isParameterSet(IntelCameraParameters::KEY_TEMPORAL_NOISE_REDUCTION));
+    if (status != NO_ERROR)
+        ALOGW("Temporal noise reduction not available, continuing without it");
+    mPipeThread->setVideoStabilization(videoMode &&
+            isParameterSet(CameraParameters::KEY_VIDEO_STABILIZATION));
+
+    // get the capture resources ready, video snapshots are taken at video size
+    PictureThread::Config pictureConfig;
+    memset(&pictureConfig, 0, sizeof(pictureConfig));
+    pictureConfig.picture.format = mCameraFormat;
+    pictureConfig.picture.quality = mParameters.getInt(CameraParameters::KEY_JPEG_QUALITY);
+    if (videoMode) {
+        pictureConfig.picture.width = videoWidth;
+        pictureConfig.picture.height = videoHeight;
+    } else {
+        mParameters.getPictureSize(&pictureConfig.picture.width, &pictureConfig.picture.height);
+        if (isThumbSupported(state)) {
+            pictureConfig.thumbnail.format = mCameraFormat;
+            pictureConfig.thumbnail.quality = mParameters.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY);
+            pictureConfig.thumbnail.width = mParameters.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
+            pictureConfig.thumbnail.height = mParameters.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
+        }
+        getScreennail(state, pictureConfig.picture.width, pictureConfig.picture.height,
+                &pictureConfig.screennail);
+    }
+    if (!isRawPicture())
+        mPictureThread->prepare(&pictureConfig);
+
+    // high frame rate recording is only possible in video mode, it also
+    // enlarges the buffer pool so it must be set before allocating buffers
+    int recordingFps = 0;
+    if (videoMode)
+        recordingFps = mParameters.getInt(IntelCameraParameters::KEY_RECORDING_FRAME_RATE);
+    status = mDriver->setHighFrameRate(recordingFps);
+    if (status != NO_ERROR) {
+        ALOGE("Error setting recording frame rate %d", recordingFps);
+        return status;
+    }
 
     mNumBuffers = mDriver->getNumBuffers();
     mConversionBuffers = new CameraBuffer[mNumBuffers];
@@ -655,6 +921,15 @@ status_t ControlThread::startPreviewCore(bool videoMode)
     status = mDriver->start(mode);
     if (status == NO_ERROR) {
         mState = state;
+        mFrameCount = 0;
+        mPreviewDecimation = 1;
+        if (recordingFps > PREVIEW_FRAME_RATE) {
+            mPreviewDecimation = (int) (mDriver->getFrameRate() / PREVIEW_FRAME_RATE + 0.5f);
+            if (mPreviewDecimation < 1)
+                mPreviewDecimation = 1;
+            LOG1("Sensor running at %.2ffps, preview gets 1 of every %d frames",
+                    mDriver->getFrameRate(), mPreviewDecimation);
+        }
     } else {
         ALOGE("Error starting driver!");
     }
@@ -675,6 +950,10 @@ status_t ControlThread::stopPreviewCore()
     if (status != NO_ERROR)
         ALOGE("error flushing preview buffers");
 
+    status = mPictureThread->waitForCopies();
+    if (status != NO_ERROR)
+        ALOGE("error waiting for video snapshot copies");
+
     status = mDriver->stop();
     if (status == NO_ERROR) {
         mState = STATE_STOPPED;
@@ -688,7 +967,11 @@ status_t ControlThread::stopPreviewCore()
     delete [] mConversionBuffers;
     mFreeBuffers.clear();
     mConversionBuffers = 0;
-    mLastRecordingBuff = 0;
+
+    if (mVideoSnapshotRequested) {
+        ALOGW("Preview stopped before a frame was available for the video snapshot");
+        mVideoSnapshotRequested = false;
+    }
 
     return status;
 }
@@ -736,6 +1019,12 @@ status_t ControlThread::handleMessageStartPreview()
 {
     LOG1("@%s", __FUNCTION__);
     status_t status;
+    if (mState == STATE_PREVIEW_STILL && mPreviewAfterCapture) {
+        // preview was restarted when the picture was taken
+        mPreviewAfterCapture = false;
+        mMessageQueue.reply(MESSAGE_ID_START_PREVIEW, NO_ERROR);
+        return NO_ERROR;
+    }
     if (mState == STATE_CAPTURE) {
         status = stopCapture();
         if (status != NO_ERROR) {
@@ -763,6 +1052,7 @@ status_t ControlThread::handleMessageStopPreview()
 {
     LOG1("@%s", __FUNCTION__);
     status_t status = NO_ERROR;
+    mPreviewAfterCapture = false;
     // In STATE_CAPTURE, preview is already stopped, nothing to do
     if (mState != STATE_CAPTURE) {
         stopFaceDetection(true);
@@ -772,6 +1062,9 @@ status_t ControlThread::handleMessageStopPreview()
             ALOGE("Error stopping preview. Invalid state!");
             status = INVALID_OPERATION;
         }
+        // no more shots for now, the driver does not hold the snapshot memory
+        mBufferShare->releaseBuffers();
+        mMultiFrameDenoiser.release();
     }
     // return status and unblock message sender
     mMessageQueue.reply(MESSAGE_ID_STOP_PREVIEW, status);
@@ -804,6 +1097,9 @@ status_t ControlThread::handleMessageStartRecording()
         status = INVALID_OPERATION;
     }
 
+    if (status == NO_ERROR)
+        mVideoThread->setFrameRate(mDriver->getFrameRate());
+
     // return status and unblock message sender
     mMessageQueue.reply(MESSAGE_ID_START_RECORDING, status);
     return status;
@@ -841,6 +1137,7 @@ status_t ControlThread::handleMessageTakePicture()
     }
 
     stopFaceDetection();
+    mPreviewAfterCapture = false;
 
     if (origState == STATE_PREVIEW_STILL) {
         status = stopPreviewCore();
@@ -870,6 +1167,7 @@ status_t ControlThread::handleMessageTakePicture()
 
     // Configure PictureThread
     PictureThread::Config config;
+    memset(&config, 0, sizeof(config));
 
     if (origState == STATE_PREVIEW_STILL) {
         gatherExifInfo(&mParameters, false, &config.exif);
@@ -892,6 +1190,11 @@ status_t ControlThread::handleMessageTakePicture()
         config.thumbnail.width = mParameters.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
         config.thumbnail.height = mParameters.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
     }
+    getScreennail(origState, width, height, &config.screennail);
+
+    // otherwise the rotation is only written to EXIF
+    if (isParameterSet(IntelCameraParameters::KEY_LOSSLESS_ROTATION))
+        config.rotation = mParameters.getInt(CameraParameters::KEY_ROTATION);
 
     mPictureThread->setConfig(&config);
 
@@ -912,29 +1215,85 @@ status_t ControlThread::handleMessageTakePicture()
         snapshotBuffer->setOwner(this);
         snapshotBuffer->mType = BUFFER_TYPE_SNAPSHOT;
 
+        // Uncompressed pictures are handed over as they are, without
+        // PictureThread. The callback copies the data, so the snapshot goes
+        // straight back to the driver: a return message would only be handled
+        // after the driver is stopped for the preview below.
+        if (isRawPicture()) {
+            mCallbacks->shutterSound();
+            snapshotBuffer->incrementReader();
+            mCallbacks->rawFrameDone(snapshotBuffer);
+            returnSnapshotBuffer(snapshotBuffer);
+            snapshotBuffer->decrementReader();
+            if (isParameterSet(IntelCameraParameters::KEY_PREVIEW_AFTER_CAPTURE) &&
+                    (status = mDriver->stop()) == NO_ERROR) {
+                mState = STATE_STOPPED;
+                if ((status = startPreviewCore(false)) == NO_ERROR)
+                    mPreviewAfterCapture = true;
+                else
+                    ALOGE("Could not restart preview after capture!");
+            }
+            return status;
+        }
+
+        // The following frames of a burst are merged into the snapshot
+        int mfnrFrames = mParameters.getInt(IntelCameraParameters::KEY_MFNR_FRAMES);
+        if (mfnrFrames > 1)
+            mergeSnapshots(snapshotBuffer, mfnrFrames, width, height);
+
+        // Without a postview from the driver PictureThread scales the
+        // thumbnail down from the snapshot
         if (mThumbSupported) {
-            if ((status = mDriver->getThumbnail(&postviewBuffer)) != NO_ERROR) {
-                ALOGE("Error in grabbing thumbnail!");
-            }else if (postviewBuffer != 0)
-            {
+            if (mDriver->getThumbnail(&postviewBuffer) != NO_ERROR) {
+                LOG1("No postview from driver");
+                postviewBuffer = 0;
+            } else if (postviewBuffer != 0) {
                 postviewBuffer->setOwner(this);
                 postviewBuffer->mType = BUFFER_TYPE_THUMBNAIL;
             }
-            postviewBuffer->setOwner(this);
         }
 
         mCallbacks->shutterSound();
 
-        if (postviewBuffer != 0) {
+        // With a copy of the snapshot the driver can go back to preview
+        // right away, PictureThread encodes the copy in the background
+        CameraBuffer *copy = 0;
+        if (postviewBuffer == 0 && isParameterSet(IntelCameraParameters::KEY_PREVIEW_AFTER_CAPTURE)) {
+            nsecs_t startTime = systemTime();
+            copy = copySnapshot(snapshotBuffer);
+            if (copy != 0) {
+                LOG1("Snapshot copied in %ums", (unsigned)((systemTime() - startTime) / 1000000));
+            } else {
+                ALOGW("No snapshot copy, preview restarts after encoding");
+            }
+        }
+
+        if (copy != 0 && mPictureThread->encode(copy) != NO_ERROR) {
+            ALOGE("Error sending snapshot copy to PictureThread");
+            mFreeSnapshotCopies.push(copy);
+            copy = 0;
+        }
+
+        if (copy != 0) {
+            // Unlike stopCapture, PictureThread is not flushed so the copy
+            // still gets encoded. The snapshot buffer goes with the driver.
+            if ((status = mDriver->stop()) == NO_ERROR) {
+                mState = STATE_STOPPED;
+                if ((status = startPreviewCore(false)) == NO_ERROR)
+                    mPreviewAfterCapture = true;
+                else
+                    ALOGE("Could not restart preview after capture!");
+            }
+        } else if (postviewBuffer != 0) {
             status = mPictureThread->encode(snapshotBuffer, postviewBuffer);
         } else {
             status = mPictureThread->encode(snapshotBuffer);
         }
     } else {
-        // If we are in video mode we simply use the recording buffer for picture encoding
+        // In video mode PictureThread copies the next recording frame and
+        // encodes the copy, so the recording buffers keep flowing.
         // No need to stop, reconfigure, and restart the driver
-        if (mLastRecordingBuff !=0)
-            status = mPictureThread->encode(mLastRecordingBuff);
+        mVideoSnapshotRequested = true;
     }
 
     return status;
@@ -1074,6 +1433,15 @@ status_t ControlThread::validateParameters(const CameraParameters *params)
         return BAD_VALUE;
     }
 
+    // HIGH FRAME RATE RECORDING
+    const char *recordingFps = params->get(IntelCameraParameters::KEY_RECORDING_FRAME_RATE);
+    if (recordingFps != NULL &&
+            !isValueInList(atoi(recordingFps),
+                params->get(IntelCameraParameters::KEY_SUPPORTED_RECORDING_FRAME_RATES))) {
+        ALOGE("bad recording frame rate %s", recordingFps);
+        return BAD_VALUE;
+    }
+
     // VIDEO
     int videoWidth, videoHeight;
     params->getPreviewSize(&videoWidth, &videoHeight);
@@ -1090,6 +1458,35 @@ status_t ControlThread::validateParameters(const CameraParameters *params)
         return BAD_VALUE;
     }
 
+    // PICTURE FORMAT
+    const char *pictureFormat = params->getPictureFormat();
+    const char *pictureFormats = params->get(CameraParameters::KEY_SUPPORTED_PICTURE_FORMATS);
+    if (pictureFormat == NULL || pictureFormats == NULL ||
+            strstr(pictureFormats, pictureFormat) == NULL) {
+        ALOGE("bad picture format");
+        return BAD_VALUE;
+    }
+
+    // SCREENNAIL
+    const char *screennailSize = params->get(IntelCameraParameters::KEY_SCREENNAIL_SIZE);
+    if (screennailSize != NULL) {
+        int width, height;
+        if (sscanf(screennailSize, "%dx%d", &width, &height) != 2 ||
+                width < 0 || height < 0 || (width | height) & 1) {
+            ALOGE("bad screennail size %s", screennailSize);
+            return BAD_VALUE;
+        }
+    }
+
+    // MULTI-FRAME NOISE REDUCTION
+    const char *mfnrFrames = params->get(IntelCameraParameters::KEY_MFNR_FRAMES);
+    if (mfnrFrames != NULL &&
+            !isValueInList(atoi(mfnrFrames),
+                params->get(IntelCameraParameters::KEY_SUPPORTED_MFNR_FRAMES))) {
+        ALOGE("bad multi-frame noise reduction frames %s", mfnrFrames);
+        return BAD_VALUE;
+    }
+
     // ZOOM
     int zoom = params->getInt(CameraParameters::KEY_ZOOM);
     int maxZoom = params->getInt(CameraParameters::KEY_MAX_ZOOM);
@@ -1257,6 +1654,35 @@ status_t ControlThread::processDynamicParameters(const CameraParameters *oldPara
         status = processParamSetMeteringAreas(oldParams, newParams);
     }
 
+    if (status == NO_ERROR) {
+        // video stabilization
+        status = processParamVideoStabilization(oldParams, newParams);
+    }
+
+    return status;
+}
+
+status_t ControlThread::processParamVideoStabilization(const CameraParameters *oldParams,
+        CameraParameters *newParams)
+{
+    LOG1("@%s", __FUNCTION__);
+    status_t status = NO_ERROR;
+    const char* oldValue = oldParams->get(CameraParameters::KEY_VIDEO_STABILIZATION);
+    const char* newValue = newParams->get(CameraParameters::KEY_VIDEO_STABILIZATION);
+
+    if (newValue && oldValue && strncmp(newValue, oldValue, MAX_PARAM_VALUE_LENGTH) != 0) {
+        bool enable = !strncmp(newValue, CameraParameters::TRUE, strlen(CameraParameters::TRUE));
+        bool videoMode = isParameterSet(CameraParameters::KEY_RECORDING_HINT) ? true : false;
+
+        // frames only go through the stabilizer in video mode, it is
+        // configured on preview start otherwise
+        if (videoMode && mState != STATE_STOPPED)
+            status = mPipeThread->setVideoStabilization(enable);
+        if (status == NO_ERROR) {
+            LOG1("Changed: %s -> %s", CameraParameters::KEY_VIDEO_STABILIZATION, newValue);
+        }
+    }
+
     return status;
 }
 
@@ -1783,6 +2209,25 @@ status_t ControlThread::processStaticParameters(const CameraParameters *oldParam
         }
     }
 
+    // a new recording frame rate needs a reconfigured sensor and buffer pool
+    if (newParams->getInt(IntelCameraParameters::KEY_RECORDING_FRAME_RATE) !=
+            oldParams->getInt(IntelCameraParameters::KEY_RECORDING_FRAME_RATE)) {
+        LOG1("Recording frame rate is changing: old=%d; new=%d",
+                oldParams->getInt(IntelCameraParameters::KEY_RECORDING_FRAME_RATE),
+                newParams->getInt(IntelCameraParameters::KEY_RECORDING_FRAME_RATE));
+        if (videoMode)
+            previewFormatChanged = true;
+    }
+
+    // the denoiser reference buffer is set up with the pipe
+    const char *oldTnr = oldParams->get(IntelCameraParameters::KEY_TEMPORAL_NOISE_REDUCTION);
+    const char *newTnr = newParams->get(IntelCameraParameters::KEY_TEMPORAL_NOISE_REDUCTION);
+    if (newTnr != NULL && (oldTnr == NULL || strcmp(oldTnr, newTnr) != 0)) {
+        LOG1("Temporal noise reduction is changing: old=%s; new=%s", oldTnr, newTnr);
+        if (videoMode)
+            previewFormatChanged = true;
+    }
+
     // if preview is running and static params have changed, then we need
     // to stop, reconfigure, and restart the driver and all threads.
     if (previewFormatChanged) {
@@ -1842,6 +2287,7 @@ status_t ControlThread::handleMessageSetParameters(MessageSetParameters *msg)
     if (status != NO_ERROR)
         goto exit;
 
+    updatePictureStride(&newParams);
     mParameters = newParams;
 
     // Take care of parameters that need to be set while the driver is stopped
@@ -2086,25 +2532,55 @@ status_t ControlThread::dequeueRecording()
         buff->setOwner(this);
         buff->mType = BUFFER_TYPE_VIDEO;
 
+        // The frame of a video snapshot is copied on another thread. This
+        // thread holds a reader on it until it is passed on, so the frame
+        // does not go back to the driver before the copy is made.
+        bool snapshot = mVideoSnapshotRequested;
+        if (snapshot) {
+            mVideoSnapshotRequested = false;
+            buff->incrementReader();
+            if (takeVideoSnapshot(buff, timestamp) != NO_ERROR)
+                ALOGE("Error taking video snapshot");
+        }
+        mLastRecordingTimestamp = timestamp;
+
+        // With a high frame rate only every n-th frame goes to preview. While
+        // not recording, the other frames go straight back to the driver
+        // without a trip through the pipe and its messages.
+        bool previewFrame = (mFrameCount++ % mPreviewDecimation) == 0;
+        if (!previewFrame && mState != STATE_RECORDING) {
+            if (!snapshot)
+                return mDriver->putRecordingFrame(buff);
+            buff->decrementReader();
+            return NO_ERROR;
+        }
+
         int width, height;
         mParameters.getVideoSize(&width, &height);
         CameraBuffer *convBuff = getFreeBuffer();
         if (convBuff == 0) {
             ALOGE("No intermediate buffers left");
             status = NO_MEMORY;
-            returnBuffer(buff);
+            if (snapshot)
+                buff->decrementReader();
+            else
+                returnBuffer(buff);
             return status;
         }
-        mLastRecordingBuff = buff;
         // See if recording has started.
         // If it has, process the buffer
         // If it hasn't, do preview only
 
         if (mState == STATE_RECORDING) {
-            status = mPipeThread->previewVideo(buff, convBuff, timestamp);
+            if (previewFrame)
+                status = mPipeThread->previewVideo(buff, convBuff, timestamp);
+            else
+                status = mPipeThread->video(buff, convBuff, timestamp);
         } else {
             status = mPipeThread->preview(buff, convBuff);
         }
+        if (snapshot)
+            buff->decrementReader();
     } else {
         ALOGE("Error: getting recording from driver\n");
     }
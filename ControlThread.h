@@ -26,6 +26,7 @@
 #include "PictureThread.h"
 #include "VideoThread.h"
 #include "PipeThread.h"
+#include "MultiFrameDenoiser.h"
 #include "CameraCommon.h"
 #include "IFaceDetectionListener.h"
 namespace android {
@@ -213,6 +214,14 @@ private:
     status_t returnThumbnailBuffer(CameraBuffer *buff);
     status_t returnConversionBuffer(CameraBuffer *buff);
 
+    // copies of captured frames, owned by ControlThread and handed to
+    // PictureThread so that the original can go back to the driver
+    CameraBuffer* getSnapshotCopyBuffer(int size);
+    CameraBuffer* copySnapshot(CameraBuffer *buff);
+    void freeSnapshotCopyBuffers();
+    void mergeSnapshots(CameraBuffer *snapshot, int numFrames, int width, int height);
+    status_t takeVideoSnapshot(CameraBuffer *buff, nsecs_t timestamp);
+
     // thread message execution functions
     status_t handleMessageExit();
     status_t handleMessageStartPreview();
@@ -245,6 +254,10 @@ private:
     // parameters handling functions
     bool isParameterSet(const char* param);
     bool isThumbSupported(State state);
+    bool isRawPicture();
+    void updatePictureStride(CameraParameters *params);
+    void getScreennail(State state, int pictureWidth, int pictureHeight,
+            PictureThread::Image *screennail);
 
     status_t gatherExifInfo(const CameraParameters *params, bool flash, exif_attribute_t *exif);
 
@@ -268,6 +281,8 @@ private:
             CameraParameters *newParams);
     status_t processParamSetMeteringAreas(const CameraParameters * oldParams,
             CameraParameters * newParams);
+    status_t processParamVideoStabilization(const CameraParameters *oldParams,
+            CameraParameters *newParams);
 
     bool verifyCameraWindow(const CameraWindow &win);
     void preSetCameraWindows(CameraWindow* focusWindows, size_t winCount);
@@ -308,6 +323,8 @@ private:
     State mState;
     bool mThreadRunning;
     Callbacks *mCallbacks;
+    BufferShareRegistry *mBufferShare; // snapshot memory kept from shot to shot
+    MultiFrameDenoiser mMultiFrameDenoiser;
 
     CameraBuffer *mConversionBuffers;
     int mNumBuffers;
@@ -319,9 +336,17 @@ private:
     bool mAutoFocusActive;
     bool mThumbSupported;
 
-    CameraBuffer* mLastRecordingBuff;
+    Vector<CameraBuffer *> mSnapshotCopies;     // all allocated copy buffers
+    Vector<CameraBuffer *> mFreeSnapshotCopies; // copy buffers held by no reader
+    bool mVideoSnapshotRequested;
+    bool mPreviewAfterCapture;  // takePicture restarted preview by itself
+    nsecs_t mLastRecordingTimestamp;
     int mCameraFormat;
 
+    // high frame rate recording: preview only gets every n-th frame
+    int mPreviewDecimation;
+    unsigned int mFrameCount;
+
 
 }; // class ControlThread
 
@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_ExifTemplate"
+
+#include <stddef.h>
+#include <string.h>
+#include "ExifTemplate.h"
+#include "LogHelper.h"
+
+namespace android {
+
+static const int MAX_EXIF_SIZE = 0xFFFF;
+
+// APP1 marker, length and "Exif\0\0" come before the TIFF header
+static const int TIFF_OFFSET = 10;
+static const unsigned char EXIF_IDENTIFIER[6] = { 'E', 'x', 'i', 'f', 0, 0 };
+
+// TIFF tags
+static const unsigned int TAG_EXIF_IFD = 0x8769;
+static const unsigned int TAG_GPS_IFD = 0x8825;
+
+// TIFF field types
+static const unsigned int TYPE_SHORT = 3;
+static const unsigned int TYPE_LONG = 4;
+static const unsigned int TYPE_RATIONAL = 5;
+
+// IFD1 with compression, resolution and the thumbnail location, and the resolution values
+static const int IFD1_ENTRIES = 6;
+static const int IFD1_SIZE = 2 + IFD1_ENTRIES * 12 + 4 + 2 * 8;
+
+enum {
+    IFD_0 = 0,
+    IFD_EXIF,
+    IFD_GPS
+};
+
+enum FieldKind {
+    KIND_ASCII,
+    KIND_BYTE,
+    KIND_SHORT,
+    KIND_RATIONAL,      // signed or not, the words are just copied
+};
+
+// a field of exif_attribute_t that usually changes from shot to shot and the tag it is in
+struct ShotField {
+    int ifd;
+    unsigned int tag;
+    FieldKind kind;
+    size_t offset;
+    size_t size;
+};
+
+#define EXIF_FIELD(f) offsetof(exif_attribute_t, f), sizeof(((exif_attribute_t *) 0)->f)
+
+static const ShotField SHOT_FIELDS[] = {
+    { IFD_0,    0x0112, KIND_SHORT,    EXIF_FIELD(orientation) },
+    { IFD_0,    0x0132, KIND_ASCII,    EXIF_FIELD(date_time) },
+    { IFD_EXIF, 0x829A, KIND_RATIONAL, EXIF_FIELD(exposure_time) },
+    { IFD_EXIF, 0x8827, KIND_SHORT,    EXIF_FIELD(iso_speed_rating) },
+    { IFD_EXIF, 0x9003, KIND_ASCII,    EXIF_FIELD(date_time) },
+    { IFD_EXIF, 0x9004, KIND_ASCII,    EXIF_FIELD(date_time) },
+    { IFD_EXIF, 0x9201, KIND_RATIONAL, EXIF_FIELD(shutter_speed) },
+    { IFD_EXIF, 0x9202, KIND_RATIONAL, EXIF_FIELD(aperture) },
+    { IFD_EXIF, 0x9203, KIND_RATIONAL, EXIF_FIELD(brightness) },
+    { IFD_EXIF, 0x9204, KIND_RATIONAL, EXIF_FIELD(exposure_bias) },
+    { IFD_EXIF, 0x9209, KIND_SHORT,    EXIF_FIELD(flash) },
+    { IFD_GPS,  0x0001, KIND_ASCII,    EXIF_FIELD(gps_latitude_ref) },
+    { IFD_GPS,  0x0002, KIND_RATIONAL, EXIF_FIELD(gps_latitude) },
+    { IFD_GPS,  0x0003, KIND_ASCII,    EXIF_FIELD(gps_longitude_ref) },
+    { IFD_GPS,  0x0004, KIND_RATIONAL, EXIF_FIELD(gps_longitude) },
+    { IFD_GPS,  0x0005, KIND_BYTE,     EXIF_FIELD(gps_altitude_ref) },
+    { IFD_GPS,  0x0006, KIND_RATIONAL, EXIF_FIELD(gps_altitude) },
+    { IFD_GPS,  0x0007, KIND_RATIONAL, EXIF_FIELD(gps_timestamp) },
+    { IFD_GPS,  0x001D, KIND_ASCII,    EXIF_FIELD(gps_datestamp) },
+};
+
+static const int NUM_SHOT_FIELDS = sizeof(SHOT_FIELDS) / sizeof(SHOT_FIELDS[0]);
+
+// bytes of one value of a TIFF field type, 0 if unknown
+static int typeSize(unsigned int type)
+{
+    switch (type) {
+    case 1:  // BYTE
+    case 2:  // ASCII
+    case 6:  // SBYTE
+    case 7:  // UNDEFINED
+        return 1;
+    case 3:  // SHORT
+    case 8:  // SSHORT
+        return 2;
+    case 4:  // LONG
+    case 9:  // SLONG
+    case 11: // FLOAT
+        return 4;
+    case 5:  // RATIONAL
+    case 10: // SRATIONAL
+    case 12: // DOUBLE
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+// reads an integer field of exif_attribute_t of any width
+static unsigned int fieldValue(const unsigned char *field, size_t size)
+{
+    unsigned char value8;
+    unsigned short value16;
+    unsigned int value32;
+    switch (size) {
+    case 1:
+        memcpy(&value8, field, 1);
+        return value8;
+    case 2:
+        memcpy(&value16, field, 2);
+        return value16;
+    default:
+        memcpy(&value32, field, 4);
+        return value32;
+    }
+}
+
+ExifTemplate::ExifTemplate() :
+    mData(NULL)
+    ,mSize(-1)
+    ,mValid(false)
+    ,mBigEndian(false)
+    ,mNextIfdOffset(0)
+    ,mNumPatches(0)
+{
+    LOG1("@%s", __FUNCTION__);
+    mData = new unsigned char[MAX_EXIF_SIZE];
+    memset(&mKey, 0, sizeof(mKey));
+}
+
+ExifTemplate::~ExifTemplate()
+{
+    LOG1("@%s", __FUNCTION__);
+    delete[] mData;
+}
+
+void ExifTemplate::reset()
+{
+    mSize = -1;
+    mValid = false;
+}
+
+unsigned int ExifTemplate::read16(const unsigned char *p)
+{
+    return mBigEndian ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+}
+
+unsigned int ExifTemplate::read32(const unsigned char *p)
+{
+    return mBigEndian ? (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+                      : p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+void ExifTemplate::write16(unsigned char *p, unsigned int value)
+{
+    if (mBigEndian) {
+        p[0] = value >> 8;
+        p[1] = value & 0xFF;
+    } else {
+        p[0] = value & 0xFF;
+        p[1] = value >> 8;
+    }
+}
+
+void ExifTemplate::write32(unsigned char *p, unsigned int value)
+{
+    if (mBigEndian) {
+        write16(p, value >> 16);
+        write16(p + 2, value & 0xFFFF);
+    } else {
+        write16(p, value & 0xFFFF);
+        write16(p + 2, value >> 16);
+    }
+}
+
+// blanks the fields that are patched, what is left identifies the template
+void ExifTemplate::clearShotFields(exif_attribute_t *exif)
+{
+    for (int i = 0; i < NUM_SHOT_FIELDS; i++)
+        memset((unsigned char *) exif + SHOT_FIELDS[i].offset, 0, SHOT_FIELDS[i].size);
+    exif->enableThumb = false;
+}
+
+/*
+ * Records where the values of the shot fields are in the IFD at ifdOffset
+ * (from the TIFF header) and follows the links to the Exif and GPS IFDs.
+ * Returns false if the IFD does not fit the template.
+ */
+bool ExifTemplate::parseIfd(int ifdOffset, int ifd)
+{
+    const unsigned char *tiff = mData + TIFF_OFFSET;
+    int tiffSize = mSize - TIFF_OFFSET;
+
+    if (ifdOffset <= 0 || ifdOffset + 2 > tiffSize)
+        return false;
+    int count = read16(tiff + ifdOffset);
+    if (ifdOffset + 2 + count * 12 + 4 > tiffSize)
+        return false;
+    if (ifd == IFD_0)
+        mNextIfdOffset = TIFF_OFFSET + ifdOffset + 2 + count * 12;
+
+    for (int i = 0; i < count; i++) {
+        const unsigned char *entry = tiff + ifdOffset + 2 + i * 12;
+        unsigned int tag = read16(entry);
+        int size = typeSize(read16(entry + 2));
+        int n = read32(entry + 4);
+
+        if (ifd == IFD_0 && tag == TAG_EXIF_IFD) {
+            if (!parseIfd(read32(entry + 8), IFD_EXIF))
+                return false;
+            continue;
+        }
+        if (ifd == IFD_0 && tag == TAG_GPS_IFD) {
+            if (!parseIfd(read32(entry + 8), IFD_GPS))
+                return false;
+            continue;
+        }
+
+        for (int f = 0; f < NUM_SHOT_FIELDS; f++) {
+            if (SHOT_FIELDS[f].ifd != ifd || SHOT_FIELDS[f].tag != tag)
+                continue;
+            if (size == 0 || mNumPatches == MAX_PATCHES)
+                return false;
+            // values of up to 4 bytes are in the entry itself
+            int offset = n * size <= 4 ? entry + 8 - mData : TIFF_OFFSET + read32(entry + 8);
+            if (offset + n * size > mSize)
+                return false;
+            mPatches[mNumPatches].field = f;
+            mPatches[mNumPatches].offset = offset;
+            mPatches[mNumPatches].count = n;
+            mNumPatches++;
+        }
+    }
+    return true;
+}
+
+// makes the template with makeExif and finds the fields to patch in it
+bool ExifTemplate::build(JpegEncoder *encoder, const exif_attribute_t *exif)
+{
+    LOG1("@%s", __FUNCTION__);
+    exif_attribute_t noThumb = *exif;
+    unsigned int size = 0;
+
+    noThumb.enableThumb = false;
+    mSize = 0;
+    mNumPatches = 0;
+    if (encoder->makeExif(mData, &noThumb, &size, false) != JPG_SUCCESS) {
+        ALOGE("Error making EXIF");
+        return false;
+    }
+    mSize = size;
+
+    if (mSize < TIFF_OFFSET + 8 || mData[0] != 0xFF || mData[1] != 0xE1 ||
+        memcmp(mData + 4, EXIF_IDENTIFIER, sizeof(EXIF_IDENTIFIER)) != 0)
+        return false;
+
+    const unsigned char *tiff = mData + TIFF_OFFSET;
+    if (tiff[0] == 'M' && tiff[1] == 'M')
+        mBigEndian = true;
+    else if (tiff[0] == 'I' && tiff[1] == 'I')
+        mBigEndian = false;
+    else
+        return false;
+
+    if (!parseIfd(read32(tiff + 4), IFD_0))
+        return false;
+    // the thumbnail gets an IFD1 of our own
+    if (read32(mData + mNextIfdOffset) != 0)
+        return false;
+
+    LOG1("EXIF template of %d bytes with %d fields to patch", mSize, mNumPatches);
+    return true;
+}
+
+void ExifTemplate::patch(const Patch &patch, const exif_attribute_t *exif, unsigned char *app1)
+{
+    const ShotField &field = SHOT_FIELDS[patch.field];
+    const unsigned char *value = (const unsigned char *) exif + field.offset;
+    unsigned char *dst = app1 + patch.offset;
+
+    switch (field.kind) {
+    case KIND_ASCII: {
+        int n = patch.count < (int) field.size ? patch.count : field.size;
+        memcpy(dst, value, n);
+        memset(dst + n, 0, patch.count - n);
+        // the count includes the terminating NUL
+        if (patch.count > 0)
+            dst[patch.count - 1] = 0;
+        break;
+    }
+    case KIND_BYTE:
+        if (patch.count > 0)
+            dst[0] = fieldValue(value, field.size);
+        break;
+    case KIND_SHORT:
+        if (patch.count > 0)
+            write16(dst, fieldValue(value, field.size));
+        break;
+    case KIND_RATIONAL: {
+        int words = patch.count * 2 < (int) field.size / 4 ? patch.count * 2 : field.size / 4;
+        for (int i = 0; i < words; i++)
+            write32(dst + i * 4, fieldValue(value + i * 4, 4));
+        break;
+    }
+    }
+}
+
+int ExifTemplate::make(JpegEncoder *encoder, const exif_attribute_t *exif,
+        const unsigned char *thumb, int thumbSize, unsigned char *out, int outSize)
+{
+    LOG1("@%s", __FUNCTION__);
+    exif_attribute_t key = *exif;
+    clearShotFields(&key);
+    if (mSize < 0 || memcmp(&key, &mKey, sizeof(key)) != 0) {
+        mKey = key;
+        mValid = build(encoder, exif);
+        if (!mValid)
+            ALOGW("Could not make EXIF template, EXIF is made for every picture");
+    }
+    if (!mValid)
+        return 0;
+
+    // IFD1 starts on a word boundary
+    int ifd1Offset = (mSize + 1) & ~1;
+    int total = thumb != NULL ? ifd1Offset + IFD1_SIZE + thumbSize : mSize;
+    if (total > outSize || total - 2 > 0xFFFF) {
+        LOG1("EXIF of %d bytes does not fit", total);
+        return 0;
+    }
+
+    memcpy(out, mData, mSize);
+    for (int i = 0; i < mNumPatches; i++)
+        patch(mPatches[i], exif, out);
+
+    if (thumb != NULL) {
+        unsigned int ifd1 = ifd1Offset - TIFF_OFFSET;
+        unsigned int resolution = ifd1 + IFD1_SIZE - 2 * 8;
+        unsigned int thumbOffset = ifd1 + IFD1_SIZE;
+        const unsigned int entries[IFD1_ENTRIES][4] = {
+            { 0x0103, TYPE_SHORT,    1, 6 },            // Compression: JPEG
+            { 0x011A, TYPE_RATIONAL, 1, resolution },   // XResolution
+            { 0x011B, TYPE_RATIONAL, 1, resolution + 8 }, // YResolution
+            { 0x0128, TYPE_SHORT,    1, 2 },            // ResolutionUnit: inch
+            { 0x0201, TYPE_LONG,     1, thumbOffset },  // JPEGInterchangeFormat
+            { 0x0202, TYPE_LONG,     1, (unsigned int) thumbSize }, // JPEGInterchangeFormatLength
+        };
+
+        if (ifd1Offset > mSize)
+            out[mSize] = 0;
+        unsigned char *p = out + ifd1Offset;
+        write16(p, IFD1_ENTRIES);
+        p += 2;
+        for (int i = 0; i < IFD1_ENTRIES; i++, p += 12) {
+            write16(p, entries[i][0]);
+            write16(p + 2, entries[i][1]);
+            write32(p + 4, entries[i][2]);
+            if (entries[i][1] == TYPE_SHORT) {
+                write16(p + 8, entries[i][3]);
+                write16(p + 10, 0);
+            } else {
+                write32(p + 8, entries[i][3]);
+            }
+        }
+        write32(p, 0); // no IFD2
+        p += 4;
+        for (int i = 0; i < 2; i++, p += 8) {
+            write32(p, 72);
+            write32(p + 4, 1);
+        }
+        memcpy(p, thumb, thumbSize);
+        write32(out + mNextIfdOffset, ifd1);
+    }
+
+    // segment lengths are big endian whatever the TIFF byte order
+    out[2] = ((total - 2) >> 8) & 0xFF;
+    out[3] = (total - 2) & 0xFF;
+    return total;
+}
+
+}; // namespace android
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_EXIF_TEMPLATE_H
+#define ANDROID_LIBCAMERA_EXIF_TEMPLATE_H
+
+#include "JpegEncoder.h" // for EXIF
+
+namespace android {
+
+/**
+ * Keeps a serialized EXIF APP1 segment and patches the fields that change
+ * from shot to shot (time, orientation, exposure, GPS) in place. The
+ * template is made again with makeExif only when any other field changes.
+ * The thumbnail is appended in an IFD1 of our own, so the template is
+ * made without one.
+ */
+class ExifTemplate {
+
+// constructor destructor
+public:
+    ExifTemplate();
+    ~ExifTemplate();
+
+// public methods
+public:
+    /**
+     * Writes the APP1 segment for exif, with the thumbnail if thumb is not
+     * NULL, into out. Returns its size, or 0 if it does not fit or makeExif
+     * output could not be parsed, in which case the caller should fall
+     * back to makeExif.
+     */
+    int make(JpegEncoder *encoder, const exif_attribute_t *exif,
+            const unsigned char *thumb, int thumbSize, unsigned char *out, int outSize);
+    void reset();
+
+// private types
+private:
+    // a tag value of the template that is patched for every shot
+    struct Patch {
+        int field;          // index in the table of patched fields
+        int offset;         // of the value in mData
+        int count;
+    };
+
+    static const int MAX_PATCHES = 24;
+
+// private methods
+private:
+    bool build(JpegEncoder *encoder, const exif_attribute_t *exif);
+    bool parseIfd(int ifdOffset, int ifd);
+    void patch(const Patch &patch, const exif_attribute_t *exif, unsigned char *app1);
+    static void clearShotFields(exif_attribute_t *exif);
+
+    unsigned int read16(const unsigned char *p);
+    unsigned int read32(const unsigned char *p);
+    void write16(unsigned char *p, unsigned int value);
+    void write32(unsigned char *p, unsigned int value);
+
+// private data
+private:
+    unsigned char *mData;       // APP1 segment made by makeExif
+    int mSize;
+    bool mValid;
+    bool mBigEndian;
+    int mNextIfdOffset;         // of the IFD0 link to IFD1 in mData
+    exif_attribute_t mKey;      // fields the template was made with
+    Patch mPatches[MAX_PATCHES];
+    int mNumPatches;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_EXIF_TEMPLATE_H
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_FileJpegSink"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <utils/Timers.h>
+#include "FileJpegSink.h"
+#include "LogHelper.h"
+
+namespace android {
+
+// added to the name of a file until it is complete
+static const char *PARTIAL_SUFFIX = ".part";
+
+FileJpegSink::FileJpegSink(const char *dir) :
+    mExiting(false)
+    ,mFd(-1)
+    ,mError(false)
+{
+    LOG1("@%s: %s", __FUNCTION__, dir);
+    snprintf(mDir, sizeof(mDir), "%s", dir);
+    mPath[0] = '\0';
+
+    mWriter = new Writer(this);
+    if (mWriter->run("CameraJpegSink") != NO_ERROR) {
+        ALOGE("Error starting JPEG sink thread");
+        mWriter.clear();
+    }
+}
+
+FileJpegSink::~FileJpegSink()
+{
+    LOG1("@%s", __FUNCTION__);
+    if (mFd >= 0)
+        end(false);
+
+    mLock.lock();
+    mExiting = true;
+    mChunkAvailable.signal();
+    mLock.unlock();
+
+    if (mWriter != NULL)
+        mWriter->requestExitAndWait();
+    mWriter.clear();
+}
+
+status_t FileJpegSink::begin()
+{
+    LOG1("@%s", __FUNCTION__);
+    if (mWriter == NULL)
+        return INVALID_OPERATION;
+    if (mFd >= 0)
+        end(false);
+
+    Mutex::Autolock lock(mLock);
+    snprintf(mPath, sizeof(mPath), "%s/IMG_%lld.jpg%s", mDir,
+            (long long) systemTime(), PARTIAL_SUFFIX);
+    mFd = open(mPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (mFd < 0) {
+        ALOGE("Could not create %s: %s", mPath, strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+    mError = false;
+    return NO_ERROR;
+}
+
+void FileJpegSink::write(const unsigned char *data, int size)
+{
+    LOG2("@%s: %d bytes", __FUNCTION__, size);
+    Mutex::Autolock lock(mLock);
+    if (mFd < 0 || mError || size <= 0)
+        return;
+    Chunk chunk;
+    chunk.data = data;
+    chunk.size = size;
+    mChunks.push(chunk);
+    mChunkAvailable.signal();
+}
+
+status_t FileJpegSink::end(bool ok)
+{
+    LOG1("@%s: ok = %d", __FUNCTION__, ok);
+    Mutex::Autolock lock(mLock);
+    if (mFd < 0)
+        return INVALID_OPERATION;
+
+    // what is queued goes to the file even if it is abandoned, the chunks
+    // are only valid until we return
+    while (!mChunks.isEmpty())
+        mChunkWritten.wait(mLock);
+
+    status_t status = NO_ERROR;
+    if (close(mFd) < 0 || mError)
+        status = UNKNOWN_ERROR;
+    mFd = -1;
+
+    if (ok && status == NO_ERROR) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%.*s",
+                (int) (strlen(mPath) - strlen(PARTIAL_SUFFIX)), mPath);
+        if (rename(mPath, path) < 0) {
+            ALOGE("Could not rename %s: %s", mPath, strerror(errno));
+            status = UNKNOWN_ERROR;
+        } else {
+            LOG1("Stored %s", path);
+        }
+    }
+    if (!ok || status != NO_ERROR)
+        unlink(mPath);
+    return ok ? status : NO_ERROR;
+}
+
+void FileJpegSink::writeChunks()
+{
+    Mutex::Autolock lock(mLock);
+    while (!mExiting) {
+        if (mChunks.isEmpty()) {
+            mChunkAvailable.wait(mLock);
+            continue;
+        }
+
+        // the chunk stays queued while it is written, so end() waits for it
+        Chunk chunk = mChunks[0];
+        int fd = mFd;
+        bool error = mError;
+        mLock.unlock();
+        while (!error && chunk.size > 0) {
+            ssize_t written = ::write(fd, chunk.data, chunk.size);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0) {
+                ALOGE("Error writing JPEG file: %s", strerror(errno));
+                error = true;
+                break;
+            }
+            chunk.data += written;
+            chunk.size -= written;
+        }
+        mLock.lock();
+
+        mError = mError || error;
+        mChunks.removeAt(0);
+        mChunkWritten.signal();
+    }
+}
+
+}; // namespace android
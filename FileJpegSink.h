@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_FILE_JPEG_SINK_H
+#define ANDROID_LIBCAMERA_FILE_JPEG_SINK_H
+
+#include <limits.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+#include "IJpegSink.h"
+
+namespace android {
+
+/**
+ * Stores JPEG files in a directory. The chunks are written by a thread of
+ * its own, so write() only queues them. A file is renamed into place once
+ * it is complete, abandoned files are removed.
+ */
+class FileJpegSink : public IJpegSink {
+
+// constructor destructor
+public:
+    FileJpegSink(const char *dir);
+    virtual ~FileJpegSink();
+
+// IJpegSink overrides
+public:
+    virtual status_t begin();
+    virtual void write(const unsigned char *data, int size);
+    virtual status_t end(bool ok);
+
+// private types
+private:
+
+    struct Chunk {
+        const unsigned char *data;
+        int size;
+    };
+
+    class Writer : public Thread {
+    public:
+        Writer(FileJpegSink *sink) : Thread(false), mSink(sink) {}
+    private:
+        virtual bool threadLoop() { mSink->writeChunks(); return false; }
+        FileJpegSink *mSink;
+    };
+
+// private methods
+private:
+
+    void writeChunks();
+
+// private data
+private:
+
+    Mutex mLock;
+    Condition mChunkAvailable;
+    Condition mChunkWritten;
+    Vector<Chunk> mChunks;      // queued, the first one is being written
+    sp<Writer> mWriter;
+    bool mExiting;
+    int mFd;
+    bool mError;                // a write of the current file failed
+    char mDir[PATH_MAX];
+    char mPath[PATH_MAX];       // of the current file while it is written
+
+}; // class FileJpegSink
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_FILE_JPEG_SINK_H
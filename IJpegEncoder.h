@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_IJPEG_ENCODER_H
+#define ANDROID_LIBCAMERA_IJPEG_ENCODER_H
+
+#include "JpegCompressor.h"
+
+namespace android {
+
+/**
+ * A JPEG encoder backend. JpegCompressor owns one of each kind and picks
+ * the fastest that works for an image, so a backend only has to encode.
+ * A hardware encoder would be added as one more implementation.
+ */
+class IJpegEncoder
+{
+public:
+    typedef JpegCompressor::InputBuffer InputBuffer;
+    typedef JpegCompressor::OutputBuffer OutputBuffer;
+    typedef JpegCompressor::OutputListener OutputListener;
+
+    virtual ~IJpegEncoder() {};
+    virtual const char* getName() = 0;
+    virtual bool isFormatSupported(int format) = 0;
+    /**
+     * Whether encode() turns the picture by out.rotation. Otherwise the
+     * JPEG is rotated after encoding. Optional.
+     */
+    virtual bool canRotate() { return false; }
+    /**
+     * Allocates what encoding images like in needs, so that encode() does
+     * not have to. Optional.
+     */
+    virtual void prepare(const InputBuffer &in) {};
+    /**
+     * Buffers of width x height pictures in format that are encoded again
+     * and again, like the snapshot buffers. A backend that needs its input
+     * in surfaces of its own registers them once here instead of copying
+     * every picture in, and in.surface then says which one an input is.
+     * num 0 drops them. Returns false if the backend takes any input as it
+     * is. Optional.
+     */
+    virtual bool setInputSurfaces(unsigned char *const *bufs, int num,
+            int width, int height, int format) { return false; }
+    /**
+     * Encodes in into out.buf, which may also be used as scratch up to
+     * out.size bytes. Returns the JPEG size or -1 on error. Telling
+     * out.listener about the output as it is written is optional, the
+     * whole JPEG is reported when encode() returns.
+     */
+    virtual int encode(const InputBuffer &in, const OutputBuffer &out) = 0;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_IJPEG_ENCODER_H
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_IJPEG_SINK_H
+#define ANDROID_LIBCAMERA_IJPEG_SINK_H
+
+#include <utils/Errors.h>
+
+namespace android {
+
+/**
+ * Takes the final JPEG file of a picture while it is encoded, a chunk at a
+ * time in file order, so that storing it overlaps the compression instead
+ * of following it.
+ */
+class IJpegSink
+{
+public:
+    virtual ~IJpegSink() {};
+    // A new file starts
+    virtual status_t begin() = 0;
+    /**
+     * The next size bytes of the file. Must not block on I/O; data stays
+     * valid until end() returns.
+     */
+    virtual void write(const unsigned char *data, int size) = 0;
+    /**
+     * The file is complete, or abandoned if ok is false. Returns when all
+     * of it is stored.
+     */
+    virtual status_t end(bool ok) = 0;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_IJPEG_SINK_H
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_ImageScaler"
+
+#include <string.h>
+#include <linux/videodev2.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "ImageScaler.h"
+#include "LogHelper.h"
+
+namespace android {
+
+// Rows summed per box at most; taller boxes are sampled every few rows so
+// the 16-bit column sums cannot overflow (128 * 255 = 32640 fits)
+static const int MAX_BOX_ROWS = 128;
+
+// one interleaved component of a plane, e.g. the U samples of YUYV
+struct Component {
+    int offset;     // of the first sample in a row, in bytes
+    int step;       // bytes from one sample to the next
+    int dstWidth;   // samples in a destination row
+};
+
+// adds up rows of width bytes, each rowStride bytes apart, column by column
+static void sumRows(const unsigned char *src, int rowStride, int rows, int width,
+        unsigned short *sums)
+{
+    memset(sums, 0, width * sizeof(sums[0]));
+    for (int r = 0; r < rows; r++) {
+        const unsigned char *row = src + r * rowStride;
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 16 <= width; x += 16) {
+            __m128i pixels = _mm_loadu_si128((const __m128i *) (row + x));
+            __m128i *sum = (__m128i *) (sums + x);
+            _mm_storeu_si128(sum, _mm_add_epi16(_mm_loadu_si128(sum),
+                    _mm_unpacklo_epi8(pixels, zero)));
+            _mm_storeu_si128(sum + 1, _mm_add_epi16(_mm_loadu_si128(sum + 1),
+                    _mm_unpackhi_epi8(pixels, zero)));
+        }
+#endif
+        for (; x < width; x++)
+            sums[x] += row[x];
+    }
+}
+
+/*
+ * Scales the width x height bytes at src into dstHeight rows at dst. The
+ * rows of a box are summed first, so each source byte is read once, then
+ * every component is averaged over the columns of its boxes.
+ */
+static void scalePlane(const unsigned char *src, int srcStride, int width, int height,
+        unsigned char *dst, int dstStride, int dstHeight,
+        const Component *comps, int numComps, unsigned short *sums)
+{
+    for (int dy = 0; dy < dstHeight; dy++) {
+        int y0 = dy * height / dstHeight;
+        int y1 = (dy + 1) * height / dstHeight;
+        if (y1 <= y0)
+            y1 = y0 + 1;
+        int rowStep = (y1 - y0 + MAX_BOX_ROWS - 1) / MAX_BOX_ROWS;
+        int rows = (y1 - y0 + rowStep - 1) / rowStep;
+        sumRows(src + y0 * srcStride, srcStride * rowStep, rows, width, sums);
+
+        unsigned char *out = dst + dy * dstStride;
+        for (int c = 0; c < numComps; c++) {
+            const Component &comp = comps[c];
+            int samples = width / comp.step;
+            for (int dx = 0; dx < comp.dstWidth; dx++) {
+                int x0 = dx * samples / comp.dstWidth;
+                int x1 = (dx + 1) * samples / comp.dstWidth;
+                if (x1 <= x0)
+                    x1 = x0 + 1;
+                const unsigned short *s = sums + comp.offset + x0 * comp.step;
+                unsigned int sum = 0;
+                for (int x = x0; x < x1; x++, s += comp.step)
+                    sum += *s;
+                unsigned int area = (x1 - x0) * rows;
+                out[comp.offset + dx * comp.step] = (sum + area / 2) / area;
+            }
+        }
+    }
+}
+
+int scaleDownScratchSize(int format, int srcWidth)
+{
+    // one column sum per byte of a source row
+    return format == V4L2_PIX_FMT_YUYV ? srcWidth * 2 : srcWidth;
+}
+
+status_t scaleDown(int format, int srcWidth, int srcHeight, const void *src,
+        int dstWidth, int dstHeight, void *dst, unsigned short *scratch)
+{
+    LOG1("@%s: %dx%d to %dx%d", __FUNCTION__, srcWidth, srcHeight, dstWidth, dstHeight);
+    if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0 ||
+        (srcWidth | srcHeight | dstWidth | dstHeight) & 1) {
+        ALOGE("Invalid scaling from %dx%d to %dx%d", srcWidth, srcHeight, dstWidth, dstHeight);
+        return BAD_VALUE;
+    }
+
+    // crop to the destination aspect ratio, on even pixels for the chroma
+    int cropWidth = srcWidth;
+    int cropHeight = srcHeight;
+    if ((long long) srcWidth * dstHeight > (long long) srcHeight * dstWidth)
+        cropWidth = (int) ((long long) srcHeight * dstWidth / dstHeight) & ~1;
+    else
+        cropHeight = (int) ((long long) srcWidth * dstHeight / dstWidth) & ~1;
+    int cropX = ((srcWidth - cropWidth) / 2) & ~1;
+    int cropY = ((srcHeight - cropHeight) / 2) & ~1;
+
+    const unsigned char *in = (const unsigned char *) src;
+    unsigned char *out = (unsigned char *) dst;
+
+    switch (format) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21: {
+        // the chroma pairs keep their order, so NV12 and NV21 scale alike
+        const Component luma[1] = { { 0, 1, dstWidth } };
+        const Component chroma[2] = { { 0, 2, dstWidth / 2 }, { 1, 2, dstWidth / 2 } };
+        scalePlane(in + cropY * srcWidth + cropX, srcWidth, cropWidth, cropHeight,
+                out, dstWidth, dstHeight, luma, 1, scratch);
+        scalePlane(in + srcWidth * srcHeight + cropY / 2 * srcWidth + cropX, srcWidth,
+                cropWidth, cropHeight / 2, out + dstWidth * dstHeight, dstWidth,
+                dstHeight / 2, chroma, 2, scratch);
+        break;
+    }
+    case V4L2_PIX_FMT_YUYV: {
+        const Component yuyv[3] = {
+            { 0, 2, dstWidth },         // Y
+            { 1, 4, dstWidth / 2 },     // U
+            { 3, 4, dstWidth / 2 },     // V
+        };
+        scalePlane(in + cropY * srcWidth * 2 + cropX * 2, srcWidth * 2, cropWidth * 2,
+                cropHeight, out, dstWidth * 2, dstHeight, yuyv, 3, scratch);
+        break;
+    }
+    default:
+        ALOGE("Scaling of format %d is not supported", format);
+        return BAD_VALUE;
+    }
+
+    return NO_ERROR;
+}
+
+// source pixel of dst pixel (x, y) when a width x height image is turned
+// clockwise by degrees
+static inline void rotatedSource(int degrees, int width, int height, int x, int y,
+        int *sx, int *sy)
+{
+    switch (degrees) {
+    case 90:
+        *sx = y;
+        *sy = height - 1 - x;
+        break;
+    case 180:
+        *sx = width - 1 - x;
+        *sy = height - 1 - y;
+        break;
+    default: // 270
+        *sx = width - 1 - y;
+        *sy = x;
+        break;
+    }
+}
+
+// turns a plane of width x height samples of size bytes each
+static void rotatePlane(const unsigned char *src, int width, int height, int size,
+        unsigned char *dst, int degrees)
+{
+    int dstWidth = degrees == 180 ? width : height;
+    int dstHeight = degrees == 180 ? height : width;
+    for (int y = 0; y < dstHeight; y++) {
+        for (int x = 0; x < dstWidth; x++) {
+            int sx, sy;
+            rotatedSource(degrees, width, height, x, y, &sx, &sy);
+            const unsigned char *s = src + (sy * width + sx) * size;
+            for (int i = 0; i < size; i++)
+                *dst++ = s[i];
+        }
+    }
+}
+
+status_t rotateImage(int format, int width, int height, const void *src,
+        void *dst, int degrees)
+{
+    LOG1("@%s: %dx%d by %d", __FUNCTION__, width, height, degrees);
+    if ((width | height) & 1 || (degrees != 90 && degrees != 180 && degrees != 270)) {
+        ALOGE("Cannot rotate %dx%d by %d degrees", width, height, degrees);
+        return BAD_VALUE;
+    }
+    const unsigned char *s = (const unsigned char *) src;
+    unsigned char *d = (unsigned char *) dst;
+
+    switch (format) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+        rotatePlane(s, width, height, 1, d, degrees);
+        // the chroma pairs turn as one
+        rotatePlane(s + width * height, width / 2, height / 2, 2, d + width * height, degrees);
+        break;
+    case V4L2_PIX_FMT_YUYV: {
+        int dstWidth = degrees == 180 ? width : height;
+        int dstHeight = degrees == 180 ? height : width;
+        for (int y = 0; y < dstHeight; y++) {
+            for (int x = 0; x < dstWidth; x += 2) {
+                int sx, sy;
+                rotatedSource(degrees, width, height, x, y, &sx, &sy);
+                const unsigned char *pair = s + (sy * width + (sx & ~1)) * 2;
+                d[0] = s[(sy * width + sx) * 2];
+                d[1] = pair[1];
+                rotatedSource(degrees, width, height, x + 1, y, &sx, &sy);
+                d[2] = s[(sy * width + sx) * 2];
+                d[3] = pair[3];
+                d += 4;
+            }
+        }
+        break;
+    }
+    default:
+        ALOGE("Rotation of format %d is not supported", format);
+        return BAD_VALUE;
+    }
+    return NO_ERROR;
+}
+
+// averages the luma of a YUYV row pair in 2x2 boxes into width samples
+static void halveYuyvRow(const unsigned char *src, int stride, unsigned char *dst, int width)
+{
+    const unsigned char *next = src + stride;
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i lumaMask = _mm_set1_epi16(0x00FF);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i round = _mm_set1_epi16(2);
+    for (; x + 16 <= width; x += 16) {
+        __m128i pairs[4];
+        for (int k = 0; k < 4; k++) {
+            int offset = x * 4 + k * 16;
+            __m128i column = _mm_add_epi16(
+                    _mm_and_si128(_mm_loadu_si128((const __m128i *) (src + offset)), lumaMask),
+                    _mm_and_si128(_mm_loadu_si128((const __m128i *) (next + offset)), lumaMask));
+            pairs[k] = _mm_madd_epi16(column, ones);
+        }
+        __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(pairs[0], pairs[1]), round), 2);
+        __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(pairs[2], pairs[3]), round), 2);
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; x < width; x++)
+        dst[x] = (src[x * 4] + src[x * 4 + 2] + next[x * 4] + next[x * 4 + 2] + 2) >> 2;
+}
+
+// averages a row pair of a plane in 2x2 boxes into width samples
+static void halvePlaneRow(const unsigned char *src, int stride, unsigned char *dst, int width)
+{
+    const unsigned char *next = src + stride;
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i evenMask = _mm_set1_epi16(0x00FF);
+    const __m128i round = _mm_set1_epi16(2);
+    for (; x + 16 <= width; x += 16) {
+        __m128i sums[2];
+        for (int k = 0; k < 2; k++) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (src + x * 2 + k * 16));
+            __m128i b = _mm_loadu_si128((const __m128i *) (next + x * 2 + k * 16));
+            sums[k] = _mm_add_epi16(
+                    _mm_add_epi16(_mm_and_si128(a, evenMask), _mm_srli_epi16(a, 8)),
+                    _mm_add_epi16(_mm_and_si128(b, evenMask), _mm_srli_epi16(b, 8)));
+            sums[k] = _mm_srli_epi16(_mm_add_epi16(sums[k], round), 2);
+        }
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(sums[0], sums[1]));
+    }
+#endif
+    for (; x < width; x++)
+        dst[x] = (src[x * 2] + src[x * 2 + 1] + next[x * 2] + next[x * 2 + 1] + 2) >> 2;
+}
+
+bool halveLumaRow(int format, const unsigned char *src, int srcStride,
+        unsigned char *dst, int dstWidth)
+{
+    switch (format) {
+    case V4L2_PIX_FMT_YUYV:
+        halveYuyvRow(src, srcStride, dst, dstWidth);
+        return true;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_GREY:
+        halvePlaneRow(src, srcStride, dst, dstWidth);
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace android
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_IMAGE_SCALER_H
+#define ANDROID_LIBCAMERA_IMAGE_SCALER_H
+
+#include <utils/Errors.h>
+
+namespace android {
+
+// Scales src down to a dstWidth x dstHeight image of the same format. Every
+// destination pixel is the average of the source pixels it covers, after the
+// source is cropped around its center to the destination aspect ratio. Only
+// NV12, NV21 and YUYV are supported and all sizes must be even. scratch is
+// owned by the caller and holds scaleDownScratchSize() entries, so that it
+// can be allocated once for all the images of a size.
+status_t scaleDown(int format, int srcWidth, int srcHeight, const void *src,
+        int dstWidth, int dstHeight, void *dst, unsigned short *scratch);
+
+// Returns the entries of the scratch scaleDown() needs for sources of format
+// that are at most srcWidth wide.
+int scaleDownScratchSize(int format, int srcWidth);
+
+// Turns src, width x height, clockwise by 90, 180 or 270 degrees into dst,
+// which is height x width unless turned by 180. Only NV12, NV21 and YUYV are
+// supported and all sizes must be even. A YUYV pixel pair takes its chroma
+// from the source pixel of its first pixel.
+status_t rotateImage(int format, int width, int height, const void *src,
+        void *dst, int degrees);
+
+// Averages the luma of two rows of src, srcStride bytes apart, in 2x2 boxes
+// into dstWidth samples at dst. YUYV and the formats that start with a luma
+// plane (NV12, NV21, GREY) are supported. Returns false for other formats.
+bool halveLumaRow(int format, const unsigned char *src, int srcStride,
+        unsigned char *dst, int dstWidth);
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_IMAGE_SCALER_H
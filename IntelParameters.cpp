@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "IntelParameters.h"
+
+namespace android {
+
+const char IntelCameraParameters::KEY_RECORDING_FRAME_RATE[] = "recording-fps";
+const char IntelCameraParameters::KEY_SUPPORTED_RECORDING_FRAME_RATES[] = "recording-fps-values";
+const char IntelCameraParameters::KEY_TEMPORAL_NOISE_REDUCTION[] = "temporal-noise-reduction";
+const char IntelCameraParameters::KEY_TEMPORAL_NOISE_REDUCTION_SUPPORTED[] = "temporal-noise-reduction-supported";
+const char IntelCameraParameters::KEY_PREVIEW_AFTER_CAPTURE[] = "preview-after-capture";
+const char IntelCameraParameters::KEY_PREVIEW_AFTER_CAPTURE_SUPPORTED[] = "preview-after-capture-supported";
+const char IntelCameraParameters::KEY_LOSSLESS_ROTATION[] = "lossless-rotation";
+const char IntelCameraParameters::KEY_LOSSLESS_ROTATION_SUPPORTED[] = "lossless-rotation-supported";
+const char IntelCameraParameters::KEY_SCREENNAIL_SIZE[] = "screennail-size";
+const char IntelCameraParameters::KEY_SUPPORTED_SCREENNAIL_SIZES[] = "screennail-size-values";
+const char IntelCameraParameters::KEY_PICTURE_STRIDE[] = "picture-stride";
+const char IntelCameraParameters::KEY_MFNR_FRAMES[] = "mfnr-frames";
+const char IntelCameraParameters::KEY_SUPPORTED_MFNR_FRAMES[] = "mfnr-frames-values";
+
+}; // namespace android
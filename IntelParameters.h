@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_INTEL_PARAMETERS_H
+#define ANDROID_LIBCAMERA_INTEL_PARAMETERS_H
+
+namespace android {
+
+//
+// Parameter keys supported by this HAL on top of the ones
+// defined in CameraParameters.
+//
+class IntelCameraParameters {
+
+public:
+
+    // Sensor frame rate used while in video mode. Rates above 30 select the
+    // high frame rate mode in which preview is decimated to 30fps while the
+    // video callbacks get every frame.
+    // Example value: "120". Read/write.
+    static const char KEY_RECORDING_FRAME_RATE[];
+    // Supported recording frame rates.
+    // Example value: "30,60,120". Read only.
+    static const char KEY_SUPPORTED_RECORDING_FRAME_RATES[];
+
+    // Motion adaptive temporal noise reduction of the video frames.
+    // Example value: "true". Read/write.
+    static const char KEY_TEMPORAL_NOISE_REDUCTION[];
+    // Whether temporal noise reduction is supported.
+    // Example value: "true". Read only.
+    static const char KEY_TEMPORAL_NOISE_REDUCTION_SUPPORTED[];
+
+    // Restart preview as soon as the snapshot is taken, while the picture
+    // is still being encoded. startPreview after the picture callbacks then
+    // has nothing left to do.
+    // Example value: "true". Read/write.
+    static const char KEY_PREVIEW_AFTER_CAPTURE[];
+    // Whether preview can restart before the picture is encoded.
+    // Example value: "true". Read only.
+    static const char KEY_PREVIEW_AFTER_CAPTURE_SUPPORTED[];
+
+    // Turn pictures by KEY_ROTATION in the JPEG itself instead of only
+    // setting the EXIF orientation, for viewers that ignore EXIF. Pictures
+    // are turned while encoding, with no loss of quality.
+    // Example value: "true". Read/write.
+    static const char KEY_LOSSLESS_ROTATION[];
+    // Whether pictures can be turned in the JPEG.
+    // Example value: "true". Read only.
+    static const char KEY_LOSSLESS_ROTATION_SUPPORTED[];
+
+    // Size of the screennail, a mid-size JPEG of the picture for display
+    // that is sent with CAMERA_MSG_POSTVIEW_FRAME ahead of the picture. It
+    // is made along with the thumbnail from a single downscale of the
+    // snapshot. "0x0" turns it off.
+    // Example value: "960x720". Read/write.
+    static const char KEY_SCREENNAIL_SIZE[];
+    // Suggested screennail sizes, any even size up to the picture size works.
+    // Example value: "0x0,640x480,960x720". Read only.
+    static const char KEY_SUPPORTED_SCREENNAIL_SIZES[];
+
+    // Bytes from one row to the next of uncompressed pictures, which are
+    // taken when the picture format is the YUV format of the sensor. They
+    // are sent as is with CAMERA_MSG_RAW_IMAGE and no JPEG is made.
+    // Example value: "6528". Read only.
+    static const char KEY_PICTURE_STRIDE[];
+
+    // Number of frames of a short burst that are aligned and merged into
+    // each still picture to lower its noise. "0" takes a single frame.
+    // Example value: "6". Read/write.
+    static const char KEY_MFNR_FRAMES[];
+    // Supported multi-frame noise reduction burst lengths.
+    // Example value: "0,4,6,8". Read only.
+    static const char KEY_SUPPORTED_MFNR_FRAMES[];
+
+}; // class IntelCameraParameters
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_INTEL_PARAMETERS_H
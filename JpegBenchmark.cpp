@@ -0,0 +1,547 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_JpegBenchmark"
+
+/*
+ * camera_jpeg_bench times the JPEG encoding of the HAL outside of a camera
+ * session: every encoder backend on its own, JpegCompressor with the backend
+ * it picks, and the whole picture file with EXIF made by PictureEncoder,
+ * with and without a thumbnail. Frames are synthetic or read from a file of
+ * recorded frames.
+ *
+ * Usage: camera_jpeg_bench [-n iterations] [-m megapixels] [-q qualities]
+ *                          [-b backends] [-f yuyv|nv12|nv21]
+ *                          [-i frames.yuv -s WIDTHxHEIGHT]
+ *
+ * Lists are comma separated, e.g. -m 0.3,8 -q 50,95 -b libjpeg,skia.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+#include <utils/Timers.h>
+#include "CameraCommon.h"
+#include "Callbacks.h"
+#include "JpegCompressor.h"
+#include "LibjpegEncoder.h"
+#include "SkiaJpegEncoder.h"
+#include "SurfaceJpegEncoder.h"
+#include "PictureEncoder.h"
+#include "LogHelper.h"
+
+namespace android {
+
+// the still picture sizes of the sensors, by megapixels
+static const struct {
+    const char *name;
+    int width;
+    int height;
+} SIZES[] = {
+    { "0.3", 640, 480 },
+    { "2", 1600, 1200 },
+    { "5", 2560, 1920 },
+    { "8", 3264, 2448 },
+};
+
+static const int DEFAULT_QUALITIES[] = { 50, 75, 85, 95 };
+static const int DEFAULT_ITERATIONS = 10;
+static const int MAX_QUALITIES = 16;
+static const int MAX_FRAMES = 8;            // recorded frames kept in memory
+static const int THUMBNAIL_WIDTH = 320;     // the default thumbnail of the HAL
+static const int THUMBNAIL_HEIGHT = 240;
+static const int THUMBNAIL_QUALITY = 50;
+
+struct Options {
+    int iterations;
+    int format;
+    const char *sizes;      // names from SIZES, NULL for all
+    const char *backends;   // NULL for all
+    int qualities[MAX_QUALITIES];
+    int numQualities;
+    const char *file;       // recorded frames, NULL for a synthetic frame
+    int fileWidth;
+    int fileHeight;
+};
+
+// the frames one row of the table encodes in turn
+struct Frames {
+    int width;
+    int height;
+    int format;
+    int size;
+    CameraBuffer buffers[MAX_FRAMES];
+    int num;
+};
+
+struct Result {
+    float meanMs;
+    float minMs;
+    int bytes;          // of the last image
+    long peakKb;        // resident memory, -1 if unknown
+};
+
+/*
+ * Encodes one frame the way a row of the table measures. Returns the JPEG
+ * size or -1 on error.
+ */
+class Runner {
+public:
+    virtual ~Runner() {}
+    virtual int encode(CameraBuffer *frame) = 0;
+};
+
+// a single backend, as JpegCompressor would call it
+class EncoderRunner : public Runner {
+public:
+    EncoderRunner(IJpegEncoder *encoder, const Frames &frames, int quality) :
+        mEncoder(encoder)
+    {
+        mIn.clear();
+        mIn.width = frames.width;
+        mIn.height = frames.height;
+        mIn.format = frames.format;
+        mIn.size = frames.size;
+        mOut.clear();
+        mOut.width = frames.width;
+        mOut.height = frames.height;
+        mOut.quality = quality;
+        mOut.size = frames.width * frames.height * 2;
+        mOut.buf = new unsigned char[mOut.size];
+        mEncoder->prepare(mIn);
+    }
+    ~EncoderRunner() { delete[] mOut.buf; }
+    virtual int encode(CameraBuffer *frame)
+    {
+        mIn.buf = (unsigned char *) frame->getData();
+        return mEncoder->encode(mIn, mOut);
+    }
+
+private:
+    IJpegEncoder *mEncoder;
+    JpegCompressor::InputBuffer mIn;
+    JpegCompressor::OutputBuffer mOut;
+};
+
+// JpegCompressor with the backend it selects
+class CompressorRunner : public Runner {
+public:
+    CompressorRunner(JpegCompressor *compressor, const Frames &frames, int quality) :
+        mCompressor(compressor)
+    {
+        mIn.clear();
+        mIn.width = frames.width;
+        mIn.height = frames.height;
+        mIn.format = frames.format;
+        mIn.size = frames.size;
+        mOut.clear();
+        mOut.width = frames.width;
+        mOut.height = frames.height;
+        mOut.quality = quality;
+        mOut.size = frames.width * frames.height * 2;
+        mOut.buf = new unsigned char[mOut.size];
+        mCompressor->prepare(mIn);
+    }
+    ~CompressorRunner() { delete[] mOut.buf; }
+    virtual int encode(CameraBuffer *frame)
+    {
+        mIn.buf = (unsigned char *) frame->getData();
+        return mCompressor->encode(mIn, mOut);
+    }
+
+private:
+    JpegCompressor *mCompressor;
+    JpegCompressor::InputBuffer mIn;
+    JpegCompressor::OutputBuffer mOut;
+};
+
+// the final JPEG file as PictureThread makes it
+class PictureRunner : public Runner {
+public:
+    PictureRunner(const Frames &frames, int quality, bool thumbnail)
+    {
+        PictureEncoder::Config config;
+        memset(&config, 0, sizeof(config));
+        config.picture.format = frames.format;
+        config.picture.quality = quality;
+        config.picture.width = frames.width;
+        config.picture.height = frames.height;
+        config.exif.width = frames.width;
+        config.exif.height = frames.height;
+        if (thumbnail) {
+            config.thumbnail.format = frames.format;
+            config.thumbnail.quality = THUMBNAIL_QUALITY;
+            config.thumbnail.width = THUMBNAIL_WIDTH;
+            config.thumbnail.height = THUMBNAIL_HEIGHT;
+            config.exif.enableThumb = true;
+            config.exif.widthThumb = THUMBNAIL_WIDTH;
+            config.exif.heightThumb = THUMBNAIL_HEIGHT;
+        }
+        mEncoder.setConfig(config);
+        mEncoder.allocateResources(config.picture, config.thumbnail, config.screennail);
+    }
+    virtual int encode(CameraBuffer *frame)
+    {
+        CameraBuffer dest;
+        if (mEncoder.encode(frame, NULL, &dest) != NO_ERROR || dest.getData() == NULL)
+            return -1;
+        int size = dest.getCameraMem()->size;
+        dest.releaseMemory();
+        return size;
+    }
+
+private:
+    PictureEncoder mEncoder;
+};
+
+// camera_request_memory of the camera service, without binder
+static void releaseMemory(camera_memory_t *mem)
+{
+    munmap(mem->data, mem->size);
+    delete mem;
+}
+
+static camera_memory_t* getMemory(int fd, size_t size, unsigned int numBufs, void *user)
+{
+    size *= numBufs;
+    void *data = fd >= 0 ?
+            mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) :
+            mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+        return NULL;
+    camera_memory_t *mem = new camera_memory_t;
+    memset(mem, 0, sizeof(*mem));
+    mem->data = data;
+    mem->size = size;
+    mem->release = releaseMemory;
+    return mem;
+}
+
+// whether name is in the comma separated list, any name is in a NULL list
+static bool inList(const char *name, const char *list)
+{
+    if (list == NULL)
+        return true;
+    int length = strlen(name);
+    while (list != NULL) {
+        if (strncmp(list, name, length) == 0 && (list[length] == ',' || list[length] == '\0'))
+            return true;
+        list = strchr(list, ',');
+        if (list != NULL)
+            list++;
+    }
+    return false;
+}
+
+static int parseFormat(const char *name)
+{
+    if (strcmp(name, "yuyv") == 0)
+        return V4L2_PIX_FMT_YUYV;
+    if (strcmp(name, "nv12") == 0)
+        return V4L2_PIX_FMT_NV12;
+    if (strcmp(name, "nv21") == 0)
+        return V4L2_PIX_FMT_NV21;
+    return 0;
+}
+
+/*
+ * Fills a frame with something like a picture: smooth shading, hard edges
+ * and a little sensor noise, so the encoders see the usual mix of flat and
+ * detailed blocks.
+ */
+static void fillSyntheticFrame(int format, int width, int height, unsigned char *buf)
+{
+    unsigned int seed = 12345;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            seed = seed * 1103515245 + 12345;
+            int luma = (x + y) * 200 / (width + height) + 16;
+            if (((x / 48) ^ (y / 48)) & 1)
+                luma += 32;
+            luma += (int) (seed >> 29) - 4;
+            int u = 128 + x * 64 / width - 32;
+            int v = 128 + y * 64 / height - 32;
+            if (format == V4L2_PIX_FMT_YUYV) {
+                buf[(y * width + x) * 2] = luma;
+                buf[(y * width + x) * 2 + 1] = (x & 1) ? v : u;
+            } else {
+                buf[y * width + x] = luma;
+                if (((x | y) & 1) == 0) {
+                    unsigned char *chroma = buf + width * height + y / 2 * width + x;
+                    chroma[0] = format == V4L2_PIX_FMT_NV12 ? u : v;
+                    chroma[1] = format == V4L2_PIX_FMT_NV12 ? v : u;
+                }
+            }
+        }
+    }
+}
+
+static bool loadFrames(const Options &options, Frames *frames)
+{
+    Callbacks *callbacks = Callbacks::getInstance();
+    frames->size = frameSize(frames->format, frames->width, frames->height);
+    frames->num = 0;
+
+    if (options.file == NULL) {
+        callbacks->allocateMemory(&frames->buffers[0], frames->size);
+        if (frames->buffers[0].getData() == NULL)
+            return false;
+        fillSyntheticFrame(frames->format, frames->width, frames->height,
+                (unsigned char *) frames->buffers[0].getData());
+        frames->num = 1;
+        return true;
+    }
+
+    int fd = open(options.file, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s\n", options.file);
+        return false;
+    }
+    while (frames->num < MAX_FRAMES) {
+        CameraBuffer *buffer = &frames->buffers[frames->num];
+        callbacks->allocateMemory(buffer, frames->size);
+        if (buffer->getData() == NULL ||
+                read(fd, buffer->getData(), frames->size) != frames->size) {
+            buffer->releaseMemory();
+            break;
+        }
+        frames->num++;
+    }
+    close(fd);
+    if (frames->num == 0)
+        fprintf(stderr, "%s holds no %dx%d frame\n", options.file, frames->width, frames->height);
+    return frames->num > 0;
+}
+
+static void releaseFrames(Frames *frames)
+{
+    for (int i = 0; i < frames->num; i++)
+        frames->buffers[i].releaseMemory();
+    frames->num = 0;
+}
+
+// restarts the peak resident memory count, supported by newer kernels only
+static bool resetPeakMemory()
+{
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0)
+        return false;
+    bool done = write(fd, "5", 1) == 1;
+    close(fd);
+    return done;
+}
+
+static long getPeakMemoryKb()
+{
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == NULL)
+        return -1;
+    char line[128];
+    long peak = -1;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "VmHWM: %ld", &peak) == 1)
+            break;
+    }
+    fclose(file);
+    return peak;
+}
+
+/*
+ * Encodes the frames in turn, once untimed so that the one time setup and
+ * the backend benchmark of JpegCompressor are left out, then iterations
+ * times.
+ */
+static bool measure(Runner *runner, Frames *frames, int iterations, Result *result)
+{
+    result->bytes = runner->encode(&frames->buffers[0]);
+    if (result->bytes <= 0)
+        return false;
+
+    nsecs_t total = 0;
+    nsecs_t min = 0;
+    for (int i = 0; i < iterations; i++) {
+        nsecs_t startTime = systemTime();
+        result->bytes = runner->encode(&frames->buffers[i % frames->num]);
+        nsecs_t time = systemTime() - startTime;
+        if (result->bytes <= 0)
+            return false;
+        total += time;
+        if (i == 0 || time < min)
+            min = time;
+    }
+    result->meanMs = total / iterations / 1000000.0f;
+    result->minMs = min / 1000000.0f;
+    result->peakKb = getPeakMemoryKb();
+    return true;
+}
+
+static void printResult(const char *mode, const char *backend, const Frames &frames,
+        int quality, bool thumbnail, const Result *result)
+{
+    printf("%-10s %-8s %5dx%-5d %3d %-5s ", mode, backend, frames.width, frames.height,
+            quality, thumbnail ? "yes" : "no");
+    if (result == NULL) {
+        printf("failed\n");
+        return;
+    }
+    printf("%8.2f %8.2f %8.1f %9d %8ld\n", result->meanMs, result->minMs,
+            frames.width * frames.height / (result->meanMs * 1000.0f),
+            result->bytes, result->peakKb);
+}
+
+static void run(Runner *runner, const char *mode, const char *backend, Frames *frames,
+        int quality, bool thumbnail, int iterations)
+{
+    Result result;
+    bool ok = measure(runner, frames, iterations, &result);
+    printResult(mode, backend, *frames, quality, thumbnail, ok ? &result : NULL);
+}
+
+static void benchmarkSize(const Options &options, Frames *frames)
+{
+    IJpegEncoder *encoders[] = {
+        new LibjpegEncoder(),
+        new SkiaJpegEncoder(),
+        new SurfaceJpegEncoder(),
+    };
+    const int numEncoders = sizeof(encoders) / sizeof(encoders[0]);
+    JpegCompressor compressor;
+
+    for (int q = 0; q < options.numQualities; q++) {
+        int quality = options.qualities[q];
+        for (int i = 0; i < numEncoders; i++) {
+            if (!inList(encoders[i]->getName(), options.backends) ||
+                    !encoders[i]->isFormatSupported(frames->format))
+                continue;
+            resetPeakMemory();
+            EncoderRunner runner(encoders[i], *frames, quality);
+            run(&runner, "encoder", encoders[i]->getName(), frames, quality, false,
+                    options.iterations);
+        }
+
+        resetPeakMemory();
+        {
+            CompressorRunner runner(&compressor, *frames, quality);
+            run(&runner, "compressor", "auto", frames, quality, false, options.iterations);
+        }
+
+        for (int thumbnail = 0; thumbnail <= 1; thumbnail++) {
+            resetPeakMemory();
+            PictureRunner runner(*frames, quality, thumbnail);
+            run(&runner, "picture", "auto", frames, quality, thumbnail, options.iterations);
+        }
+    }
+
+    for (int i = 0; i < numEncoders; i++)
+        delete encoders[i];
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-n iterations] [-m megapixels] [-q qualities] [-b backends]\n"
+            "       [-f yuyv|nv12|nv21] [-i frames.yuv -s WIDTHxHEIGHT]\n", name);
+}
+
+static int runBenchmarks(int argc, char **argv)
+{
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.iterations = DEFAULT_ITERATIONS;
+    options.format = V4L2_PIX_FMT_YUYV;
+    options.numQualities = sizeof(DEFAULT_QUALITIES) / sizeof(DEFAULT_QUALITIES[0]);
+    memcpy(options.qualities, DEFAULT_QUALITIES, sizeof(DEFAULT_QUALITIES));
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:m:q:b:f:i:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            options.iterations = atoi(optarg);
+            break;
+        case 'm':
+            options.sizes = optarg;
+            break;
+        case 'q': {
+            options.numQualities = 0;
+            for (const char *value = optarg; value != NULL && options.numQualities < MAX_QUALITIES;
+                    value = strchr(value, ',') ? strchr(value, ',') + 1 : NULL)
+                options.qualities[options.numQualities++] = atoi(value);
+            break;
+        }
+        case 'b':
+            options.backends = optarg;
+            break;
+        case 'f':
+            options.format = parseFormat(optarg);
+            break;
+        case 'i':
+            options.file = optarg;
+            break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &options.fileWidth, &options.fileHeight) != 2)
+                options.fileWidth = 0;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.iterations <= 0 || options.format == 0 ||
+            (options.file != NULL && (options.fileWidth <= 0 || options.fileHeight <= 0))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Callbacks::getInstance()->setCallbacks(NULL, NULL, NULL, getMemory, NULL);
+    if (!resetPeakMemory())
+        fprintf(stderr, "Peak memory is counted from the start of the process\n");
+
+    printf("%-10s %-8s %11s %3s %-5s %8s %8s %8s %9s %8s\n", "mode", "backend", "size",
+            "q", "thumb", "ms/image", "min ms", "MPix/s", "bytes", "peak KB");
+    Frames frames;
+    frames.format = options.format;
+    if (options.file != NULL) {
+        frames.width = options.fileWidth;
+        frames.height = options.fileHeight;
+        if (!loadFrames(options, &frames))
+            return 1;
+        benchmarkSize(options, &frames);
+        releaseFrames(&frames);
+        return 0;
+    }
+
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++) {
+        if (!inList(SIZES[i].name, options.sizes))
+            continue;
+        frames.width = SIZES[i].width;
+        frames.height = SIZES[i].height;
+        if (!loadFrames(options, &frames))
+            return 1;
+        benchmarkSize(options, &frames);
+        releaseFrames(&frames);
+    }
+    return 0;
+}
+
+}; // namespace android
+
+int main(int argc, char **argv)
+{
+    return android::runBenchmarks(argc, argv);
+}
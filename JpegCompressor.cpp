@@ -15,197 +15,390 @@
  */
 #define LOG_TAG "Camera_JpegCompressor"
 
-#define JPEG_BLOCK_SIZE 4096
-
+#include <string.h>
+#include <cutils/properties.h>
+#include <utils/Timers.h>
 #include "JpegCompressor.h"
-#include "ColorConverter.h"
+#include "LibjpegEncoder.h"
+#include "SkiaJpegEncoder.h"
+#include "SurfaceJpegEncoder.h"
+#include "BufferShareRegistry.h"
+#include "JpegRotator.h"
 #include "LogHelper.h"
-#include "SkBitmap.h"
-#include "SkStream.h"
-#include <string.h>
-
-extern "C" {
-    #include "jpeglib.h"
-}
 
 namespace android {
+
+// forces a backend by name ("libjpeg", "skia", "null" or "surface") instead of the fastest one
+static const char *PROP_JPEG_BACKEND = "camera.jpeg.backend";
+
+// synthetic frame each size class is measured with
+static const int BENCHMARK_SIZES[][2] = { {640, 480}, {1280, 960}, {1600, 1200} };
+static const int BENCHMARK_QUALITY = 85;
+// timed encodes per backend, after one that warms it up
+static const int BENCHMARK_RUNS = 3;
+
+Mutex JpegCompressor::sChoiceLock;
+JpegCompressor::Choice JpegCompressor::sChoices[NUM_SIZE_CLASSES][MAX_CHOICE_FORMATS];
+
 /*
- * START: jpeglib interface functions
+ * Writes SOI and EOI only, so a capture can be timed without the encoding.
+ * Never chosen by the benchmark since its output is not a complete image.
  */
-
-// jpeg destination manager structure
-struct JpegDestinationManager {
-    struct jpeg_destination_mgr pub; // public fields
-    JSAMPLE *encodeBlock;            // encode block buffer
-    JSAMPLE *outJpegBuf;             // JPEG output buffer
-    JSAMPLE *outJpegBufPos;          // JPEG output buffer current ptr
-    int outJpegBufSize;              // JPEG output buffer size
-    int *dataCount;                  // JPEG output buffer data written count
+class NullJpegEncoder : public IJpegEncoder {
+public:
+    virtual const char* getName() { return "null"; }
+    virtual bool isFormatSupported(int format) { return true; }
+    virtual bool canRotate() { return true; }
+    virtual int encode(const InputBuffer &in, const OutputBuffer &out)
+    {
+        static const unsigned char emptyJpeg[4] = { 0xFF, 0xD8, 0xFF, 0xD9 };
+        if (out.size < (int) sizeof(emptyJpeg))
+            return -1;
+        memcpy(out.buf, emptyJpeg, sizeof(emptyJpeg));
+        return sizeof(emptyJpeg);
+    }
 };
 
-// initialize the jpeg compression destination buffer (passed to libjpeg as function pointer)
-static void init_destination(j_compress_ptr cinfo)
+// true if jpeg has SOI, a frame header, a scan header and ends with EOI
+static bool isCompleteJpeg(const unsigned char *jpeg, int size)
 {
-    LOG1("@%s", __FUNCTION__);
-    JpegDestinationManager *dest = (JpegDestinationManager*) cinfo->dest;
-    dest->encodeBlock = (JSAMPLE *)(*cinfo->mem->alloc_small) \
-            ((j_common_ptr) cinfo, JPOOL_IMAGE, JPEG_BLOCK_SIZE * sizeof(JSAMPLE));
-    dest->pub.next_output_byte = dest->encodeBlock;
-    dest->pub.free_in_buffer = JPEG_BLOCK_SIZE;
+    if (size < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8 ||
+        jpeg[size - 2] != 0xFF || jpeg[size - 1] != 0xD9)
+        return false;
+
+    bool frame = false;
+    int pos = 2;
+    while (pos + 4 <= size && jpeg[pos] == 0xFF) {
+        int marker = jpeg[pos + 1];
+        if (marker >= 0xC0 && marker <= 0xC3)
+            frame = true;
+        if (marker == 0xDA)
+            return frame;
+        pos += 2 + ((jpeg[pos + 2] << 8) | jpeg[pos + 3]);
+    }
+    return false;
 }
 
-// handle the jpeg output buffers (passed to libjpeg as function pointer)
-static boolean empty_output_buffer(j_compress_ptr cinfo)
+// fills a frame with a gradient and some noise, so the encoder has detail to code
+static void fillSyntheticFrame(unsigned char *buf, int size)
 {
-    LOG2("@%s", __FUNCTION__);
-    JpegDestinationManager *dest = (JpegDestinationManager*) cinfo->dest;
-    if(dest->outJpegBufSize < *(dest->dataCount) + JPEG_BLOCK_SIZE)
-    {
-        ALOGE("JPEGLIB: empty_output_buffer overflow!");
-        *(dest->dataCount) = 0;
-        return FALSE;
+    unsigned int seed = 12345;
+    for (int i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = ((i >> 3) + (seed >> 29)) & 0xFF;
     }
-    memcpy(dest->outJpegBufPos, dest->encodeBlock, JPEG_BLOCK_SIZE);
-    dest->outJpegBufPos += JPEG_BLOCK_SIZE;
-    *(dest->dataCount) += JPEG_BLOCK_SIZE;
-    dest->pub.next_output_byte = dest->encodeBlock;
-    dest->pub.free_in_buffer = JPEG_BLOCK_SIZE;
-    return TRUE;
 }
 
-// terminate the compression destination buffer (passed to libjpeg as function pointer)
-static void term_destination(j_compress_ptr cinfo)
+JpegCompressor::JpegCompressor() :
+    mVaInputSurfacesNum(0)
+    ,mVaSurfaceWidth(0)
+    ,mVaSurfaceHeight(0)
+    ,mVaSurfaceFormat(0)
+    ,mSharedBuffersGeneration(0)
+    ,mStartSharedBuffersEncode(false)
+    ,mRotateBuf(NULL)
+    ,mRotateBufSize(0)
 {
     LOG1("@%s", __FUNCTION__);
-    JpegDestinationManager *dest = (JpegDestinationManager*) cinfo->dest;
-    int dataCount = JPEG_BLOCK_SIZE - dest->pub.free_in_buffer;
-    if(dest->outJpegBufSize < dataCount || dataCount < 0)
-    {
-        if (dataCount < 0)
-            ALOGE("jpeg overrun. this should not happen");
+    mBackends[BACKEND_LIBJPEG] = new LibjpegEncoder();
+    mBackends[BACKEND_SKIA] = new SkiaJpegEncoder();
+    mBackends[BACKEND_NULL] = new NullJpegEncoder();
+    mBackends[BACKEND_SURFACE] = new SurfaceJpegEncoder();
+    memset(mVaInputSurfacesPtr, 0, sizeof(mVaInputSurfacesPtr));
+    mJpegSize = -1;
+}
 
-        *(dest->dataCount) = 0;
-        return;
+JpegCompressor::~JpegCompressor()
+{
+    LOG1("@%s", __FUNCTION__);
+    for (int i = 0; i < NUM_BACKENDS; i++)
+        delete mBackends[i];
+    delete[] mRotateBuf;
+}
+
+JpegCompressor::SizeClass JpegCompressor::getSizeClass(int width, int height)
+{
+    if (width * height <= 640 * 480)
+        return SIZE_SMALL;
+    if (width * height <= 1920 * 1088)
+        return SIZE_MEDIUM;
+    return SIZE_LARGE;
+}
+
+/*
+ * Encodes a synthetic frame of the size class with every backend that takes
+ * the format, once to warm it up and then BENCHMARK_RUNS times. Returns the
+ * fastest one on average that produced a complete JPEG, or -1.
+ */
+int JpegCompressor::benchmarkBackends(SizeClass sizeClass, int format)
+{
+    LOG1("@%s: size class %d, format %s", __FUNCTION__, sizeClass, v4l2Fmt2Str(format));
+    InputBuffer in;
+    OutputBuffer out;
+
+    in.clear();
+    in.width = BENCHMARK_SIZES[sizeClass][0];
+    in.height = BENCHMARK_SIZES[sizeClass][1];
+    in.format = format;
+    in.size = frameSize(format, in.width, in.height);
+    out.clear();
+    out.width = in.width;
+    out.height = in.height;
+    out.quality = BENCHMARK_QUALITY;
+    out.size = in.width * in.height * 2;
+
+    in.buf = new unsigned char[in.size];
+    out.buf = new unsigned char[out.size];
+    fillSyntheticFrame(in.buf, in.size);
+
+    int best = -1;
+    nsecs_t bestTime = 0;
+    for (int i = 0; i < NUM_BACKENDS; i++) {
+        if (i == BACKEND_SURFACE || !mBackends[i]->isFormatSupported(format))
+            continue;
+        mBackends[i]->prepare(in);
+        int size = mBackends[i]->encode(in, out);
+        bool works = size > 0 && isCompleteJpeg(out.buf, size);
+        nsecs_t time = 0;
+        if (works) {
+            nsecs_t startTime = systemTime();
+            for (int run = 0; run < BENCHMARK_RUNS; run++)
+                mBackends[i]->encode(in, out);
+            time = (systemTime() - startTime) / BENCHMARK_RUNS;
+        }
+        LOG1("JPEG backend %s: %dx%d in %ums, %d bytes%s", mBackends[i]->getName(),
+                in.width, in.height, (unsigned)(time / 1000000), size,
+                works ? "" : ", not usable");
+        if (works && (best < 0 || time < bestTime)) {
+            best = i;
+            bestTime = time;
+        }
     }
-    memcpy(dest->outJpegBufPos, dest->encodeBlock, dataCount);
-    dest->outJpegBufPos += dataCount;
-    *(dest->dataCount) += dataCount;
+
+    delete[] in.buf;
+    delete[] out.buf;
+
+    if (best >= 0)
+        ALOGD("Using %s for JPEG encoding of %s images up to %dx%d", mBackends[best]->getName(),
+                v4l2Fmt2Str(format), BENCHMARK_SIZES[sizeClass][0], BENCHMARK_SIZES[sizeClass][1]);
+    else
+        ALOGE("No JPEG backend works for %s images", v4l2Fmt2Str(format));
+    return best;
 }
 
-// setup the destination manager in j_compress_ptr handle
-static int setup_jpeg_destmgr(j_compress_ptr cinfo, JSAMPLE *outBuf, int jpegBufSize, int *jpegSizePtr)
+// the entry for format in the size class, or NULL if all are taken by others
+JpegCompressor::Choice* JpegCompressor::findChoice(SizeClass sizeClass, int format)
 {
-    LOG1("@%s", __FUNCTION__);
-    JpegDestinationManager *dest;
+    Choice *free = NULL;
+    for (int i = 0; i < MAX_CHOICE_FORMATS; i++) {
+        Choice *choice = &sChoices[sizeClass][i];
+        if (choice->format == format)
+            return choice;
+        if (choice->format == 0 && free == NULL)
+            free = choice;
+    }
+    if (free != NULL)
+        free->format = format;
+    return free;
+}
 
-    if(outBuf == NULL || jpegBufSize <= 0 )
-        return -1;
+// the first backend in order of preference that takes format, or -1
+int JpegCompressor::getDefaultBackend(int format)
+{
+    for (int i = 0; i < NUM_BACKENDS; i++) {
+        if (i != BACKEND_NULL && i != BACKEND_SURFACE && mBackends[i]->isFormatSupported(format))
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Returns the backend for encoding images like in: the one forced by the
+ * property, or the fastest one for its size class and format. The first
+ * image of a size class and format runs the benchmark, normally from
+ * prepare() ahead of the capture. It runs without the lock, and while it
+ * does other compressors take the default backend rather than wait.
+ */
+int JpegCompressor::selectBackend(const InputBuffer &in)
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_JPEG_BACKEND, value, NULL) > 0) {
+        for (int i = 0; i < NUM_BACKENDS; i++) {
+            if (strcmp(value, mBackends[i]->getName()) == 0 &&
+                mBackends[i]->isFormatSupported(in.format))
+                return i;
+        }
+        ALOGW("JPEG backend %s is not available, choosing one", value);
+    }
+
+    SizeClass sizeClass = getSizeClass(in.width, in.height);
+    Choice *choice;
+    {
+        Mutex::Autolock lock(sChoiceLock);
+        choice = findChoice(sizeClass, in.format);
+        if (choice != NULL && choice->measured)
+            return choice->backend;
+        if (choice != NULL && choice->measuring)
+            return getDefaultBackend(in.format);
+        if (choice != NULL)
+            choice->measuring = true;
+    }
+
+    int backend = benchmarkBackends(sizeClass, in.format);
 
-    LOG1("Setting up JPEG destination manager...");
-    dest = (JpegDestinationManager*) cinfo->dest;
-    if (cinfo->dest == NULL) {
-        LOG1("Create destination manager...");
-        cinfo->dest = (struct jpeg_destination_mgr *)(*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT, sizeof(JpegDestinationManager));
-        dest = (JpegDestinationManager*) cinfo->dest;
-        dest->pub.init_destination = init_destination;
-        dest->pub.empty_output_buffer = empty_output_buffer;
-        dest->pub.term_destination = term_destination;
-        dest->outJpegBuf = outBuf;
+    if (choice != NULL) {
+        Mutex::Autolock lock(sChoiceLock);
+        choice->backend = backend;
+        choice->measured = true;
+        choice->measuring = false;
     }
-    LOG1("Out: bufPos = %p, bufSize = %d, dataCount = %d", outBuf, jpegBufSize, *jpegSizePtr);
-    dest->outJpegBufSize = jpegBufSize;
-    dest->outJpegBufPos = outBuf;
-    dest->dataCount = jpegSizePtr;
-    return 0;
+    return backend;
+}
+
+// Allocates what encode() needs for images like in, ahead of time
+void JpegCompressor::prepare(const InputBuffer &in)
+{
+    LOG1("@%s: %dx%d %s", __FUNCTION__, in.width, in.height, v4l2Fmt2Str(in.format));
+    int backend = selectBackend(in);
+    if (backend >= 0)
+        mBackends[backend]->prepare(in);
 }
 
 /*
- * END: jpeglib interface functions
+ * Whether encode() keeps all of a picture like in turned by degrees. The
+ * JPEG of a backend that cannot rotate is rotated losslessly afterwards,
+ * which drops the partial iMCUs of the edges that end up left or top.
  */
+bool JpegCompressor::canRotate(const InputBuffer &in, int degrees)
+{
+    if (degrees != 90 && degrees != 180 && degrees != 270)
+        return false;
+    int backend = selectBackend(in);
+    if (backend >= 0 && mBackends[backend]->canRotate())
+        return true;
+    return canRotateLosslessly(in.width, in.height, degrees);
+}
 
-JpegCompressor::JpegCompressor() :
-    mVaInputSurfacesNum(0)
-    ,mVaSurfaceWidth(0)
-    ,mVaSurfaceHeight(0)
-    ,mJpegCompressStruct(NULL)
-    ,mStartSharedBuffersEncode(false)
-#ifndef ANDROID_1998
-    ,mStartCompressDone(false)
-#endif
+/*
+ * Encodes with one backend. A rotated picture the backend cannot turn is
+ * encoded as is into scratch and then rotated into out without decoding.
+ */
+int JpegCompressor::encodeWith(int backend, const InputBuffer &in, const OutputBuffer &out)
 {
-    LOG1("@%s", __FUNCTION__);
-    mJpegEncoder = SkImageEncoder::Create(SkImageEncoder::kJPEG_Type);
-    if (mJpegEncoder == NULL) {
-        ALOGE("No memory for Skia JPEG encoder!");
+    IJpegEncoder *encoder = mBackends[backend];
+    if (out.rotation == 0 || encoder->canRotate())
+        return encoder->encode(in, out);
+
+    if (mRotateBufSize < out.size) {
+        delete[] mRotateBuf;
+        mRotateBuf = new unsigned char[out.size];
+        mRotateBufSize = out.size;
     }
-    memset(mVaInputSurfacesPtr, 0, sizeof(mVaInputSurfacesPtr));
-    mJpegSize = -1;
+    OutputBuffer unrotated = out;
+    unrotated.buf = mRotateBuf;
+    unrotated.rotation = 0;
+    unrotated.listener = NULL;
+    int size = encoder->encode(in, unrotated);
+    if (size <= 0)
+        return size;
+
+    nsecs_t startTime = systemTime();
+    int width;
+    int height;
+    size = rotateJpeg(mRotateBuf, size, out.rotation, out.buf, out.size, &width, &height);
+    LOG1("JPEG rotated by %d degrees to %dx%d in %ums", out.rotation, width, height,
+            (unsigned)((systemTime() - startTime) / 1000000));
+    return size;
 }
 
-JpegCompressor::~JpegCompressor()
+/*
+ * Registers the snapshot buffers shared by the capture with the backends,
+ * once every time they change rather than for every picture
+ */
+void JpegCompressor::syncSharedBuffers()
 {
-    LOG1("@%s", __FUNCTION__);
-    if (mJpegEncoder != NULL) {
-        LOG1("Deleting Skia JPEG encoder...");
-        delete mJpegEncoder;
+    BufferShareRegistry::SharedBuffers shared;
+    int generation = BufferShareRegistry::getInstance()->getSharedBuffers(
+            mSharedBuffersGeneration, &shared);
+    if (generation == mSharedBuffersGeneration)
+        return;
+    mSharedBuffersGeneration = generation;
+
+    mVaInputSurfacesNum = shared.num;
+    for (int i = 0; i < shared.num; i++)
+        mVaInputSurfacesPtr[i] = (char *) shared.data[i];
+    mVaSurfaceWidth = shared.width;
+    mVaSurfaceHeight = shared.height;
+    mVaSurfaceFormat = shared.format;
+
+    mStartSharedBuffersEncode = false;
+    for (int i = 0; i < NUM_BACKENDS; i++) {
+        if (mBackends[i]->setInputSurfaces((unsigned char **) mVaInputSurfacesPtr,
+                mVaInputSurfacesNum, mVaSurfaceWidth, mVaSurfaceHeight, mVaSurfaceFormat))
+            mStartSharedBuffersEncode = true;
     }
+    LOG1("%d shared snapshot buffers of %dx%d registered", mVaInputSurfacesNum,
+            mVaSurfaceWidth, mVaSurfaceHeight);
 }
 
-bool JpegCompressor::convertRawImage(void* src, void* dst, int width, int height, int format)
+// Returns the shared surface in is a picture of, or -1
+int JpegCompressor::findSurface(const InputBuffer &in)
 {
-    LOG1("@%s", __FUNCTION__);
-    return colorConvert(format, V4L2_PIX_FMT_RGB565, width, height, src, dst) == NO_ERROR;
+    if (!mStartSharedBuffersEncode || in.width != mVaSurfaceWidth ||
+        in.height != mVaSurfaceHeight || in.format != mVaSurfaceFormat)
+        return -1;
+    for (int i = 0; i < mVaInputSurfacesNum; i++) {
+        if (mVaInputSurfacesPtr[i] == (char *) in.buf)
+            return i;
+    }
+    return -1;
 }
 
-// Takes YUV data (NV12 or YUV420) and outputs JPEG encoded stream
-int JpegCompressor::encode(const InputBuffer &in, const OutputBuffer &out)
+// Takes YUV data (NV12, NV21 or YUYV) and outputs JPEG encoded stream
+int JpegCompressor::encode(const InputBuffer &input, const OutputBuffer &out)
 {
+    syncSharedBuffers();
+    InputBuffer in = input;
+    in.surface = findSurface(input);
+
     LOG1("@%s:\n\t IN  = {buf:%p, w:%u, h:%u, sz:%u, f:%s}" \
-             "\n\t OUT = {buf:%p, w:%u, h:%u, sz:%u, q:%d}",
+             "\n\t OUT = {buf:%p, w:%u, h:%u, sz:%u, q:%d, r:%d}",
             __FUNCTION__,
             in.buf, in.width, in.height, in.size, v4l2Fmt2Str(in.format),
-            out.buf, out.width, out.height, out.size, out.quality);
-    // For SW path
-    SkBitmap skBitmap;
-    SkDynamicMemoryWStream skStream;
-    // For HW path
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_compress_struct* pCinfo;
-    struct jpeg_error_mgr jerr;
-    JSAMPROW row_pointer[1];
+            out.buf, out.width, out.height, out.size, out.quality, out.rotation);
 
     if (in.width == 0 || in.height == 0 || in.format == 0) {
         ALOGE("Invalid input received!");
         mJpegSize = -1;
-        goto exit;
+        return mJpegSize;
     }
-    {
-        // Choose Skia
-        LOG1("Choosing Skia for JPEG encoding");
-        if (mJpegEncoder == NULL) {
-            ALOGE("Skia JpegEncoder not created, cannot encode to JPEG!");
-            mJpegSize = -1;
-            goto exit;
-        }
-        bool success = convertRawImage((void*)in.buf, (void*)out.buf, in.width, in.height, in.format);
-        if (!success) {
-            ALOGE("Could not convert the raw image!");
-            mJpegSize = -1;
-            goto exit;
+
+    int backend = selectBackend(in);
+    if (backend >= 0) {
+        LOG1("Choosing %s for JPEG encoding", mBackends[backend]->getName());
+        mJpegSize = encodeWith(backend, in, out);
+        if (mJpegSize > 0) {
+            if (out.listener != NULL)
+                out.listener->outputReady(mJpegSize);
+            return mJpegSize;
         }
-        skBitmap.setConfig(SkBitmap::kRGB_565_Config, in.width, in.height);
-        skBitmap.setPixels(out.buf, NULL);
-        LOG1("Encoding stream using Skia...");
-        if (mJpegEncoder->encodeStream(&skStream, skBitmap, out.quality)) {
-            mJpegSize = skStream.getOffset();
-            skStream.copyTo(out.buf);
-        } else {
-            ALOGE("Skia could not encode the stream!");
-            mJpegSize = -1;
-            goto exit;
+    }
+
+    // fall back to the other backends that produce images
+    for (int i = 0; i < NUM_BACKENDS; i++) {
+        if (i == backend || i == BACKEND_NULL || i == BACKEND_SURFACE ||
+            !mBackends[i]->isFormatSupported(in.format))
+            continue;
+        ALOGW("Falling back to %s for JPEG encoding", mBackends[i]->getName());
+        if (out.listener != NULL)
+            out.listener->outputDiscarded();
+        mJpegSize = encodeWith(i, in, out);
+        if (mJpegSize > 0) {
+            if (out.listener != NULL)
+                out.listener->outputReady(mJpegSize);
+            break;
         }
     }
-exit:
     return mJpegSize;
 }
 
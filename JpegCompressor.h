@@ -18,29 +18,26 @@
 #define ANDROID_LIBCAMERA_JPEG_COMPRESSOR_H
 
 #include <stdio.h>
-#include "SkImageEncoder.h"
+#include <utils/threads.h>
 #include "CameraCommon.h"
 #include <utils/Errors.h>
 
 namespace android {
 
+class IJpegEncoder;
+
 class JpegCompressor {
     int mJpegSize;
 
-    // For buffer sharing
+    // For buffer sharing, the snapshot buffers the backends have as surfaces
     char* mVaInputSurfacesPtr[MAX_BURST_BUFFERS];
     int mVaInputSurfacesNum;
     int mVaSurfaceWidth;
     int mVaSurfaceHeight;
+    int mVaSurfaceFormat;
+    int mSharedBuffersGeneration; // of BufferShareRegistry the surfaces are from
 
-    SkImageEncoder* mJpegEncoder; // used for small images (< 512x512)
-    void *mJpegCompressStruct;
     bool mStartSharedBuffersEncode;
-#ifndef ANDROID_1998
-    bool mStartCompressDone;
-#endif
-
-    bool convertRawImage(void* src, void* dst, int width, int height, int format);
 
 public:
     JpegCompressor();
@@ -53,6 +50,7 @@ public:
         int height;
         int format;
         int size;
+        int surface; // shared input surface buf is in, -1 if none
 
         void clear()
         {
@@ -61,15 +59,29 @@ public:
             height = 0;
             format = 0;
             size = 0;
+            surface = -1;
         }
     };
 
+    // told while encoding how much of the output is done, so that it can be
+    // passed on before the whole image is
+    class OutputListener {
+    public:
+        virtual ~OutputListener() {}
+        // the first size bytes of the output buffer are final
+        virtual void outputReady(int size) = 0;
+        // what was reported is void, the image is encoded again
+        virtual void outputDiscarded() = 0;
+    };
+
     struct OutputBuffer {
         unsigned char *buf;
         int width;
         int height;
         int size;
         int quality;
+        int rotation; // degrees clockwise the picture is turned when encoded
+        OutputListener *listener; // optional
 
         void clear()
         {
@@ -78,12 +90,60 @@ public:
             height = 0;
             size = 0;
             quality = 0;
+            rotation = 0;
+            listener = NULL;
         }
     };
 
     // Encoder functions
+    void prepare(const InputBuffer &in);
     int encode(const InputBuffer &in, const OutputBuffer &out);
+    bool canRotate(const InputBuffer &in, int degrees);
+
+private:
+    // encoder backends, in order of preference if they are equally fast
+    enum Backend {
+        BACKEND_LIBJPEG = 0,
+        BACKEND_SKIA,
+        BACKEND_NULL,       // writes an empty stream, for measuring the rest of a capture
+        BACKEND_SURFACE,    // stand-in for a hardware encoder, only used when forced
+        NUM_BACKENDS
+    };
+
+    // images of a class are expected to favor the same backend
+    enum SizeClass {
+        SIZE_SMALL = 0,     // up to VGA, thumbnails
+        SIZE_MEDIUM,        // up to 2MP
+        SIZE_LARGE,
+        NUM_SIZE_CLASSES
+    };
+
+    // the backend chosen for a size class and format
+    struct Choice {
+        int format;         // 0 if the entry is free
+        int backend;        // -1 if none works
+        bool measured;
+        bool measuring;     // by one of the compressors, the others do not wait
+    };
+
+    static const int MAX_CHOICE_FORMATS = 4;
+
+    static SizeClass getSizeClass(int width, int height);
+    static Choice* findChoice(SizeClass sizeClass, int format);
+    int getDefaultBackend(int format);
+    int selectBackend(const InputBuffer &in);
+    int benchmarkBackends(SizeClass sizeClass, int format);
+    int encodeWith(int backend, const InputBuffer &in, const OutputBuffer &out);
+    void syncSharedBuffers();
+    int findSurface(const InputBuffer &in);
+
+    IJpegEncoder *mBackends[NUM_BACKENDS];
+    unsigned char *mRotateBuf; // unrotated JPEG of backends that cannot rotate
+    int mRotateBufSize;
 
+    // shared by all compressors, the benchmark is run once per process
+    static Mutex sChoiceLock;
+    static Choice sChoices[NUM_SIZE_CLASSES][MAX_CHOICE_FORMATS];
 };
 
 }; // namespace android
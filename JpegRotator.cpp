@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_JpegRotator"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include "JpegRotator.h"
+#include "LogHelper.h"
+
+extern "C" {
+    #include "jpeglib.h"
+    #include "jerror.h"
+}
+
+namespace android {
+
+// largest iMCU our encoders write, 4:2:0 sampling
+static const int MAX_MCU_SIZE = 16;
+
+// jpeg error manager structure, errors jump back to the rotator
+struct RotatorErrorManager {
+    struct jpeg_error_mgr pub;       // public fields
+    jmp_buf setjmpBuffer;            // return point on error
+};
+
+/*
+ * START: jpeglib interface functions
+ */
+
+static void init_source(j_decompress_ptr cinfo)
+{
+}
+
+// the whole stream is handed out at once, so it is truncated if more is asked for
+static boolean fill_input_buffer(j_decompress_ptr cinfo)
+{
+    static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+    WARNMS(cinfo, JWRN_JPEG_EOF);
+    cinfo->src->next_input_byte = eoi;
+    cinfo->src->bytes_in_buffer = sizeof(eoi);
+    return TRUE;
+}
+
+static void skip_input_data(j_decompress_ptr cinfo, long count)
+{
+    struct jpeg_source_mgr *src = cinfo->src;
+    if (count > (long) src->bytes_in_buffer)
+        count = src->bytes_in_buffer;
+    if (count > 0) {
+        src->next_input_byte += count;
+        src->bytes_in_buffer -= count;
+    }
+}
+
+static void term_source(j_decompress_ptr cinfo)
+{
+}
+
+static void init_destination(j_compress_ptr cinfo)
+{
+}
+
+// the whole output buffer was handed out before compressing
+static boolean empty_output_buffer(j_compress_ptr cinfo)
+{
+    ALOGE("JPEGLIB: empty_output_buffer overflow!");
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+    return FALSE;
+}
+
+static void term_destination(j_compress_ptr cinfo)
+{
+}
+
+// report a fatal libjpeg error and unwind to the rotator
+static void rotator_error_exit(j_common_ptr cinfo)
+{
+    char buffer[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, buffer);
+    ALOGE("JPEGLIB: %s", buffer);
+    RotatorErrorManager *err = (RotatorErrorManager*) cinfo->err;
+    longjmp(err->setjmpBuffer, 1);
+}
+
+/*
+ * END: jpeglib interface functions
+ */
+
+/*
+ * The blocks are turned in the DCT domain. Transposing a block transposes
+ * its coefficients, and mirroring it negates the coefficients of odd
+ * frequency in the mirrored direction. Coefficients are indexed by
+ * vertical frequency * DCTSIZE + horizontal frequency.
+ */
+
+// transposes and mirrors horizontally
+static void rotateBlock90(const JCOEF *src, JCOEF *dst)
+{
+    for (int v = 0; v < DCTSIZE; v++)
+        for (int u = 0; u < DCTSIZE; u++)
+            dst[v * DCTSIZE + u] = (u & 1) ? -src[u * DCTSIZE + v] : src[u * DCTSIZE + v];
+}
+
+// mirrors both ways
+static void rotateBlock180(const JCOEF *src, JCOEF *dst)
+{
+    for (int v = 0; v < DCTSIZE; v++)
+        for (int u = 0; u < DCTSIZE; u++)
+            dst[v * DCTSIZE + u] = ((u + v) & 1) ? -src[v * DCTSIZE + u] : src[v * DCTSIZE + u];
+}
+
+// transposes and mirrors vertically
+static void rotateBlock270(const JCOEF *src, JCOEF *dst)
+{
+    for (int v = 0; v < DCTSIZE; v++)
+        for (int u = 0; u < DCTSIZE; u++)
+            dst[v * DCTSIZE + u] = (v & 1) ? -src[u * DCTSIZE + v] : src[u * DCTSIZE + v];
+}
+
+/*
+ * Fills the blocks of one component of the rotated image from the source
+ * ones. fullWidth and fullHeight are the source blocks in whole iMCUs,
+ * the ones that can be mirrored. The arrays are accessed an iMCU row at a
+ * time, which is all the source array allows.
+ */
+static void rotateComponent(j_common_ptr cinfo, const jpeg_component_info *comp,
+        jvirt_barray_ptr srcArray, jvirt_barray_ptr dstArray, int degrees,
+        int fullWidth, int fullHeight)
+{
+    int h = comp->h_samp_factor;
+    int v = comp->v_samp_factor;
+    int width = comp->width_in_blocks;
+    int height = comp->height_in_blocks;
+    JBLOCKARRAY dstRows;
+    JBLOCKARRAY srcRows;
+
+    switch (degrees) {
+    case 90:
+        // destination rows are source columns, read from the bottom up
+        for (int y = 0; y < width; y += h) {
+            dstRows = (*cinfo->mem->access_virt_barray)(cinfo, dstArray, y, h, TRUE);
+            for (int x = 0; x < fullHeight; x += v) {
+                srcRows = (*cinfo->mem->access_virt_barray)(cinfo, srcArray,
+                        fullHeight - x - v, v, FALSE);
+                for (int r = 0; r < h && y + r < width; r++)
+                    for (int k = 0; k < v; k++)
+                        rotateBlock90(srcRows[v - 1 - k][y + r], dstRows[r][x + k]);
+            }
+        }
+        break;
+    case 180:
+        for (int y = 0; y < fullHeight; y += v) {
+            dstRows = (*cinfo->mem->access_virt_barray)(cinfo, dstArray, y, v, TRUE);
+            srcRows = (*cinfo->mem->access_virt_barray)(cinfo, srcArray,
+                    fullHeight - y - v, v, FALSE);
+            for (int r = 0; r < v; r++)
+                for (int x = 0; x < fullWidth; x++)
+                    rotateBlock180(srcRows[v - 1 - r][fullWidth - 1 - x], dstRows[r][x]);
+        }
+        break;
+    case 270:
+        // destination rows are source columns, read from the right
+        for (int y = 0; y < fullWidth; y += h) {
+            dstRows = (*cinfo->mem->access_virt_barray)(cinfo, dstArray, y, h, TRUE);
+            for (int x = 0; x < height; x += v) {
+                srcRows = (*cinfo->mem->access_virt_barray)(cinfo, srcArray, x, v, FALSE);
+                for (int r = 0; r < h; r++)
+                    for (int k = 0; k < v && x + k < height; k++)
+                        rotateBlock270(srcRows[k][fullWidth - 1 - y - r], dstRows[r][x + k]);
+            }
+        }
+        break;
+    }
+}
+
+bool canRotateLosslessly(int width, int height, int degrees)
+{
+    switch (degrees) {
+    case 90:
+        return height % MAX_MCU_SIZE == 0;
+    case 180:
+        return width % MAX_MCU_SIZE == 0 && height % MAX_MCU_SIZE == 0;
+    case 270:
+        return width % MAX_MCU_SIZE == 0;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Reads the coefficients of the whole image, moves the blocks into arrays
+ * of the rotated size and writes them back out with the same quantization
+ * (transposed along with the blocks) and the standard Huffman tables. Both
+ * coefficient images are held in memory, 6 bytes per pixel for 4:2:0.
+ */
+int rotateJpeg(const unsigned char *jpeg, int size, int degrees,
+        unsigned char *out, int outSize, int *width, int *height)
+{
+    LOG1("@%s: %d degrees", __FUNCTION__, degrees);
+    struct jpeg_decompress_struct src;
+    struct jpeg_compress_struct dst;
+    struct jpeg_source_mgr srcMgr;
+    struct jpeg_destination_mgr dstMgr;
+    RotatorErrorManager jerr;
+    jvirt_barray_ptr dstArrays[MAX_COMPONENTS];
+
+    if (degrees != 90 && degrees != 180 && degrees != 270) {
+        ALOGE("Invalid rotation %d", degrees);
+        return -1;
+    }
+
+    src.err = jpeg_std_error(&jerr.pub);
+    dst.err = &jerr.pub;
+    jerr.pub.error_exit = rotator_error_exit;
+    jpeg_create_decompress(&src);
+    jpeg_create_compress(&dst);
+    if (setjmp(jerr.setjmpBuffer)) {
+        jpeg_destroy_compress(&dst);
+        jpeg_destroy_decompress(&src);
+        return -1;
+    }
+
+    srcMgr.init_source = init_source;
+    srcMgr.fill_input_buffer = fill_input_buffer;
+    srcMgr.skip_input_data = skip_input_data;
+    srcMgr.resync_to_restart = jpeg_resync_to_restart;
+    srcMgr.term_source = term_source;
+    srcMgr.next_input_byte = jpeg;
+    srcMgr.bytes_in_buffer = size;
+    src.src = &srcMgr;
+    jpeg_read_header(&src, TRUE);
+
+    bool transpose = degrees != 180;
+    int mcuWidth = src.max_h_samp_factor * DCTSIZE;
+    int mcuHeight = src.max_v_samp_factor * DCTSIZE;
+    int fullMcuCols = src.image_width / mcuWidth;
+    int fullMcuRows = src.image_height / mcuHeight;
+    if ((degrees != 270 && fullMcuRows == 0) || (degrees != 90 && fullMcuCols == 0)) {
+        ALOGE("%dx%d is too small to rotate", src.image_width, src.image_height);
+        jpeg_destroy_compress(&dst);
+        jpeg_destroy_decompress(&src);
+        return -1;
+    }
+
+    // the destination arrays must be requested before the source is read
+    for (int ci = 0; ci < src.num_components; ci++) {
+        jpeg_component_info *comp = src.comp_info + ci;
+        JDIMENSION cols = (comp->width_in_blocks + comp->h_samp_factor - 1) /
+                comp->h_samp_factor * comp->h_samp_factor;
+        JDIMENSION rows = (comp->height_in_blocks + comp->v_samp_factor - 1) /
+                comp->v_samp_factor * comp->v_samp_factor;
+        if (transpose)
+            dstArrays[ci] = (*src.mem->request_virt_barray)((j_common_ptr) &src,
+                    JPOOL_IMAGE, FALSE, rows, cols, comp->h_samp_factor);
+        else
+            dstArrays[ci] = (*src.mem->request_virt_barray)((j_common_ptr) &src,
+                    JPOOL_IMAGE, FALSE, cols, rows, comp->v_samp_factor);
+    }
+
+    jvirt_barray_ptr *srcArrays = jpeg_read_coefficients(&src);
+
+    jpeg_copy_critical_parameters(&src, &dst);
+    dst.write_JFIF_header = FALSE; // the caller adds EXIF
+    switch (degrees) {
+    case 90:
+        dst.image_width = fullMcuRows * mcuHeight;
+        dst.image_height = src.image_width;
+        break;
+    case 180:
+        dst.image_width = fullMcuCols * mcuWidth;
+        dst.image_height = fullMcuRows * mcuHeight;
+        break;
+    case 270:
+        dst.image_width = src.image_height;
+        dst.image_height = fullMcuCols * mcuWidth;
+        break;
+    }
+
+    if (transpose) {
+        for (int ci = 0; ci < dst.num_components; ci++) {
+            jpeg_component_info *comp = dst.comp_info + ci;
+            int h = comp->h_samp_factor;
+            comp->h_samp_factor = comp->v_samp_factor;
+            comp->v_samp_factor = h;
+        }
+        // the coefficients are transposed, so are the tables they were quantized with
+        for (int i = 0; i < NUM_QUANT_TBLS; i++) {
+            JQUANT_TBL *table = dst.quant_tbl_ptrs[i];
+            if (table == NULL)
+                continue;
+            for (int v = 0; v < DCTSIZE; v++) {
+                for (int u = 0; u < v; u++) {
+                    UINT16 q = table->quantval[v * DCTSIZE + u];
+                    table->quantval[v * DCTSIZE + u] = table->quantval[u * DCTSIZE + v];
+                    table->quantval[u * DCTSIZE + v] = q;
+                }
+            }
+        }
+    }
+
+    for (int ci = 0; ci < src.num_components; ci++) {
+        jpeg_component_info *comp = src.comp_info + ci;
+        rotateComponent((j_common_ptr) &src, comp, srcArrays[ci], dstArrays[ci], degrees,
+                fullMcuCols * comp->h_samp_factor, fullMcuRows * comp->v_samp_factor);
+    }
+
+    dstMgr.init_destination = init_destination;
+    dstMgr.empty_output_buffer = empty_output_buffer;
+    dstMgr.term_destination = term_destination;
+    dstMgr.next_output_byte = out;
+    dstMgr.free_in_buffer = outSize;
+    dst.dest = &dstMgr;
+    jpeg_write_coefficients(&dst, dstArrays);
+    jpeg_finish_compress(&dst);
+    int rotatedSize = outSize - dstMgr.free_in_buffer;
+    *width = dst.image_width;
+    *height = dst.image_height;
+
+    jpeg_destroy_compress(&dst);
+    jpeg_finish_decompress(&src);
+    jpeg_destroy_decompress(&src);
+    return rotatedSize;
+}
+
+} // namespace android
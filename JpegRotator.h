@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_JPEG_ROTATOR_H
+#define ANDROID_LIBCAMERA_JPEG_ROTATOR_H
+
+namespace android {
+
+// Whether rotateJpeg keeps every pixel of a width x height picture turned by
+// degrees. The edges that end up on the left or top must hold whole iMCUs.
+bool canRotateLosslessly(int width, int height, int degrees);
+
+// Turns a baseline JPEG clockwise by 90, 180 or 270 degrees without decoding
+// it: the DCT blocks are moved, transposed and mirrored, so no quality is
+// lost and only the entropy coding is redone. Partial iMCUs on the edges that
+// would end up on the left or top are dropped. Writes the rotated JPEG, with
+// no JFIF header, to out and its size to width and height. Returns the size
+// of the rotated JPEG or -1 on error.
+int rotateJpeg(const unsigned char *jpeg, int size, int degrees,
+        unsigned char *out, int outSize, int *width, int *height);
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_JPEG_ROTATOR_H
@@ -0,0 +1,942 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_LibjpegEncoder"
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <cutils/properties.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "LibjpegEncoder.h"
+#include "LogHelper.h"
+#include <string.h>
+
+extern "C" {
+    #include "jpeglib.h"
+    #include "jerror.h"
+}
+
+namespace android {
+
+// overrides the number of JPEG strips, for comparing encode times
+static const char *PROP_JPEG_STRIPS = "camera.jpeg.strips";
+
+// images below this size are not worth splitting
+static const int MIN_STRIPS_IMAGE_SIZE = 1280 * 960;
+
+// restart intervals are 16 bit
+static const int MAX_RESTART_INTERVAL = 0xFFFF;
+
+// room for the JPEG headers of a strip on top of its data
+static const int STRIP_HEADER_SIZE = 4096;
+
+// iMCU rows of a turned input filled at once, so that the input rows are
+// read a cache line at a time rather than a few samples at a time
+static const int ROTATE_MCU_ROWS = 4;
+
+// output handed to libjpeg at a time when it is passed on while encoding
+static const int OUTPUT_CHUNK_SIZE = 64 * 1024;
+
+/*
+ * START: jpeglib interface functions
+ */
+
+// jpeg destination manager structure
+struct JpegDestinationManager {
+    struct jpeg_destination_mgr pub; // public fields
+    JSAMPLE *outJpegBuf;             // JPEG output buffer
+    int outJpegBufSize;              // JPEG output buffer size
+    int *dataCount;                  // JPEG output buffer data written count
+    int windowEnd;                   // end of the part handed to libjpeg
+    IJpegEncoder::OutputListener *listener; // told about every chunk, optional
+};
+
+// jpeg error manager structure, errors jump back to the encoder
+struct JpegErrorManager {
+    struct jpeg_error_mgr pub;       // public fields
+    jmp_buf setjmpBuffer;            // return point on error
+};
+
+// initialize the jpeg compression destination buffer (passed to libjpeg as function pointer)
+static void init_destination(j_compress_ptr cinfo)
+{
+    LOG1("@%s", __FUNCTION__);
+    JpegDestinationManager *dest = (JpegDestinationManager*) cinfo->dest;
+    // libjpeg writes straight into the output buffer, a chunk at a time if
+    // someone is waiting for the output
+    int window = dest->outJpegBufSize;
+    if (dest->listener != NULL && window > OUTPUT_CHUNK_SIZE)
+        window = OUTPUT_CHUNK_SIZE;
+    dest->pub.next_output_byte = dest->outJpegBuf;
+    dest->pub.free_in_buffer = window;
+    dest->windowEnd = window;
+}
+
+// handle the jpeg output buffers (passed to libjpeg as function pointer)
+static boolean empty_output_buffer(j_compress_ptr cinfo)
+{
+    LOG2("@%s", __FUNCTION__);
+    JpegDestinationManager *dest = (JpegDestinationManager*) cinfo->dest;
+    int pos = dest->windowEnd;
+    if (dest->listener == NULL || pos >= dest->outJpegBufSize) {
+        ALOGE("JPEGLIB: empty_output_buffer overflow!");
+        ERREXIT(cinfo, JERR_BUFFER_SIZE);
+        return FALSE;
+    }
+
+    // the chunk is full, pass it on and hand out the next one
+    dest->listener->outputReady(pos);
+    int window = dest->outJpegBufSize - pos;
+    if (window > OUTPUT_CHUNK_SIZE)
+        window = OUTPUT_CHUNK_SIZE;
+    dest->pub.next_output_byte = dest->outJpegBuf + pos;
+    dest->pub.free_in_buffer = window;
+    dest->windowEnd = pos + window;
+    return TRUE;
+}
+
+// terminate the compression destination buffer (passed to libjpeg as function pointer)
+static void term_destination(j_compress_ptr cinfo)
+{
+    LOG1("@%s", __FUNCTION__);
+    JpegDestinationManager *dest = (JpegDestinationManager*) cinfo->dest;
+    *(dest->dataCount) = dest->windowEnd - dest->pub.free_in_buffer;
+    if (dest->listener != NULL)
+        dest->listener->outputReady(*(dest->dataCount));
+}
+
+// setup the destination manager in j_compress_ptr handle
+static int setup_jpeg_destmgr(j_compress_ptr cinfo, JSAMPLE *outBuf, int jpegBufSize, int *jpegSizePtr,
+        IJpegEncoder::OutputListener *listener)
+{
+    LOG1("@%s", __FUNCTION__);
+    JpegDestinationManager *dest;
+
+    if(outBuf == NULL || jpegBufSize <= 0 )
+        return -1;
+
+    LOG1("Setting up JPEG destination manager...");
+    dest = (JpegDestinationManager*) cinfo->dest;
+    if (cinfo->dest == NULL) {
+        LOG1("Create destination manager...");
+        cinfo->dest = (struct jpeg_destination_mgr *)(*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT, sizeof(JpegDestinationManager));
+        dest = (JpegDestinationManager*) cinfo->dest;
+        dest->pub.init_destination = init_destination;
+        dest->pub.empty_output_buffer = empty_output_buffer;
+        dest->pub.term_destination = term_destination;
+    }
+    LOG1("Out: bufPos = %p, bufSize = %d, dataCount = %d", outBuf, jpegBufSize, *jpegSizePtr);
+    dest->outJpegBuf = outBuf;
+    dest->outJpegBufSize = jpegBufSize;
+    dest->dataCount = jpegSizePtr;
+    dest->listener = listener;
+    return 0;
+}
+
+// report a fatal libjpeg error and unwind to the encoder (passed to libjpeg as function pointer)
+static void jpeg_error_exit(j_common_ptr cinfo)
+{
+    char buffer[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, buffer);
+    ALOGE("JPEGLIB: %s", buffer);
+    JpegErrorManager *err = (JpegErrorManager*) cinfo->err;
+    longjmp(err->setjmpBuffer, 1);
+}
+
+/*
+ * END: jpeglib interface functions
+ */
+
+// libjpeg state kept from image to image, so that only what differs between
+// them is set up again. The Huffman tables stay the standard ones and the
+// quantization tables are only scaled again when the quality changes.
+struct LibjpegEncoder::Context {
+    struct jpeg_compress_struct cinfo;
+    JpegErrorManager jerr;
+    int jpegSize;
+    int quality;    // of the quantization tables, 0 until the first image
+};
+
+LibjpegEncoder::LibjpegEncoder()
+{
+    LOG1("@%s", __FUNCTION__);
+}
+
+LibjpegEncoder::~LibjpegEncoder()
+{
+    LOG1("@%s", __FUNCTION__);
+    for (int i = 0; i < MAX_STRIPS; i++)
+        mStrips[i].release();
+}
+
+// libjpeg takes these as raw data, other formats go to another backend
+bool LibjpegEncoder::isFormatSupported(int format)
+{
+    return format == V4L2_PIX_FMT_NV12 ||
+           format == V4L2_PIX_FMT_NV21 ||
+           format == V4L2_PIX_FMT_YUYV;
+}
+
+// splits count YUYV pixels in luma and the two chroma rows
+static void splitYUYV(const unsigned char *src, unsigned char *y,
+        unsigned char *u, unsigned char *v, int count)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= count; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (src + x * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *) (src + x * 2 + 16));
+        __m128i luma = _mm_packus_epi16(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask));
+        __m128i chroma = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *) (y + x), luma);
+        _mm_storel_epi64((__m128i *) (u + x / 2), _mm_packus_epi16(_mm_and_si128(chroma, lowMask), zero));
+        _mm_storel_epi64((__m128i *) (v + x / 2), _mm_packus_epi16(_mm_srli_epi16(chroma, 8), zero));
+    }
+#endif
+    for (; x + 2 <= count; x += 2) {
+        y[x] = src[x * 2];
+        u[x / 2] = src[x * 2 + 1];
+        y[x + 1] = src[x * 2 + 2];
+        v[x / 2] = src[x * 2 + 3];
+    }
+}
+
+// splits count interleaved chroma pairs in two chroma rows
+static void splitChroma(const unsigned char *src, unsigned char *first,
+        unsigned char *second, int count)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    for (; x + 16 <= count; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (src + x * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *) (src + x * 2 + 16));
+        _mm_storeu_si128((__m128i *) (first + x),
+                _mm_packus_epi16(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask)));
+        _mm_storeu_si128((__m128i *) (second + x),
+                _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#endif
+    for (; x < count; x++) {
+        first[x] = src[x * 2];
+        second[x] = src[x * 2 + 1];
+    }
+}
+
+// repeats the last sample of a row up to the padded width
+static void padRow(unsigned char *row, int width, int paddedWidth)
+{
+    if (width < paddedWidth)
+        memset(row + width, row[width - 1], paddedWidth - width);
+}
+
+/*
+ * Points the libjpeg raw data rows of the iMCU row starting at firstRow at
+ * the input image. Luma rows of NV12/NV21 images with a width multiple of 16
+ * are used in place, everything else is copied into the scratch rows.
+ */
+static void fillRawRows(const IJpegEncoder::InputBuffer &in, unsigned char *scratch,
+        int firstRow, int mcuRows, JSAMPROW *yRows, JSAMPROW *cbRows, JSAMPROW *crRows)
+{
+    int paddedWidth = (in.width + 15) & ~15;
+    int chromaWidth = (in.width + 1) / 2;
+    unsigned char *yScratch = scratch;
+    unsigned char *cbScratch = yScratch + mcuRows * paddedWidth;
+    unsigned char *crScratch = cbScratch + DCTSIZE * paddedWidth / 2;
+
+    if (in.format == V4L2_PIX_FMT_YUYV) {
+        // 4:2:2, chroma rows come with the luma rows
+        for (int i = 0; i < mcuRows; i++) {
+            int y = firstRow + i < in.height ? firstRow + i : in.height - 1;
+            yRows[i] = yScratch + i * paddedWidth;
+            cbRows[i] = cbScratch + i * paddedWidth / 2;
+            crRows[i] = crScratch + i * paddedWidth / 2;
+            splitYUYV(in.buf + y * in.width * 2, yRows[i], cbRows[i], crRows[i], in.width);
+            padRow(yRows[i], in.width, paddedWidth);
+            padRow(cbRows[i], chromaWidth, paddedWidth / 2);
+            padRow(crRows[i], chromaWidth, paddedWidth / 2);
+        }
+        return;
+    }
+
+    // NV12/NV21, 4:2:0
+    for (int i = 0; i < mcuRows; i++) {
+        int y = firstRow + i < in.height ? firstRow + i : in.height - 1;
+        unsigned char *src = in.buf + y * in.width;
+        if (paddedWidth == in.width) {
+            yRows[i] = src;
+        } else {
+            yRows[i] = yScratch + i * paddedWidth;
+            memcpy(yRows[i], src, in.width);
+            padRow(yRows[i], in.width, paddedWidth);
+        }
+    }
+
+    int chromaHeight = (in.height + 1) / 2;
+    unsigned char *chroma = in.buf + in.width * in.height;
+    for (int i = 0; i < DCTSIZE; i++) {
+        int y = firstRow / 2 + i < chromaHeight ? firstRow / 2 + i : chromaHeight - 1;
+        cbRows[i] = cbScratch + i * paddedWidth / 2;
+        crRows[i] = crScratch + i * paddedWidth / 2;
+        // NV12 is CbCr, NV21 is CrCb
+        if (in.format == V4L2_PIX_FMT_NV12)
+            splitChroma(chroma + y * in.width, cbRows[i], crRows[i], chromaWidth);
+        else
+            splitChroma(chroma + y * in.width, crRows[i], cbRows[i], chromaWidth);
+        padRow(cbRows[i], chromaWidth, paddedWidth / 2);
+        padRow(crRows[i], chromaWidth, paddedWidth / 2);
+    }
+}
+
+// whether the image is turned on its side, which swaps its dimensions
+static bool isTransposed(int rotation)
+{
+    return rotation == 90 || rotation == 270;
+}
+
+// size of the encoded image, the input turned by rotation degrees clockwise
+static void getEncodedSize(const IJpegEncoder::InputBuffer &in, int rotation,
+        int *width, int *height)
+{
+    *width = isTransposed(rotation) ? in.height : in.width;
+    *height = isTransposed(rotation) ? in.width : in.height;
+}
+
+// luma samples per chroma sample across and down, the iMCU is 8 times that
+static void getSampling(int format, int rotation, int *h, int *v)
+{
+    if (format != V4L2_PIX_FMT_YUYV) {
+        *h = 2; // 4:2:0 in any orientation
+        *v = 2;
+    } else if (isTransposed(rotation)) {
+        *h = 1; // 4:2:2 on its side is 4:4:0
+        *v = 2;
+    } else {
+        *h = 2;
+        *v = 1;
+    }
+}
+
+// luma rows in one iMCU row: 16 for 4:2:0 and 4:4:0, 8 for 4:2:2
+static int mcuRowHeight(int format, int rotation)
+{
+    int h, v;
+    getSampling(format, rotation, &h, &v);
+    return v * DCTSIZE;
+}
+
+// MCUs in one iMCU row of an image of the given encoded width
+static int mcusPerRow(int format, int rotation, int width)
+{
+    int h, v;
+    getSampling(format, rotation, &h, &v);
+    return (width + h * DCTSIZE - 1) / (h * DCTSIZE);
+}
+
+// iMCU rows filled at once
+static int mcuRowsPerFill(int rotation)
+{
+    return rotation != 0 ? ROTATE_MCU_ROWS : 1;
+}
+
+// bytes of scratch rows the raw rows of an image of the given encoded width need
+static int rawRowsSize(int format, int rotation, int width)
+{
+    int h, v;
+    getSampling(format, rotation, &h, &v);
+    int paddedWidth = (width + 15) & ~15;
+    return mcuRowsPerFill(rotation) *
+            (mcuRowHeight(format, rotation) * paddedWidth + 2 * DCTSIZE * paddedWidth / h);
+}
+
+// the samples of one component in the input, e.g. the Cb samples of NV12
+struct Plane {
+    const unsigned char *base;  // first sample
+    int step;                   // bytes from one sample of a row to the next
+    int stride;                 // bytes from one row to the next
+    int width;                  // samples in a row
+    int height;                 // rows
+};
+
+static void getPlanes(const IJpegEncoder::InputBuffer &in, Plane *y, Plane *cb, Plane *cr)
+{
+    int chromaWidth = (in.width + 1) / 2;
+    if (in.format == V4L2_PIX_FMT_YUYV) {
+        Plane luma = { in.buf, 2, in.width * 2, in.width, in.height };
+        Plane u = { in.buf + 1, 4, in.width * 2, chromaWidth, in.height };
+        Plane v = { in.buf + 3, 4, in.width * 2, chromaWidth, in.height };
+        *y = luma;
+        *cb = u;
+        *cr = v;
+        return;
+    }
+
+    // NV12 is CbCr, NV21 is CrCb
+    const unsigned char *chroma = in.buf + in.width * in.height;
+    int first = in.format == V4L2_PIX_FMT_NV12 ? 0 : 1;
+    Plane luma = { in.buf, 1, in.width, in.width, in.height };
+    Plane u = { chroma + first, 2, in.width, chromaWidth, (in.height + 1) / 2 };
+    Plane v = { chroma + 1 - first, 2, in.width, chromaWidth, (in.height + 1) / 2 };
+    *y = luma;
+    *cb = u;
+    *cr = v;
+}
+
+// Writes rows [i0, i1) and columns [x0, x1) of the plane turned by 90 or 270 degrees
+static void gatherColumns(const Plane &p, int rotation, int firstRow, int i0, int i1,
+        int x0, int x1, JSAMPROW *dst)
+{
+    for (int x = x0; x < x1; x++) {
+        if (rotation == 90) {
+            // row y is column y, bottom up
+            const unsigned char *src = p.base + (p.height - 1 - x) * p.stride + firstRow * p.step;
+            for (int i = i0; i < i1; i++)
+                dst[i][x] = src[i * p.step];
+        } else {
+            // row y is column width - 1 - y, top down
+            const unsigned char *src = p.base + x * p.stride + (p.width - 1 - firstRow) * p.step;
+            for (int i = i0; i < i1; i++)
+                dst[i][x] = src[-i * p.step];
+        }
+    }
+}
+
+#ifdef __SSE2__
+// loads 8 samples step bytes apart into the low half, step is 1, 2 or 4
+static inline __m128i loadSamples(const unsigned char *src, int step)
+{
+    const __m128i zero = _mm_setzero_si128();
+    if (step == 1)
+        return _mm_loadl_epi64((const __m128i *) src);
+    __m128i a = _mm_loadu_si128((const __m128i *) src);
+    if (step == 2)
+        return _mm_packus_epi16(_mm_and_si128(a, _mm_set1_epi16(0x00FF)), zero);
+    const __m128i lowByte = _mm_set1_epi32(0x000000FF);
+    __m128i b = _mm_loadu_si128((const __m128i *) (src + 16));
+    __m128i words = _mm_packs_epi32(_mm_and_si128(a, lowByte), _mm_and_si128(b, lowByte));
+    return _mm_packus_epi16(words, zero);
+}
+
+// transposes 8 rows of 8 bytes held in the low halves
+static inline void transpose8x8(__m128i *rows)
+{
+    __m128i a0 = _mm_unpacklo_epi8(rows[0], rows[1]);
+    __m128i a1 = _mm_unpacklo_epi8(rows[2], rows[3]);
+    __m128i a2 = _mm_unpacklo_epi8(rows[4], rows[5]);
+    __m128i a3 = _mm_unpacklo_epi8(rows[6], rows[7]);
+    __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+    __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+    __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+    __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+    rows[0] = _mm_unpacklo_epi32(b0, b2);
+    rows[2] = _mm_unpackhi_epi32(b0, b2);
+    rows[4] = _mm_unpacklo_epi32(b1, b3);
+    rows[6] = _mm_unpackhi_epi32(b1, b3);
+    rows[1] = _mm_unpackhi_epi64(rows[0], rows[0]);
+    rows[3] = _mm_unpackhi_epi64(rows[2], rows[2]);
+    rows[5] = _mm_unpackhi_epi64(rows[4], rows[4]);
+    rows[7] = _mm_unpackhi_epi64(rows[6], rows[6]);
+}
+#endif
+
+/*
+ * Writes rows [firstRow, firstRow + rows) of the plane turned by rotation
+ * degrees clockwise to dst, padded to paddedWidth. Turned on its side a row
+ * is a column of the plane, gathered 8x8 samples at a time, so the input is
+ * read once no matter the rotation. Rows past the bottom repeat the last one.
+ */
+static void fillRotatedPlane(const Plane &p, int rotation, int firstRow, int rows,
+        JSAMPROW *dst, int paddedWidth)
+{
+    int width = isTransposed(rotation) ? p.height : p.width;
+    int height = isTransposed(rotation) ? p.width : p.height;
+    int valid = height - firstRow < rows ? height - firstRow : rows;
+
+    if (rotation == 180) {
+        // row y is row height - 1 - y, right to left
+        for (int i = 0; i < valid; i++) {
+            const unsigned char *src = p.base + (p.height - 1 - firstRow - i) * p.stride +
+                    (p.width - 1) * p.step;
+            for (int x = 0; x < width; x++)
+                dst[i][x] = src[-x * p.step];
+        }
+    } else {
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 8 <= width; x += 8) {
+            int i = 0;
+            for (; i + 8 <= valid; i += 8) {
+                // the first column read, 8*step bytes are loaded from it
+                int col = rotation == 90 ? firstRow + i : p.width - 8 - firstRow - i;
+                if (col < 0 || col + 9 > p.width)
+                    break;
+                __m128i tile[8];
+                for (int k = 0; k < 8; k++) {
+                    int y = rotation == 90 ? p.height - 1 - x - k : x + k;
+                    tile[k] = loadSamples(p.base + y * p.stride + col * p.step, p.step);
+                }
+                transpose8x8(tile);
+                for (int j = 0; j < 8; j++)
+                    _mm_storel_epi64((__m128i *) (dst[rotation == 90 ? i + j : i + 7 - j] + x),
+                            tile[j]);
+            }
+            gatherColumns(p, rotation, firstRow, i, valid, x, x + 8, dst);
+        }
+#endif
+        gatherColumns(p, rotation, firstRow, 0, valid, x, width, dst);
+    }
+
+    for (int i = 0; i < valid; i++)
+        padRow(dst[i], width, paddedWidth);
+    for (int i = valid; i < rows; i++)
+        memcpy(dst[i], dst[valid - 1], paddedWidth);
+}
+
+/*
+ * Like fillRawRows for numMcuRows iMCU rows of the input turned by rotation
+ * degrees clockwise, which is encoded as is instead of being rotated in a
+ * pass of its own. All rows go through the scratch rows.
+ */
+static void fillRotatedRows(const IJpegEncoder::InputBuffer &in, int rotation,
+        unsigned char *scratch, int firstRow, int numMcuRows,
+        JSAMPROW *yRows, JSAMPROW *cbRows, JSAMPROW *crRows)
+{
+    int width;
+    int height;
+    int h;
+    int v;
+    Plane y;
+    Plane cb;
+    Plane cr;
+    getEncodedSize(in, rotation, &width, &height);
+    getSampling(in.format, rotation, &h, &v);
+    getPlanes(in, &y, &cb, &cr);
+
+    int paddedWidth = (width + 15) & ~15;
+    int chromaWidth = paddedWidth / h;
+    int lumaRows = numMcuRows * v * DCTSIZE;
+    int chromaRows = numMcuRows * DCTSIZE;
+    unsigned char *cbScratch = scratch + lumaRows * paddedWidth;
+    unsigned char *crScratch = cbScratch + chromaRows * chromaWidth;
+    for (int i = 0; i < lumaRows; i++)
+        yRows[i] = scratch + i * paddedWidth;
+    for (int i = 0; i < chromaRows; i++) {
+        cbRows[i] = cbScratch + i * chromaWidth;
+        crRows[i] = crScratch + i * chromaWidth;
+    }
+
+    fillRotatedPlane(y, rotation, firstRow, lumaRows, yRows, paddedWidth);
+    fillRotatedPlane(cb, rotation, firstRow / v, chromaRows, cbRows, chromaWidth);
+    fillRotatedPlane(cr, rotation, firstRow / v, chromaRows, crRows, chromaWidth);
+}
+
+/*
+ * Creates a compressor for YUV fed as raw downsampled data, so that no color
+ * conversion is needed. No JFIF header is written since the caller adds
+ * EXIF. Returns NULL if libjpeg fails.
+ */
+LibjpegEncoder::Context* LibjpegEncoder::createContext()
+{
+    LOG1("@%s", __FUNCTION__);
+    Context *context = new Context;
+    struct jpeg_compress_struct *cinfo = &context->cinfo;
+    cinfo->err = jpeg_std_error(&context->jerr.pub);
+    context->jerr.pub.error_exit = jpeg_error_exit;
+    context->jpegSize = 0;
+    context->quality = 0;
+    if (setjmp(context->jerr.setjmpBuffer)) {
+        jpeg_destroy_compress(cinfo);
+        delete context;
+        return NULL;
+    }
+
+    jpeg_create_compress(cinfo);
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(cinfo);
+    jpeg_set_colorspace(cinfo, JCS_YCbCr);
+    cinfo->raw_data_in = TRUE;
+    cinfo->write_JFIF_header = FALSE;
+    return context;
+}
+
+void LibjpegEncoder::destroyContext(Context *context)
+{
+    if (context != NULL) {
+        jpeg_destroy_compress(&context->cinfo);
+        delete context;
+    }
+}
+
+/*
+ * Encodes rows [firstRow, firstRow + rows) of YUV input turned by rotation
+ * degrees clockwise with the libjpeg compressor of context as a standalone
+ * image. listener, if any, is told about the output a chunk at a time.
+ * Returns the JPEG size or -1 on error.
+ */
+int LibjpegEncoder::encodeRows(const InputBuffer &in, int rotation, int firstRow, int rows,
+        Context *context, unsigned char *scratch,
+        unsigned char *outBuf, int outSize, int quality, OutputListener *listener)
+{
+    LOG1("@%s: rows %d-%d", __FUNCTION__, firstRow, firstRow + rows - 1);
+    if (context == NULL)
+        return -1;
+    struct jpeg_compress_struct *cinfo = &context->cinfo;
+    int width;
+    int height;
+    int h;
+    int v;
+    getEncodedSize(in, rotation, &width, &height);
+    getSampling(in.format, rotation, &h, &v);
+
+    int mcuRows = mcuRowHeight(in.format, rotation);
+    int fillMcuRows = mcuRowsPerFill(rotation);
+    JSAMPROW yRows[ROTATE_MCU_ROWS * 2 * DCTSIZE];
+    JSAMPROW cbRows[ROTATE_MCU_ROWS * DCTSIZE];
+    JSAMPROW crRows[ROTATE_MCU_ROWS * DCTSIZE];
+
+    // the compressor stays usable for the next image
+    if (setjmp(context->jerr.setjmpBuffer)) {
+        jpeg_abort_compress(cinfo);
+        return -1;
+    }
+
+    context->jpegSize = 0;
+    if (setup_jpeg_destmgr(cinfo, outBuf, outSize, &context->jpegSize, listener) < 0) {
+        ALOGE("Invalid output buffer");
+        return -1;
+    }
+
+    cinfo->image_width = width;
+    cinfo->image_height = rows;
+    if (quality != context->quality) {
+        jpeg_set_quality(cinfo, quality, TRUE);
+        context->quality = quality;
+    }
+    cinfo->comp_info[0].h_samp_factor = h;
+    cinfo->comp_info[0].v_samp_factor = v;
+    cinfo->comp_info[1].h_samp_factor = 1;
+    cinfo->comp_info[1].v_samp_factor = 1;
+    cinfo->comp_info[2].h_samp_factor = 1;
+    cinfo->comp_info[2].v_samp_factor = 1;
+
+    jpeg_start_compress(cinfo, TRUE);
+    for (int row = firstRow; row < firstRow + rows; row += fillMcuRows * mcuRows) {
+        int left = (firstRow + rows - row + mcuRows - 1) / mcuRows;
+        int count = left < fillMcuRows ? left : fillMcuRows;
+        if (rotation != 0)
+            fillRotatedRows(in, rotation, scratch, row, count, yRows, cbRows, crRows);
+        else
+            fillRawRows(in, scratch, row, mcuRows, yRows, cbRows, crRows);
+        for (int i = 0; i < count; i++) {
+            JSAMPARRAY planes[3] = { yRows + i * mcuRows, cbRows + i * DCTSIZE,
+                    crRows + i * DCTSIZE };
+            jpeg_write_raw_data(cinfo, planes, mcuRows);
+        }
+    }
+    jpeg_finish_compress(cinfo);
+
+    return context->jpegSize;
+}
+
+void LibjpegEncoder::StripJob::processStripe(int index, int count)
+{
+    Strip *strip = &mEncoder->mStrips[index];
+    nsecs_t startTime = systemTime();
+    int size = encodeRows(*mIn, mRotation, strip->firstRow, strip->rows,
+            strip->context, strip->rawRows, strip->buf, strip->bufSize, mQuality, NULL);
+    strip->time = systemTime() - startTime;
+
+    Mutex::Autolock lock(mLock);
+    strip->size = size;
+    mEncoder->stitchStrips();
+}
+
+void LibjpegEncoder::Strip::reserve(int scratchSize, int outSize)
+{
+    if (context == NULL)
+        context = createContext();
+    if (scratchSize > rawRowsSize) {
+        delete[] rawRows;
+        rawRows = new unsigned char[scratchSize];
+        rawRowsSize = scratchSize;
+    }
+    if (outSize > bufSize) {
+        delete[] buf;
+        buf = new unsigned char[outSize];
+        bufSize = outSize;
+    }
+}
+
+void LibjpegEncoder::Strip::release()
+{
+    destroyContext(context);
+    context = NULL;
+    delete[] rawRows;
+    delete[] buf;
+    rawRows = NULL;
+    buf = NULL;
+    rawRowsSize = 0;
+    bufSize = 0;
+}
+
+/*
+ * Returns the number of strips to split the image in, 1 if it should be
+ * encoded in one piece. Every strip but the last holds the same number of
+ * iMCU rows, which becomes the restart interval, so it must fit in DRI.
+ */
+int LibjpegEncoder::getNumStrips(const InputBuffer &in, int rotation, int *stripMcuRows)
+{
+    int width;
+    int height;
+    getEncodedSize(in, rotation, &width, &height);
+    int mcuRows = mcuRowHeight(in.format, rotation);
+    int totalMcuRows = (height + mcuRows - 1) / mcuRows;
+    int rowMcus = mcusPerRow(in.format, rotation, width);
+
+    int strips = WorkerPool::getInstance()->getNumWorkers();
+    if (in.width * in.height < MIN_STRIPS_IMAGE_SIZE)
+        strips = 1;
+
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_JPEG_STRIPS, value, NULL) > 0 && atoi(value) > 0)
+        strips = atoi(value);
+
+    if (strips > MAX_STRIPS)
+        strips = MAX_STRIPS;
+    if (strips > totalMcuRows)
+        strips = totalMcuRows;
+    if (strips <= 1)
+        return 1;
+
+    int rows = (totalMcuRows + strips - 1) / strips;
+    if (rows * rowMcus > MAX_RESTART_INTERVAL) {
+        rows = MAX_RESTART_INTERVAL / rowMcus;
+        if (rows == 0)
+            return 1;
+    }
+    strips = (totalMcuRows + rows - 1) / rows;
+    if (strips > MAX_STRIPS)
+        return 1;
+
+    *stripMcuRows = rows;
+    return strips;
+}
+
+/*
+ * Locates the SOF0 marker and the start of the entropy coded data (after the
+ * SOS header) in a baseline JPEG written by encodeRows. Returns false if the
+ * stream does not look as expected.
+ */
+static bool findScanData(const unsigned char *jpeg, int size, int *sofOffset,
+        int *sosOffset, int *dataOffset)
+{
+    int pos = 2; // skip SOI
+    *sofOffset = -1;
+    while (pos + 4 <= size) {
+        if (jpeg[pos] != 0xFF)
+            return false;
+        int marker = jpeg[pos + 1];
+        int length = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        if (marker == 0xC0)
+            *sofOffset = pos;
+        if (marker == 0xDA) {
+            *sosOffset = pos;
+            *dataOffset = pos + 2 + length;
+            return *sofOffset > 0 && *dataOffset <= size - 2;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+/*
+ * Appends strip index to the output: the headers of the first strip with the
+ * full image height and a DRI marker come first, then the entropy coded data
+ * of every strip followed by an RSTn marker, or EOI after the last one.
+ */
+bool LibjpegEncoder::appendStrip(int index)
+{
+    const OutputBuffer &out = *mStripJob.mOut;
+    const unsigned char *strip = mStrips[index].buf;
+    int size = mStrips[index].size;
+    int sofOffset;
+    int sosOffset;
+    int dataOffset;
+
+    if (!findScanData(strip, size, &sofOffset, &sosOffset, &dataOffset)) {
+        ALOGE("Could not parse JPEG strip %d", index);
+        return false;
+    }
+
+    // headers, DRI and SOS for the first strip, then data and RSTn or EOI
+    int pos = mStripJob.mStitchedSize;
+    int needed = size - 2 - dataOffset + 2;
+    if (index == 0)
+        needed += dataOffset + 6;
+    if (pos + needed > out.size) {
+        ALOGE("Output buffer too small for stitched JPEG (%d > %d)", pos + needed, out.size);
+        return false;
+    }
+
+    unsigned char *dst = out.buf + pos;
+    if (index == 0) {
+        int height = mStripJob.mHeight;
+        int restartInterval = mStripJob.mRestartInterval;
+        memcpy(dst, strip, sosOffset);
+        dst[sofOffset + 5] = (height >> 8) & 0xFF;
+        dst[sofOffset + 6] = height & 0xFF;
+        dst += sosOffset;
+
+        *dst++ = 0xFF;
+        *dst++ = 0xDD;
+        *dst++ = 0x00;
+        *dst++ = 0x04;
+        *dst++ = (restartInterval >> 8) & 0xFF;
+        *dst++ = restartInterval & 0xFF;
+
+        memcpy(dst, strip + sosOffset, dataOffset - sosOffset);
+        dst += dataOffset - sosOffset;
+    }
+
+    // the entropy coded data ends right before the EOI
+    memcpy(dst, strip + dataOffset, size - 2 - dataOffset);
+    dst += size - 2 - dataOffset;
+    *dst++ = 0xFF;
+    *dst++ = index < mStripJob.mNumStrips - 1 ? 0xD0 + (index & 7) : 0xD9;
+
+    mStripJob.mStitchedSize = dst - out.buf;
+    return true;
+}
+
+/*
+ * Joins the strips that are encoded and next in line to the output, so that
+ * it grows in order while later strips are still encoding. Called with the
+ * strip job lock held.
+ */
+void LibjpegEncoder::stitchStrips()
+{
+    StripJob &job = mStripJob;
+    while (job.mStitched < job.mNumStrips && job.mStitchedSize >= 0) {
+        int index = job.mStitched;
+        if (mStrips[index].size == 0)
+            break;
+        if (mStrips[index].size < 0) {
+            ALOGE("Error encoding JPEG strip %d", index);
+            job.mStitchedSize = -1;
+            break;
+        }
+        if (!appendStrip(index)) {
+            job.mStitchedSize = -1;
+            break;
+        }
+        job.mStitched++;
+        if (job.mOut->listener != NULL)
+            job.mOut->listener->outputReady(job.mStitchedSize);
+    }
+}
+
+/*
+ * Splits the image turned by rotation in strips and makes sure their buffers
+ * are big enough. Returns the number of strips, 1 if the image is encoded in
+ * one piece.
+ */
+int LibjpegEncoder::layoutStrips(const InputBuffer &in, int rotation, int *stripMcuRows)
+{
+    int width;
+    int height;
+    getEncodedSize(in, rotation, &width, &height);
+    int numStrips = getNumStrips(in, rotation, stripMcuRows);
+    int scratchSize = rawRowsSize(in.format, rotation, width);
+
+    if (numStrips <= 1) {
+        mStrips[0].reserve(scratchSize, 0);
+        return 1;
+    }
+
+    int stripHeight = *stripMcuRows * mcuRowHeight(in.format, rotation);
+    for (int i = 0; i < numStrips; i++) {
+        Strip *strip = &mStrips[i];
+        strip->firstRow = i * stripHeight;
+        strip->rows = height - strip->firstRow < stripHeight ?
+                height - strip->firstRow : stripHeight;
+        strip->reserve(scratchSize, width * strip->rows * 2 + STRIP_HEADER_SIZE);
+        strip->size = 0;
+    }
+    return numStrips;
+}
+
+/*
+ * Encodes YUV input with libjpeg, turned by out.rotation. Large images are
+ * split in strips of whole iMCU rows that are encoded concurrently on the
+ * worker pool and stitched together with restart markers as they finish.
+ */
+int LibjpegEncoder::encode(const InputBuffer &in, const OutputBuffer &out)
+{
+    LOG1("@%s", __FUNCTION__);
+    int stripMcuRows = 0;
+    int width;
+    int height;
+    getEncodedSize(in, out.rotation, &width, &height);
+    int numStrips = layoutStrips(in, out.rotation, &stripMcuRows);
+
+    if (numStrips <= 1)
+        return encodeRows(in, out.rotation, 0, height, mStrips[0].context,
+                mStrips[0].rawRows, out.buf, out.size, out.quality, out.listener);
+
+    nsecs_t startTime = systemTime();
+
+    mStripJob.mEncoder = this;
+    mStripJob.mIn = &in;
+    mStripJob.mOut = &out;
+    mStripJob.mRotation = out.rotation;
+    mStripJob.mQuality = out.quality;
+    mStripJob.mHeight = height;
+    mStripJob.mRestartInterval = stripMcuRows * mcusPerRow(in.format, out.rotation, width);
+    mStripJob.mNumStrips = numStrips;
+    mStripJob.mStitched = 0;
+    mStripJob.mStitchedSize = 0;
+    WorkerPool::getInstance()->run(&mStripJob, numStrips);
+
+    nsecs_t encodeTime = systemTime() - startTime;
+    nsecs_t stripTime = 0;
+    for (int i = 0; i < numStrips; i++)
+        stripTime += mStrips[i].time;
+    if (mStripJob.mStitched < numStrips)
+        return -1;
+
+    // strip time over wall time is the speedup over encoding in one piece
+    LOG1("Encoded %d strips in %ums, speedup %.2fx",
+            numStrips,
+            (unsigned)(encodeTime / 1000000),
+            encodeTime > 0 ? (float) stripTime / encodeTime : 0.0f);
+
+    return mStripJob.mStitchedSize;
+}
+
+// Allocates the strip buffers encode() needs for images like in, in either orientation
+void LibjpegEncoder::prepare(const InputBuffer &in)
+{
+    LOG1("@%s: %dx%d %s", __FUNCTION__, in.width, in.height, v4l2Fmt2Str(in.format));
+    int stripMcuRows = 0;
+    layoutStrips(in, 0, &stripMcuRows);
+    layoutStrips(in, 90, &stripMcuRows);
+}
+
+} // namespace android
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_LIBJPEG_ENCODER_H
+#define ANDROID_LIBCAMERA_LIBJPEG_ENCODER_H
+
+#include <utils/Timers.h>
+#include <utils/threads.h>
+#include "IJpegEncoder.h"
+#include "WorkerPool.h"
+
+namespace android {
+
+/**
+ * Encodes NV12, NV21 and YUYV with libjpeg, feeding the planes as raw
+ * data. Large images are split in strips encoded on the worker pool.
+ * Rotated pictures are encoded from the turned planes directly. The libjpeg
+ * state of every strip is kept from image to image.
+ */
+class LibjpegEncoder : public IJpegEncoder {
+
+// constructor destructor
+public:
+    LibjpegEncoder();
+    virtual ~LibjpegEncoder();
+
+// IJpegEncoder overrides
+public:
+    virtual const char* getName() { return "libjpeg"; }
+    virtual bool isFormatSupported(int format);
+    virtual bool canRotate() { return true; }
+    virtual void prepare(const InputBuffer &in);
+    virtual int encode(const InputBuffer &in, const OutputBuffer &out);
+
+// private types
+private:
+    static const int MAX_STRIPS = 8;
+
+    // libjpeg compressor, defined with libjpeg in the .cpp
+    struct Context;
+
+    // a horizontal band of the image encoded on its own
+    struct Strip {
+        int firstRow;
+        int rows;
+        Context *context;
+        unsigned char *rawRows;     // scratch rows for raw data encoding
+        int rawRowsSize;
+        unsigned char *buf;         // encoded strip
+        int bufSize;
+        int size;                   // 0 while encoding, -1 on error
+        nsecs_t time;
+
+        Strip() : firstRow(0), rows(0), context(NULL), rawRows(NULL), rawRowsSize(0),
+                  buf(NULL), bufSize(0), size(0), time(0) {}
+        void reserve(int scratchSize, int outSize);
+        void release();
+    };
+
+    class StripJob : public WorkerPool::Job {
+    public:
+        StripJob() : mEncoder(NULL), mIn(NULL), mOut(NULL), mRotation(0), mQuality(0),
+                     mHeight(0), mRestartInterval(0), mNumStrips(0), mStitched(0),
+                     mStitchedSize(0) {}
+        virtual void processStripe(int index, int count);
+
+        LibjpegEncoder *mEncoder;
+        const InputBuffer *mIn;
+        const OutputBuffer *mOut;
+        int mRotation;
+        int mQuality;
+        int mHeight;
+        int mRestartInterval;
+        int mNumStrips;
+        Mutex mLock;            // guards the strip sizes and the stitching
+        int mStitched;          // strips in the output so far
+        int mStitchedSize;      // bytes in the output so far, -1 on error
+    };
+
+// private methods
+private:
+    static Context* createContext();
+    static void destroyContext(Context *context);
+    static int encodeRows(const InputBuffer &in, int rotation, int firstRow, int rows,
+            Context *context, unsigned char *scratch,
+            unsigned char *outBuf, int outSize, int quality, OutputListener *listener);
+    int getNumStrips(const InputBuffer &in, int rotation, int *stripMcuRows);
+    int layoutStrips(const InputBuffer &in, int rotation, int *stripMcuRows);
+    bool appendStrip(int index);
+    void stitchStrips();
+
+// private data
+private:
+    Strip mStrips[MAX_STRIPS];
+    StripJob mStripJob;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_LIBJPEG_ENCODER_H
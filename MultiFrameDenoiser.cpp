@@ -0,0 +1,518 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_MultiFrameDenoiser"
+
+#include <stdlib.h>
+#include <string.h>
+#include <linux/videodev2.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "MultiFrameDenoiser.h"
+#include "ImageScaler.h"
+#include "LogHelper.h"
+
+namespace android {
+
+// the reference of a merge has this weight, the other frames up to it
+static const int FULL_WEIGHT = 16;
+
+static inline int clamp(int value, int min, int max)
+{
+    return value < min ? min : (value > max ? max : value);
+}
+
+// splits units in count nearly equal stripes
+static inline void stripeRange(int units, int index, int count, int *start, int *end)
+{
+    *start = units * index / count;
+    *end = units * (index + 1) / count;
+}
+
+static int compareInts(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+// sum of absolute differences of two width x height blocks
+static int blockSad(const unsigned char *a, int aStride,
+        const unsigned char *b, int bStride, int width, int height)
+{
+    int sad = 0;
+#ifdef __SSE2__
+    __m128i acc = _mm_setzero_si128();
+#endif
+    for (int y = 0; y < height; y++, a += aStride, b += bStride) {
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 16 <= width; x += 16) {
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (a + x)),
+                                                  _mm_loadu_si128((const __m128i *) (b + x))));
+        }
+#endif
+        for (; x < width; x++)
+            sad += abs(a[x] - b[x]);
+    }
+#ifdef __SSE2__
+    sad += _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+    return sad;
+}
+
+/*
+ * Moves (*dx, *dy) by up to range, keeping the block inside the frame, to
+ * where the size x size block at (x, y) of ref matches frame best. Both
+ * planes are stride wide and height high. Returns the SAD there.
+ */
+static int searchBlock(const unsigned char *ref, const unsigned char *frame,
+        int stride, int height, int x, int y, int size, int range, int *dx, int *dy)
+{
+    int minX = -x, maxX = stride - size - x;
+    int minY = -y, maxY = height - size - y;
+    int cx = clamp(*dx, minX, maxX);
+    int cy = clamp(*dy, minY, maxY);
+    const unsigned char *block = ref + y * stride + x;
+    const unsigned char *origin = frame + y * stride + x;
+
+    // the center wins ties, so flat areas do not wander
+    int best = blockSad(block, stride, origin + cy * stride + cx, stride, size, size);
+    int bestX = cx, bestY = cy;
+    int y1 = cy + range < maxY ? cy + range : maxY;
+    int x1 = cx + range < maxX ? cx + range : maxX;
+    for (int oy = cy - range > minY ? cy - range : minY; oy <= y1; oy++) {
+        for (int ox = cx - range > minX ? cx - range : minX; ox <= x1; ox++) {
+            if (ox == cx && oy == cy)
+                continue;
+            int sad = blockSad(block, stride, origin + oy * stride + ox, stride, size, size);
+            if (sad < best) {
+                best = sad;
+                bestX = ox;
+                bestY = oy;
+            }
+        }
+    }
+    *dx = bestX;
+    *dy = bestY;
+    return best;
+}
+
+/*
+ * Adds the samples of frame to the sums with the weight
+ *   w = min(FULL_WEIGHT, max(0, limit - |frame - ref|))
+ * so differences up to limit - FULL_WEIGHT count fully and larger ones fade
+ * out. The first frame of a merge overwrites the sums instead.
+ */
+static void accumulate(const unsigned char *ref, const unsigned char *frame,
+        unsigned short *sums, unsigned char *weights, int size, int limit, bool first)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i limits = _mm_set1_epi8(limit);
+    const __m128i fullWeight = _mm_set1_epi8(FULL_WEIGHT);
+    for (; i + 16 <= size; i += 16) {
+        __m128i cur = _mm_loadu_si128((const __m128i *) (frame + i));
+        __m128i prev = _mm_loadu_si128((const __m128i *) (ref + i));
+        __m128i diff = _mm_or_si128(_mm_subs_epu8(cur, prev), _mm_subs_epu8(prev, cur));
+        __m128i weight = _mm_min_epu8(_mm_subs_epu8(limits, diff), fullWeight);
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(cur, zero), _mm_unpacklo_epi8(weight, zero));
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(cur, zero), _mm_unpackhi_epi8(weight, zero));
+        if (!first) {
+            lo = _mm_add_epi16(lo, _mm_loadu_si128((const __m128i *) (sums + i)));
+            hi = _mm_add_epi16(hi, _mm_loadu_si128((const __m128i *) (sums + i + 8)));
+            weight = _mm_add_epi8(weight, _mm_loadu_si128((const __m128i *) (weights + i)));
+        }
+        _mm_storeu_si128((__m128i *) (sums + i), lo);
+        _mm_storeu_si128((__m128i *) (sums + i + 8), hi);
+        _mm_storeu_si128((__m128i *) (weights + i), weight);
+    }
+#endif
+    for (; i < size; i++) {
+        int diff = abs(frame[i] - ref[i]);
+        int weight = clamp(limit - diff, 0, FULL_WEIGHT);
+        if (first) {
+            sums[i] = frame[i] * weight;
+            weights[i] = weight;
+        } else {
+            sums[i] += frame[i] * weight;
+            weights[i] += weight;
+        }
+    }
+}
+
+#ifdef __SSE2__
+static inline __m128i divide(__m128i num, __m128i den)
+{
+    return _mm_cvtps_epi32(_mm_div_ps(_mm_cvtepi32_ps(num), _mm_cvtepi32_ps(den)));
+}
+#endif
+
+// ref = (ref * FULL_WEIGHT + sums) / (FULL_WEIGHT + weights), rounded
+static void blend(unsigned char *ref, const unsigned short *sums,
+        const unsigned char *weights, int size)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i fullWeight = _mm_set1_epi16(FULL_WEIGHT);
+    for (; i + 16 <= size; i += 16) {
+        __m128i cur = _mm_loadu_si128((const __m128i *) (ref + i));
+        __m128i weight = _mm_loadu_si128((const __m128i *) (weights + i));
+        __m128i num[2], den[2];
+        num[0] = _mm_add_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(cur, zero), 4),
+                _mm_loadu_si128((const __m128i *) (sums + i)));
+        num[1] = _mm_add_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(cur, zero), 4),
+                _mm_loadu_si128((const __m128i *) (sums + i + 8)));
+        den[0] = _mm_add_epi16(_mm_unpacklo_epi8(weight, zero), fullWeight);
+        den[1] = _mm_add_epi16(_mm_unpackhi_epi8(weight, zero), fullWeight);
+        __m128i out[2];
+        for (int k = 0; k < 2; k++) {
+            out[k] = _mm_packs_epi32(
+                    divide(_mm_unpacklo_epi16(num[k], zero), _mm_unpacklo_epi16(den[k], zero)),
+                    divide(_mm_unpackhi_epi16(num[k], zero), _mm_unpackhi_epi16(den[k], zero)));
+        }
+        _mm_storeu_si128((__m128i *) (ref + i), _mm_packus_epi16(out[0], out[1]));
+    }
+#endif
+    for (; i < size; i++) {
+        int den = FULL_WEIGHT + weights[i];
+        ref[i] = (ref[i] * FULL_WEIGHT + sums[i] + den / 2) / den;
+    }
+}
+
+MultiFrameDenoiser::MultiFrameDenoiser() :
+    mWidth(0)
+    ,mHeight(0)
+    ,mSize(0)
+    ,mTileCols(0)
+    ,mTileRows(0)
+    ,mSums(NULL)
+    ,mWeights(NULL)
+    ,mMotion(NULL)
+    ,mReference(NULL)
+    ,mFrame(NULL)
+    ,mPyramidFrame(NULL)
+    ,mPyramidOut(NULL)
+    ,mThreshold(MIN_THRESHOLD)
+    ,mFrames(0)
+    ,mAlignTime(0)
+    ,mMergeTime(0)
+{
+    LOG1("@%s", __FUNCTION__);
+    for (int i = 0; i < LEVELS; i++) {
+        mRefPyramid[i] = NULL;
+        mPyramid[i] = NULL;
+    }
+    mJob.mDenoiser = this;
+}
+
+MultiFrameDenoiser::~MultiFrameDenoiser()
+{
+    LOG1("@%s", __FUNCTION__);
+    release();
+}
+
+status_t MultiFrameDenoiser::setConfig(int format, int width, int height)
+{
+    LOG1("@%s: %dx%d", __FUNCTION__, width, height);
+    if (format != V4L2_PIX_FMT_YUYV) {
+        ALOGE("Unsupported multi-frame denoiser format %d", format);
+        return BAD_VALUE;
+    }
+    if (width < TILE_SIZE || height < TILE_SIZE || (width & 1)) {
+        ALOGE("Unsupported multi-frame denoiser size %dx%d", width, height);
+        return BAD_VALUE;
+    }
+
+    if (width == mWidth && height == mHeight)
+        return NO_ERROR;
+
+    release();
+    mWidth = width;
+    mHeight = height;
+    mSize = width * height * 2;
+    int levelWidth = width;
+    int levelHeight = height;
+    for (int i = 0; i < LEVELS; i++) {
+        levelWidth /= 2;
+        levelHeight /= 2;
+        mLevelWidth[i] = levelWidth;
+        mLevelHeight[i] = levelHeight;
+        mRefPyramid[i] = new unsigned char[levelWidth * levelHeight];
+        mPyramid[i] = new unsigned char[levelWidth * levelHeight];
+    }
+    mTileCols = (width + TILE_SIZE - 1) / TILE_SIZE;
+    mTileRows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    mMotion = new Motion[mTileCols * mTileRows];
+    mSums = new unsigned short[mSize];
+    mWeights = new unsigned char[mSize];
+    return NO_ERROR;
+}
+
+void MultiFrameDenoiser::release()
+{
+    LOG1("@%s", __FUNCTION__);
+    for (int i = 0; i < LEVELS; i++) {
+        delete[] mRefPyramid[i];
+        delete[] mPyramid[i];
+        mRefPyramid[i] = NULL;
+        mPyramid[i] = NULL;
+    }
+    delete[] mMotion;
+    delete[] mSums;
+    delete[] mWeights;
+    mMotion = NULL;
+    mSums = NULL;
+    mWeights = NULL;
+    mWidth = 0;
+    mHeight = 0;
+    mSize = 0;
+    mReference = NULL;
+}
+
+status_t MultiFrameDenoiser::start(void *reference)
+{
+    LOG1("@%s", __FUNCTION__);
+    if (mSums == NULL) {
+        ALOGE("Multi-frame denoiser not configured");
+        return INVALID_OPERATION;
+    }
+
+    nsecs_t startTime = systemTime();
+    mReference = (unsigned char *) reference;
+    mFrames = 0;
+    mMergeTime = 0;
+
+    mPyramidFrame = mReference;
+    mPyramidOut = mRefPyramid;
+    run(STAGE_PYRAMID);
+
+    mAlignTime = systemTime() - startTime;
+    return NO_ERROR;
+}
+
+status_t MultiFrameDenoiser::add(const void *frame)
+{
+    LOG2("@%s", __FUNCTION__);
+    if (mReference == NULL) {
+        ALOGE("No multi-frame merge started");
+        return INVALID_OPERATION;
+    }
+    if (mFrames + 1 >= MAX_FRAMES) {
+        ALOGE("At most %d frames can be merged", MAX_FRAMES);
+        return INVALID_OPERATION;
+    }
+
+    nsecs_t startTime = systemTime();
+    mFrame = (const unsigned char *) frame;
+    mPyramidFrame = mFrame;
+    mPyramidOut = mPyramid;
+    run(STAGE_PYRAMID);
+    run(STAGE_ALIGN);
+    updateThreshold();
+
+    nsecs_t alignedTime = systemTime();
+    run(STAGE_MERGE);
+    mFrames++;
+
+    mAlignTime += alignedTime - startTime;
+    mMergeTime += systemTime() - alignedTime;
+    return NO_ERROR;
+}
+
+status_t MultiFrameDenoiser::finish()
+{
+    LOG1("@%s", __FUNCTION__);
+    if (mReference == NULL) {
+        ALOGE("No multi-frame merge started");
+        return INVALID_OPERATION;
+    }
+
+    if (mFrames > 0) {
+        nsecs_t startTime = systemTime();
+        run(STAGE_BLEND);
+        mMergeTime += systemTime() - startTime;
+        LOG1("Merged %d frames into the reference: align %.2fms, merge %.2fms",
+                mFrames, mAlignTime / 1000000.0f, mMergeTime / 1000000.0f);
+    }
+    mReference = NULL;
+    mFrame = NULL;
+    return NO_ERROR;
+}
+
+void MultiFrameDenoiser::run(Stage stage)
+{
+    mJob.mStage = stage;
+    WorkerPool *pool = WorkerPool::getInstance();
+    pool->run(&mJob, pool->getNumWorkers());
+}
+
+void MultiFrameDenoiser::StripeJob::processStripe(int index, int count)
+{
+    switch (mStage) {
+    case STAGE_PYRAMID:
+        mDenoiser->buildPyramid(index, count);
+        break;
+    case STAGE_ALIGN:
+        mDenoiser->alignTiles(index, count);
+        break;
+    case STAGE_MERGE:
+        mDenoiser->mergeRows(index, count);
+        break;
+    case STAGE_BLEND:
+        mDenoiser->blendRows(index, count);
+        break;
+    }
+}
+
+/*
+ * Every stripe takes a band of rows of the smallest level and makes the
+ * rows of the larger levels under it first, so the levels need no sync.
+ * The last stripe also takes the rows left over at the bottom.
+ */
+void MultiFrameDenoiser::buildPyramid(int index, int count)
+{
+    int start, end;
+    stripeRange(mLevelHeight[LEVELS - 1], index, count, &start, &end);
+    bool last = index == count - 1;
+
+    for (int level = 0; level < LEVELS; level++) {
+        int scale = 1 << (LEVELS - 1 - level);
+        int y0 = start * scale;
+        int y1 = last ? mLevelHeight[level] : end * scale;
+        int width = mLevelWidth[level];
+        unsigned char *dst = mPyramidOut[level];
+        for (int y = y0; y < y1; y++) {
+            if (level == 0) {
+                int stride = mWidth * 2;
+                halveLumaRow(V4L2_PIX_FMT_YUYV, mPyramidFrame + y * 2 * stride, stride,
+                        dst + y * width, width);
+            } else {
+                int stride = mLevelWidth[level - 1];
+                halveLumaRow(V4L2_PIX_FMT_GREY, mPyramidOut[level - 1] + y * 2 * stride, stride,
+                        dst + y * width, width);
+            }
+        }
+    }
+}
+
+void MultiFrameDenoiser::alignTiles(int index, int count)
+{
+    int start, end;
+    stripeRange(mTileRows, index, count, &start, &end);
+    for (int row = start; row < end; row++) {
+        for (int col = 0; col < mTileCols; col++)
+            alignTile(col, row, &mMotion[row * mTileCols + col]);
+    }
+}
+
+/*
+ * Tiles at the right and bottom edges are matched with the whole block
+ * that ends at the edge, so every level compares full blocks.
+ */
+void MultiFrameDenoiser::alignTile(int col, int row, Motion *motion)
+{
+    int dx = 0, dy = 0;
+    for (int level = LEVELS - 1; level >= 0; level--) {
+        int size = TILE_SIZE >> (level + 1);
+        int width = mLevelWidth[level];
+        int height = mLevelHeight[level];
+        int x = clamp(col * size, 0, width - size);
+        int y = clamp(row * size, 0, height - size);
+        int range = level == LEVELS - 1 ? SEARCH_RANGE : 1;
+        searchBlock(mRefPyramid[level], mPyramid[level], width, height,
+                x, y, size, range, &dx, &dy);
+        dx *= 2;
+        dy *= 2;
+    }
+
+    // at full resolution only the rows are refined, the columns stay even
+    // so that the chroma pairs line up
+    int stride = mWidth * 2;
+    int x = clamp(col * TILE_SIZE, 0, mWidth - TILE_SIZE);
+    int y = clamp(row * TILE_SIZE, 0, mHeight - TILE_SIZE);
+    dx = clamp(dx, -x, mWidth - TILE_SIZE - x);
+    const unsigned char *block = mReference + y * stride + x * 2;
+    const unsigned char *origin = mFrame + y * stride + (x + dx) * 2;
+    int best = -1;
+    int bestY = 0;
+    int center = clamp(dy, -y, mHeight - TILE_SIZE - y);
+    for (int oy = center - 1; oy <= center + 1; oy++) {
+        if (oy < -y || oy > mHeight - TILE_SIZE - y)
+            continue;
+        int sad = blockSad(block, stride, origin + oy * stride, stride,
+                TILE_SIZE * 2, TILE_SIZE);
+        if (best < 0 || sad < best || (sad == best && oy == center)) {
+            best = sad;
+            bestY = oy;
+        }
+    }
+
+    motion->dx = dx;
+    motion->dy = bestY;
+    motion->sad = best * 16 / (TILE_SIZE * TILE_SIZE * 2);
+}
+
+/*
+ * Most tiles only differ by noise once aligned, so the median difference of
+ * the tiles tells the noise level of the frame. Twice that is taken at full
+ * weight.
+ */
+void MultiFrameDenoiser::updateThreshold()
+{
+    int numTiles = mTileCols * mTileRows;
+    int *sads = new int[numTiles];
+    for (int i = 0; i < numTiles; i++)
+        sads[i] = mMotion[i].sad;
+    qsort(sads, numTiles, sizeof(sads[0]), compareInts);
+    int median = sads[numTiles / 2];
+    delete[] sads;
+
+    mThreshold = clamp((median + 4) / 8, MIN_THRESHOLD, MAX_THRESHOLD);
+    LOG2("Noise threshold %d", mThreshold);
+}
+
+void MultiFrameDenoiser::mergeRows(int index, int count)
+{
+    int start, end;
+    stripeRange(mHeight, index, count, &start, &end);
+    int stride = mWidth * 2;
+    int limit = mThreshold + FULL_WEIGHT;
+    bool first = mFrames == 0;
+
+    for (int y = start; y < end; y++) {
+        const Motion *motion = &mMotion[y / TILE_SIZE * mTileCols];
+        for (int col = 0; col < mTileCols; col++, motion++) {
+            int x = col * TILE_SIZE;
+            int bytes = (x + TILE_SIZE < mWidth ? TILE_SIZE : mWidth - x) * 2;
+            int offset = y * stride + x * 2;
+            const unsigned char *frame = mFrame + offset + motion->dy * stride + motion->dx * 2;
+            accumulate(mReference + offset, frame, mSums + offset, mWeights + offset,
+                    bytes, limit, first);
+        }
+    }
+}
+
+void MultiFrameDenoiser::blendRows(int index, int count)
+{
+    int start, end;
+    stripeRange(mHeight, index, count, &start, &end);
+    int stride = mWidth * 2;
+    int offset = start * stride;
+    blend(mReference + offset, mSums + offset, mWeights + offset, (end - start) * stride);
+}
+
+}; // namespace android
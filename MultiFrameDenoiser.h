@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_MULTI_FRAME_DENOISER_H
+#define ANDROID_LIBCAMERA_MULTI_FRAME_DENOISER_H
+
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+#include "WorkerPool.h"
+
+namespace android {
+
+//
+// MultiFrameDenoiser merges a short burst of YUYV snapshots into the first
+// one. Every following frame is aligned to the first tile by tile: a coarse
+// search on a luma pyramid is refined level by level down to full
+// resolution. The aligned samples are then averaged with the first frame,
+// weighted down where they differ from it by more than the noise, so moving
+// objects do not leave ghosts. All stages run in stripes on the WorkerPool.
+//
+class MultiFrameDenoiser {
+
+// constructor destructor
+public:
+    MultiFrameDenoiser();
+    ~MultiFrameDenoiser();
+
+// public methods
+public:
+
+    // Allocates the buffers for frames of the given size
+    status_t setConfig(int format, int width, int height);
+    void release();
+
+    // Starts a burst with the frame that the others are merged into. The
+    // frame must stay valid until finish.
+    status_t start(void *reference);
+
+    // Aligns a frame of the burst and adds it to the merge
+    status_t add(const void *frame);
+
+    // Writes the merged burst into the reference frame
+    status_t finish();
+
+// private types
+private:
+
+    enum Stage {
+        STAGE_PYRAMID,  // mPyramidFrame into mPyramidOut
+        STAGE_ALIGN,    // mPyramid against mRefPyramid, tile rows
+        STAGE_MERGE,    // mFrame added to the sums, rows
+        STAGE_BLEND,    // the sums divided into mReference, rows
+    };
+
+    class StripeJob : public WorkerPool::Job {
+    public:
+        StripeJob() : mDenoiser(NULL), mStage(STAGE_PYRAMID) {}
+        virtual void processStripe(int index, int count);
+
+        MultiFrameDenoiser *mDenoiser;
+        Stage mStage;
+    };
+
+    // offset of the frame to the reference in one tile, in pixels
+    struct Motion {
+        int dx;
+        int dy;
+        int sad;    // per byte of the tile, in 1/16 levels
+    };
+
+// private methods
+private:
+
+    void run(Stage stage);
+    void buildPyramid(int index, int count);
+    void alignTiles(int index, int count);
+    void alignTile(int col, int row, Motion *motion);
+    void mergeRows(int index, int count);
+    void blendRows(int index, int count);
+    void updateThreshold();
+
+// private data
+private:
+
+    static const int LEVELS = 3;            // half, quarter and eighth resolution
+    static const int TILE_SIZE = 128;       // pixels, 16 on the smallest level
+    static const int SEARCH_RANGE = 6;      // on the smallest level, 48 pixels
+    static const int MIN_THRESHOLD = 4;     // differences taken at full weight
+    static const int MAX_THRESHOLD = 40;
+    static const int MAX_FRAMES = 16;       // the sums are 16 bits
+
+    int mWidth;
+    int mHeight;
+    int mSize;
+    int mLevelWidth[LEVELS];
+    int mLevelHeight[LEVELS];
+    int mTileCols;
+    int mTileRows;
+
+    unsigned char *mRefPyramid[LEVELS];
+    unsigned char *mPyramid[LEVELS];
+    unsigned short *mSums;      // weighted samples of the added frames
+    unsigned char *mWeights;    // sum of their weights, the reference has 16
+    Motion *mMotion;
+    StripeJob mJob;
+
+    unsigned char *mReference;
+    const unsigned char *mFrame;
+    const unsigned char *mPyramidFrame;
+    unsigned char **mPyramidOut;
+    int mThreshold;
+    int mFrames;            // added to the reference
+
+    nsecs_t mAlignTime;
+    nsecs_t mMergeTime;
+
+}; // class MultiFrameDenoiser
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_MULTI_FRAME_DENOISER_H
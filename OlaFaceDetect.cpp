@@ -17,9 +17,11 @@
 
 #include "OlaFaceDetect.h"
 #include <stdlib.h>
+#include <linux/videodev2.h>
 #include <system/camera.h>
 #include "IFaceDetectionListener.h"
 #include "CameraCommon.h"
+#include "ImageScaler.h"
 
 #ifdef LOG_TAG
 #undef LOG_TAG
@@ -34,8 +36,22 @@ OlaFaceDetect::OlaFaceDetect(IFaceDetectionListener *pListener) :
             IFaceDetector(pListener),
             mMessageQueue("OlaFaceDetector"),
             mFaceDetectionStruct(0),
-            mbRunning(false)
+            mbRunning(false),
+            mInterval(1),
+            mSkipped(0),
+            mLastFrameTime(0),
+            mFrameDuration(0),
+            mDetectDuration(0),
+            mReportTime(0),
+            mReportFrames(0),
+            mReportDetected(0),
+            mReportDropped(0)
 {
+    for (int i = 0; i < PYRAMID_LEVELS; i++) {
+        mPyramid[i] = 0;
+        mPyramidSize[i] = 0;
+    }
+    mPendingFrame.img = 0;
 }
 
 OlaFaceDetect::~OlaFaceDetect()
@@ -43,9 +59,12 @@ OlaFaceDetect::~OlaFaceDetect()
     ALOGV("%s: Destroy the OlaFaceDetec\n", __func__);
 
     mbRunning = false;
+    releasePendingFrame();
     if (mFaceDetectionStruct)
         CameraFaceDetection_Destroy(&mFaceDetectionStruct);
     mFaceDetectionStruct = 0;
+    for (int i = 0; i < PYRAMID_LEVELS; i++)
+        delete[] mPyramid[i];
 
     ALOGV("%s: Destroy the OlaFaceDetec DONE.\n", __func__);
 }
@@ -78,7 +97,8 @@ void OlaFaceDetect::stop(bool wait)
     ALOGV("%s: STOP Face DEtection mFaceDetectionStruct 0x%p\n", __func__, mFaceDetectionStruct);
     Message msg;
     msg.id = MESSAGE_ID_EXIT;
-    mMessageQueue.remove(MESSAGE_ID_FRAME); // flush all buffers
+    mMessageQueue.remove(MESSAGE_ID_FRAME);
+    releasePendingFrame(); // flush the buffer
     mMessageQueue.send( &msg );
     if (wait) {
         requestExitAndWait();
@@ -94,21 +114,62 @@ status_t OlaFaceDetect::handleExit()
     return NO_ERROR;
 }
 
+/**
+ * Frames are skipped to keep the detector in its CPU budget, see
+ * updateInterval. A taken frame replaces the one still waiting for the
+ * detector, if any, so a slow detector never holds more than one preview
+ * buffer besides the one it works on.
+ */
 int OlaFaceDetect::sendFrame(CameraBuffer *img, int width, int height)
 {
+    if (img == 0)
+        return -1;
     ALOGV("%s: sendFrame, data =%p, width=%d height=%d\n", __func__, img->getData(), width, height);
-    Message msg;
-    msg.id = MESSAGE_ID_FRAME;
-    msg.data.frame.img = img;
-    msg.data.frame.height = height;
-    msg.data.frame.width = width;
-    if (mMessageQueue.send(&msg) == NO_ERROR) {
-        if (img != 0)
-            img->incrementReader();
+
+    Mutex::Autolock lock(mFrameLock);
+    nsecs_t now = systemTime();
+    if (mLastFrameTime != 0) {
+        nsecs_t duration = now - mLastFrameTime;
+        mFrameDuration = mFrameDuration ? (mFrameDuration * 7 + duration) / 8 : duration;
+    }
+    mLastFrameTime = now;
+    mReportFrames++;
+    reportRate(now);
+
+    if (++mSkipped < mInterval)
+        return 0;
+    mSkipped = 0;
+
+    img->incrementReader();
+    if (mPendingFrame.img != 0) {
+        // the detector has not got to the waiting frame, it is stale now
+        mPendingFrame.img->decrementReader();
+        mPendingFrame.img = img;
+        mPendingFrame.width = width;
+        mPendingFrame.height = height;
+        mReportDropped++;
         return 0;
     }
-    else
+
+    Message msg;
+    msg.id = MESSAGE_ID_FRAME;
+    if (mMessageQueue.send(&msg) != NO_ERROR) {
+        img->decrementReader();
         return -1;
+    }
+    mPendingFrame.img = img;
+    mPendingFrame.width = width;
+    mPendingFrame.height = height;
+    return 0;
+}
+
+void OlaFaceDetect::releasePendingFrame()
+{
+    Mutex::Autolock lock(mFrameLock);
+    if (mPendingFrame.img != 0) {
+        mPendingFrame.img->decrementReader();
+        mPendingFrame.img = 0;
+    }
 }
 
 bool OlaFaceDetect::threadLoop()
@@ -123,7 +184,7 @@ bool OlaFaceDetect::threadLoop()
         switch (msg.id)
         {
         case MESSAGE_ID_FRAME:
-            status = handleFrame(msg.data.frame);
+            status = handleFrame();
             break;
         case MESSAGE_ID_EXIT:
             status = handleExit();
@@ -138,22 +199,37 @@ bool OlaFaceDetect::threadLoop()
     }
     return false;
 }
-status_t OlaFaceDetect::handleFrame(MessageFrame frame)
+status_t OlaFaceDetect::handleFrame()
 {
     ALOGV("%s: Face detection executing\n", __func__);
-    if (mFaceDetectionStruct == 0) return INVALID_OPERATION;
+    MessageFrame frame;
+    {
+        Mutex::Autolock lock(mFrameLock);
+        frame = mPendingFrame;
+        mPendingFrame.img = 0;
+    }
+    if (frame.img == 0)
+        return NO_ERROR; // released by stop
+    if (mFaceDetectionStruct == 0) {
+        frame.img->decrementReader();
+        return INVALID_OPERATION;
+    }
 
+    nsecs_t startTime = systemTime();
     ALOGV("%s: data =%p, width=%d height=%d\n", __func__, frame.img->getData(), frame.width, frame.height);
+    DetectionInput input;
+    prepareInput(frame, &input);
     int faces = CameraFaceDetection_FindFace(mFaceDetectionStruct,
-            (unsigned char*) (frame.img->getData()),
-            frame.width, frame.height);
-    ALOGV("%s CameraFaceDetection_FindFace faces %d, %d\n", __func__, faces, mFaceDetectionStruct->numDetected);
+            input.data, input.width, input.height);
+    ALOGV("%s CameraFaceDetection_FindFace faces %d, %d on %dx%d\n", __func__, faces,
+            mFaceDetectionStruct->numDetected, input.width, input.height);
 
     camera_frame_metadata_t face_metadata;
     face_metadata.number_of_faces = mFaceDetectionStruct->numDetected;
     face_metadata.faces = (camera_face_t *)mFaceDetectionStruct->detectedFaces;
     for (int i=0; i<face_metadata.number_of_faces;i++) {
         camera_face_t& face =face_metadata.faces[i];
+        mapToFrame(frame, input, &face);
         ALOGV("face id=%d, score =%d", face.id, face.score);
         ALOGV("rect = (%d, %d, %d, %d)",face.rect[0],face.rect[1],
                 face.rect[2],face.rect[3]);
@@ -161,13 +237,137 @@ status_t OlaFaceDetect::handleFrame(MessageFrame frame)
         ALOGV("left eye: (%d, %d)", face.left_eye[0], face.left_eye[1]);
         ALOGV("right eye: (%d, %d)", face.right_eye[0], face.right_eye[1]);
     }
+    updateInterval(systemTime() - startTime);
     //blocking call
     ALOGV("%s calling listener", __func__);
     mpListener->facesDetected(face_metadata, frame.img);
-    frame.img>decrementReader();
+    frame.img->decrementReader();
     ALOGV("%s returned from listener", __func__);
 
     return NO_ERROR;
 }
 
+/**
+ * Detects on every frame while a detection takes less than
+ * CPU_BUDGET_PERCENT of the time between frames, and on every second or
+ * third frame when it takes longer.
+ */
+void OlaFaceDetect::updateInterval(nsecs_t detectTime)
+{
+    Mutex::Autolock lock(mFrameLock);
+    mDetectDuration = mDetectDuration ? (mDetectDuration * 7 + detectTime) / 8 : detectTime;
+    mReportDetected++;
+    if (mFrameDuration == 0)
+        return;
+
+    nsecs_t budget = mFrameDuration * CPU_BUDGET_PERCENT / 100;
+    int interval = (int) ((mDetectDuration + budget - 1) / budget);
+    if (interval < 1)
+        interval = 1;
+    else if (interval > MAX_INTERVAL)
+        interval = MAX_INTERVAL;
+    if (interval != mInterval)
+        ALOGV("%s: detection takes %lld us, every %d frame(s)", __func__,
+                mDetectDuration / 1000, interval);
+    mInterval = interval;
+}
+
+// called with mFrameLock held
+void OlaFaceDetect::reportRate(nsecs_t now)
+{
+    if (mReportTime == 0) {
+        mReportTime = now;
+        return;
+    }
+    nsecs_t period = now - mReportTime;
+    if (period < REPORT_PERIOD)
+        return;
+
+    float seconds = period / 1000000000.0f;
+    ALOGD("face detection %.1f fps of %.1f fps preview, every %d frame(s), %lld us each, %d stale",
+            mReportDetected / seconds, mReportFrames / seconds, mInterval,
+            mDetectDuration / 1000, mReportDropped);
+    mReportTime = now;
+    mReportFrames = 0;
+    mReportDetected = 0;
+    mReportDropped = 0;
+}
+
+/**
+ * Gives the detector the luma of the frame halved until it is just wider
+ * than MIN_DETECTION_WIDTH. The first level is made straight from the frame
+ * and each further level from the one before. Frames that are small already
+ * or in a format without luma rows are searched as they are.
+ */
+void OlaFaceDetect::prepareInput(const MessageFrame &frame, DetectionInput *input)
+{
+    input->data = (unsigned char*) frame.img->getData();
+    input->width = frame.width;
+    input->height = frame.height;
+    input->scale = 1;
+
+    int levels = 0;
+    while (levels < PYRAMID_LEVELS && (frame.width >> (levels + 1)) >= MIN_DETECTION_WIDTH)
+        levels++;
+
+    int format = frame.img->getFormat();
+    const unsigned char *src = input->data;
+    int srcStride = format == V4L2_PIX_FMT_YUYV ? frame.width * 2 : frame.width;
+    for (int level = 0; level < levels; level++) {
+        int width = frame.width >> (level + 1);
+        int height = frame.height >> (level + 1);
+        if (mPyramidSize[level] < width * height) {
+            delete[] mPyramid[level];
+            mPyramid[level] = new unsigned char[width * height];
+            mPyramidSize[level] = width * height;
+        }
+        for (int y = 0; y < height; y++) {
+            if (!halveLumaRow(format, src + y * 2 * srcStride, srcStride,
+                    mPyramid[level] + y * width, width)) {
+                ALOGW("%s: no luma in format %d, searching the whole frame", __func__, format);
+                return;
+            }
+        }
+        src = mPyramid[level];
+        srcStride = width;
+        format = V4L2_PIX_FMT_GREY;
+    }
+
+    if (levels > 0) {
+        input->data = mPyramid[levels - 1];
+        input->width = frame.width >> levels;
+        input->height = frame.height >> levels;
+        input->scale = 1 << levels;
+    }
+}
+
+// Face coordinates run from -1000 to 1000 across the detection input, which
+// may leave out the last few columns and rows of the frame
+static int mapCoordinate(int value, int covered, int size)
+{
+    if (value < -1000)
+        return value; // not detected
+    return (value + 1000) * covered / size - 1000;
+}
+
+void OlaFaceDetect::mapToFrame(const MessageFrame &frame, const DetectionInput &input,
+        camera_face_t *face)
+{
+    int coveredWidth = input.width * input.scale;
+    int coveredHeight = input.height * input.scale;
+    if (coveredWidth == frame.width && coveredHeight == frame.height)
+        return;
+
+    for (int i = 0; i < 4; i += 2) {
+        face->rect[i] = mapCoordinate(face->rect[i], coveredWidth, frame.width);
+        face->rect[i + 1] = mapCoordinate(face->rect[i + 1], coveredHeight, frame.height);
+    }
+    face->left_eye[0] = mapCoordinate(face->left_eye[0], coveredWidth, frame.width);
+    face->left_eye[1] = mapCoordinate(face->left_eye[1], coveredHeight, frame.height);
+    face->right_eye[0] = mapCoordinate(face->right_eye[0], coveredWidth, frame.width);
+    face->right_eye[1] = mapCoordinate(face->right_eye[1], coveredHeight, frame.height);
+    face->mouth[0] = mapCoordinate(face->mouth[0], coveredWidth, frame.width);
+    face->mouth[1] = mapCoordinate(face->mouth[1], coveredHeight, frame.height);
+}
+
 }
@@ -19,6 +19,7 @@
 #define OLAFACEDETECT_H_
 
 #include <utils/threads.h>
+#include <utils/Timers.h>
 #include "CameraFaceDetection.h"
 #include "IFaceDetector.h"
 #include "MessageQueue.h"
@@ -50,46 +51,73 @@ private:
     enum MessageId {
 
         MESSAGE_ID_EXIT = 0,            // call requestExitAndWait
-        MESSAGE_ID_FRAME,
+        MESSAGE_ID_FRAME,               // a frame waits in mPendingFrame
 
         // max number of messages
         MESSAGE_ID_MAX
     };
 
-    //
-    // message data structures
-    //
+    // messages carry no data, the frame is passed in mPendingFrame
+    struct Message {
+        MessageId id;
+    };
+
     struct MessageFrame {
         CameraBuffer* img;
         int width;
         int height;
     };
 
-    // union of all message data
-    union MessageData {
-        // MESSAGE_ID_FRAME
-        MessageFrame frame;
-
+    // what the detector searches, the luma of a frame at a fraction of its size
+    struct DetectionInput {
+        unsigned char *data;
+        int width;
+        int height;
+        int scale;  // frame pixels per input pixel, 1 if the frame is searched as is
     };
 
-    // message id and message data
-    struct Message {
-        MessageId id;
-        MessageData data;
-    };
     friend class FaceDetectorFactory;
 // inherited from Thread
 private:
     virtual bool threadLoop();
-    status_t handleFrame(MessageFrame frame);
+    status_t handleFrame();
     status_t handleExit();
+    void releasePendingFrame();
+    void updateInterval(nsecs_t detectTime);
+    void reportRate(nsecs_t now);
+    void prepareInput(const MessageFrame &frame, DetectionInput *input);
+    static void mapToFrame(const MessageFrame &frame, const DetectionInput &input,
+            camera_face_t *face);
 
 // private data
 private:
 
+    // faces are still found at a quarter of the VGA preview
+    static const int MIN_DETECTION_WIDTH = 320;
+    static const int PYRAMID_LEVELS = 3;
+    // share of the frame time the detector may use before frames are skipped
+    static const int CPU_BUDGET_PERCENT = 50;
+    static const int MAX_INTERVAL = 3;
+    static const nsecs_t REPORT_PERIOD = 5000000000LL; // 5 s
+
     MessageQueue<Message, MessageId> mMessageQueue;
     CameraFaceDetection * mFaceDetectionStruct;
     volatile bool mbRunning;
+    unsigned char *mPyramid[PYRAMID_LEVELS]; // half, quarter and eighth size luma
+    int mPyramidSize[PYRAMID_LEVELS];
+
+    // only the newest frame waits for the detector, older ones are released
+    Mutex mFrameLock;
+    MessageFrame mPendingFrame;     // img is 0 if no frame waits
+    int mInterval;                  // every mInterval'th frame is detected
+    int mSkipped;                   // frames skipped since the last taken one
+    nsecs_t mLastFrameTime;
+    nsecs_t mFrameDuration;         // averages, 0 until measured
+    nsecs_t mDetectDuration;
+    nsecs_t mReportTime;            // start of the current rate report
+    int mReportFrames;
+    int mReportDetected;
+    int mReportDropped;
 };
 
 }
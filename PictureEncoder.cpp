@@ -0,0 +1,695 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_PictureEncoder"
+
+#include "PictureEncoder.h"
+#include "LogHelper.h"
+#include "Callbacks.h"
+#include "ImageScaler.h"
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cutils/ashmem.h>
+
+namespace android {
+
+static const int MAX_EXIF_SIZE = 0xFFFF;
+static const unsigned char JPEG_MARKER_SOI[2] = {0xFF, 0xD8}; // JPEG StartOfImage marker
+static const int JPEG_HEADER_SIZE = 4096; // room for the tables of small images
+static const int MAX_EXIF_RESERVE = 2 + 2 + 0xFFFF; // SOI and the largest APP1 segment
+static const int EXIF_BASE_SIZE = 2048; // EXIF header without the thumbnail
+static const int MAX_EXIF_PADDING = 4096; // more unused reserve is cheaper to move than to store
+
+PictureEncoder::PictureEncoder() :
+    mCallbacks(Callbacks::getInstance())
+    ,mOutFd(-1)
+    ,mOutData(NULL)
+    ,mOutCapacity(0)
+    ,mMaxOutDataSize(0)
+    ,mExifReserve(MAX_EXIF_RESERVE)
+    ,mThumbInData(NULL)
+    ,mThumbOutData(NULL)
+    ,mMaxThumbOutDataSize(0)
+    ,mThumbRotated(NULL)
+    ,mScreennailInData(NULL)
+    ,mScreennailOutData(NULL)
+    ,mMaxScreennailOutDataSize(0)
+    ,mScreennailRotated(NULL)
+    ,mScaleScratch(NULL)
+    ,mExifBuf(NULL)
+    ,mRotation(0)
+    ,mSink(NULL)
+    ,mStreaming(false)
+    ,mStreamFailed(false)
+    ,mStreamExifSize(0)
+    ,mMainReady(0)
+    ,mMainStreamed(0)
+{
+    LOG1("@%s", __FUNCTION__);
+    mExifBuf = new unsigned char[MAX_EXIF_SIZE];
+    memset(&mPreparedPicture, 0, sizeof(mPreparedPicture));
+    memset(&mPreparedThumbnail, 0, sizeof(mPreparedThumbnail));
+    memset(&mPreparedScreennail, 0, sizeof(mPreparedScreennail));
+}
+
+PictureEncoder::~PictureEncoder()
+{
+    LOG1("@%s", __FUNCTION__);
+    releaseOutput();
+    if (mThumbInData != NULL) {
+        delete[] mThumbInData;
+    }
+    if (mThumbOutData != NULL) {
+        delete[] mThumbOutData;
+    }
+    if (mScreennailInData != NULL) {
+        delete[] mScreennailInData;
+    }
+    if (mScreennailOutData != NULL) {
+        delete[] mScreennailOutData;
+    }
+    delete[] mThumbRotated;
+    delete[] mScreennailRotated;
+    delete[] mScaleScratch;
+    if (mExifBuf != NULL) {
+        delete[] mExifBuf;
+    }
+}
+
+/*
+ * encodeExif: encodes the thumbnail and builds the EXIF header in mExifBuf
+ * Input:  mainBuf  - buffer containing the main picture image
+ *         thumbBuf - buffer containing the thumbnail image (optional, can be NULL)
+ * Output: returns the size of SOI and EXIF APP1 in mExifBuf, 0 on error
+ * Without thumbBuf the thumbnail is scaled down from mainBuf, or from the
+ * screennail if there is one, so that mainBuf is read once for both. Runs on
+ * the worker pool concurrently with the main picture encoding, so it must
+ * only read mainBuf and touch the thumbnail, screennail and EXIF state.
+ */
+int PictureEncoder::encodeExif(CameraBuffer *mainBuf, CameraBuffer *thumbBuf)
+{
+    LOG1("@%s", __FUNCTION__);
+    JpegCompressor::InputBuffer inBuf;
+    JpegCompressor::OutputBuffer outBuf;
+    exif_attribute_t exif = mConfig.exif;
+    unsigned char *thumbData = NULL;
+    unsigned char *thumbInData = NULL;
+    int thumbSize = 0;
+    bool screennail = startScreennail(mainBuf);
+
+    if (exif.enableThumb && thumbBuf != NULL) {
+        thumbInData = (unsigned char*)thumbBuf->getData();
+    } else if (exif.enableThumb && mThumbInData != NULL &&
+               mConfig.thumbnail.format == mConfig.picture.format) {
+        const Image &src = screennail ? mConfig.screennail : mConfig.picture;
+        const void *srcData = screennail ? mScreennailInData : mainBuf->getData();
+        nsecs_t startTime = systemTime();
+        if (scaleDown(src.format, src.width, src.height, srcData,
+                mConfig.thumbnail.width, mConfig.thumbnail.height, mThumbInData,
+                mScaleScratch) == NO_ERROR) {
+            LOG1("Thumbnail scaled down from %s in %ums", screennail ? "screennail" : "picture",
+                    (unsigned)((systemTime() - startTime) / 1000000));
+            thumbInData = mThumbInData;
+        } else {
+            ALOGE("Could not scale down thumbnail!");
+        }
+    }
+
+    // Convert and encode the thumbnail, if present and EXIF maker is initialized
+    if (exif.enableThumb && thumbInData != NULL && mThumbOutData != NULL) {
+
+        LOG1("Encoding thumbnail");
+
+        // setup the JpegCompressor input and output buffers
+        inBuf.clear();
+        inBuf.buf = thumbInData;
+        inBuf.width = mConfig.thumbnail.width;
+        inBuf.height = mConfig.thumbnail.height;
+        inBuf.format = mConfig.thumbnail.format;
+        inBuf.size = frameSize(mConfig.thumbnail.format,
+                mConfig.thumbnail.width,
+                mConfig.thumbnail.height);
+        outBuf.clear();
+        outBuf.rotation = rotateInput(mThumbCompressor, &inBuf, &mThumbRotated);
+        outBuf.buf = mThumbOutData;
+        outBuf.width = inBuf.width;
+        outBuf.height = inBuf.height;
+        outBuf.quality = mConfig.thumbnail.quality;
+        outBuf.size = mMaxThumbOutDataSize;
+        nsecs_t startTime = systemTime();
+        int size = mThumbCompressor.encode(inBuf, outBuf);
+        LOG1("Thumbnail JPEG size: %d (time to encode: %ums)", size, (unsigned)((systemTime() - startTime) / 1000000));
+        if (size > 0) {
+            thumbData = outBuf.buf;
+            thumbSize = size;
+        } else {
+            // This is not critical, we can continue with main picture image
+            ALOGE("Could not encode thumbnail stream!");
+            exif.enableThumb = false;
+        }
+    } else {
+        LOG1("Skipping thumbnail");
+        exif.enableThumb = false;
+    }
+
+    if (mRotation != 0) {
+        // the picture and the thumbnail are upright now
+        exif.orientation = EXIF_ORIENTATION_UP;
+        if (mRotation != 180) {
+            unsigned int width = exif.width;
+            exif.width = exif.height;
+            exif.height = width;
+            width = exif.widthThumb;
+            exif.widthThumb = exif.heightThumb;
+            exif.heightThumb = width;
+        }
+    }
+
+    // Copy the SOI marker
+    unsigned char* currentPtr = mExifBuf;
+    memcpy(currentPtr, JPEG_MARKER_SOI, sizeof(JPEG_MARKER_SOI));
+    currentPtr += sizeof(JPEG_MARKER_SOI);
+
+    // usually only the fields of this shot need to be written
+    int templateSize = mExifTemplate.make(&encoder, &exif, thumbData, thumbSize,
+            currentPtr, MAX_EXIF_SIZE - sizeof(JPEG_MARKER_SOI));
+    if (templateSize > 0)
+        return sizeof(JPEG_MARKER_SOI) + templateSize;
+
+    unsigned int exifSize = 0;
+    if (thumbData != NULL)
+        encoder.setThumbData(thumbData, thumbSize);
+    if (encoder.makeExif(currentPtr, &exif, &exifSize, false) != JPG_SUCCESS) {
+        ALOGE("Error making EXIF");
+        return 0;
+    }
+
+    return sizeof(JPEG_MARKER_SOI) + exifSize;
+}
+
+/*
+ * startScreennail: scales the screennail down from mainBuf and starts
+ * encoding it on the worker pool
+ * Output: returns whether the screennail is being encoded
+ */
+bool PictureEncoder::startScreennail(CameraBuffer *mainBuf)
+{
+    if (mScreennailInData == NULL || mConfig.screennail.format != mConfig.picture.format)
+        return false;
+
+    LOG1("@%s", __FUNCTION__);
+    nsecs_t startTime = systemTime();
+    if (scaleDown(mConfig.picture.format,
+            mConfig.picture.width, mConfig.picture.height, mainBuf->getData(),
+            mConfig.screennail.width, mConfig.screennail.height, mScreennailInData,
+            mScaleScratch) != NO_ERROR) {
+        ALOGE("Could not scale down screennail!");
+        return false;
+    }
+    LOG1("Screennail scaled down from picture in %ums",
+            (unsigned)((systemTime() - startTime) / 1000000));
+
+    mScreennailJob.mStarted = true;
+    WorkerPool::getInstance()->submit(&mScreennailJob, 1);
+    return true;
+}
+
+/*
+ * encodeScreennail: encodes the scaled down screennail into mScreennailOutData
+ * Output: returns the size of the screennail JPEG, 0 on error
+ */
+int PictureEncoder::encodeScreennail()
+{
+    LOG1("@%s", __FUNCTION__);
+    JpegCompressor::InputBuffer inBuf;
+    JpegCompressor::OutputBuffer outBuf;
+
+    inBuf.clear();
+    inBuf.buf = mScreennailInData;
+    inBuf.width = mConfig.screennail.width;
+    inBuf.height = mConfig.screennail.height;
+    inBuf.format = mConfig.screennail.format;
+    inBuf.size = frameSize(mConfig.screennail.format,
+            mConfig.screennail.width,
+            mConfig.screennail.height);
+    outBuf.clear();
+    outBuf.rotation = rotateInput(mScreennailCompressor, &inBuf, &mScreennailRotated);
+    outBuf.buf = mScreennailOutData;
+    outBuf.width = inBuf.width;
+    outBuf.height = inBuf.height;
+    outBuf.quality = mConfig.screennail.quality;
+    outBuf.size = mMaxScreennailOutDataSize;
+    int size = mScreennailCompressor.encode(inBuf, outBuf);
+    return size > 0 ? size : 0;
+}
+
+/*
+ * rotateInput: the thumbnail and screennail are turned with the main picture.
+ * The backend picked for their size may not turn them, and turning its
+ * JPEG afterwards drops the edge blocks of sizes that are not whole MCUs, so
+ * then the pixels are turned before encoding.
+ * Input:  jpeg    - compressor of the image
+ *         in      - the image, pointed at the turned pixels if they are turned
+ *         rotated - buffer for the turned pixels, allocated on first use
+ * Output: returns the rotation left to the compressor
+ */
+int PictureEncoder::rotateInput(JpegCompressor &jpeg, JpegCompressor::InputBuffer *in,
+        unsigned char **rotated)
+{
+    if (mRotation == 0 || jpeg.canRotate(*in, mRotation))
+        return mRotation;
+
+    if (*rotated == NULL)
+        *rotated = new unsigned char[in->size];
+    nsecs_t startTime = systemTime();
+    if (rotateImage(in->format, in->width, in->height, in->buf, *rotated, mRotation) != NO_ERROR)
+        return mRotation;
+    LOG1("%dx%d turned by %d degrees before encoding in %ums", in->width, in->height,
+            mRotation, (unsigned)((systemTime() - startTime) / 1000000));
+
+    in->buf = *rotated;
+    if (mRotation != 180) {
+        int width = in->width;
+        in->width = in->height;
+        in->height = width;
+    }
+    return 0;
+}
+
+void PictureEncoder::ScreennailJob::processStripe(int index, int count)
+{
+    nsecs_t startTime = systemTime();
+    mSize = mEncoder->encodeScreennail();
+    mTime = systemTime() - startTime;
+}
+
+void PictureEncoder::ExifJob::processStripe(int index, int count)
+{
+    nsecs_t startTime = systemTime();
+    mExifSize = mEncoder->encodeExif(mMainBuf, mThumbBuf);
+    mTime = systemTime() - startTime;
+    mEncoder->streamExif(mExifSize);
+}
+
+/*
+ * The streamed file is SOI and EXIF from mExifBuf followed by the main
+ * picture stream without its SOI, as EXIF is not padded there. EXIF comes
+ * first, so the main picture is held back until it is ready.
+ */
+void PictureEncoder::startStream()
+{
+    Mutex::Autolock lock(mStreamLock);
+    mStreaming = mSink != NULL && mSink->begin() == NO_ERROR;
+    mStreamFailed = false;
+    mStreamExifSize = 0;
+    mMainReady = 0;
+    mMainStreamed = sizeof(JPEG_MARKER_SOI);
+}
+
+void PictureEncoder::streamExif(int exifSize)
+{
+    Mutex::Autolock lock(mStreamLock);
+    if (!mStreaming)
+        return;
+    if (exifSize <= 0) {
+        mStreamFailed = true;
+        return;
+    }
+    mSink->write(mExifBuf, exifSize);
+    mStreamExifSize = exifSize;
+    streamMain();
+}
+
+void PictureEncoder::streamMain()
+{
+    if (!mStreaming || mStreamFailed || mStreamExifSize == 0 || mMainReady <= mMainStreamed)
+        return;
+    mSink->write(mEncoderOutBuf.buf + mMainStreamed, mMainReady - mMainStreamed);
+    mMainStreamed = mMainReady;
+}
+
+void PictureEncoder::outputReady(int size)
+{
+    Mutex::Autolock lock(mStreamLock);
+    mMainReady = size;
+    streamMain();
+}
+
+void PictureEncoder::outputDiscarded()
+{
+    Mutex::Autolock lock(mStreamLock);
+    // what the sink has cannot be taken back
+    if (mMainStreamed > (int) sizeof(JPEG_MARKER_SOI))
+        mStreamFailed = true;
+    mMainReady = 0;
+}
+
+// Returns when the sink has the whole file, it reads from the output buffer
+void PictureEncoder::endStream(bool ok)
+{
+    Mutex::Autolock lock(mStreamLock);
+    if (!mStreaming)
+        return;
+    if (mSink->end(ok && !mStreamFailed && mStreamExifSize > 0) != NO_ERROR)
+        ALOGE("Could not store the streamed JPEG file");
+    mStreaming = false;
+}
+
+/*
+ * placeExif: puts SOI and EXIF in front of the main picture stream
+ * Input:  jpeg      - final buffer, the main picture starts at mExifReserve - 2
+ *         exifSize  - size of SOI and EXIF APP1 in mExifBuf
+ *         mainSize  - size of the main picture stream, including its SOI
+ * Output: returns the size of the final JPEG file
+ * The APP1 segment is padded up to the reserved space so the main picture
+ * stays where it was encoded. Only if EXIF does not fit, or would leave more
+ * than MAX_EXIF_PADDING unused, the main picture is moved, which costs one
+ * copy.
+ */
+int PictureEncoder::placeExif(unsigned char *jpeg, int exifSize, int mainSize)
+{
+    LOG1("@%s", __FUNCTION__);
+    unsigned char *mainData = jpeg + mExifReserve;
+    int mainDataSize = mainSize - sizeof(JPEG_MARKER_SOI);
+    bool isApp1 = mExifBuf[2] == 0xFF && mExifBuf[3] == 0xE1;
+
+    int padding = mExifReserve - exifSize;
+    if (padding >= 0 && padding <= MAX_EXIF_PADDING && isApp1) {
+        int length = ((mExifBuf[4] << 8) | mExifBuf[5]) + padding;
+        memcpy(jpeg, mExifBuf, exifSize);
+        memset(jpeg + exifSize, 0, padding);
+        jpeg[4] = length >> 8;
+        jpeg[5] = length & 0xFF;
+        LOG1("EXIF padded with %d bytes", padding);
+        return mExifReserve + mainDataSize;
+    }
+
+    if (padding < 0)
+        ALOGW("EXIF (%d bytes) does not fit the reserved %d bytes, moving the picture",
+                exifSize, mExifReserve);
+    else
+        LOG1("EXIF (%d bytes) leaves %d bytes unused, moving the picture", exifSize, padding);
+    memmove(jpeg + exifSize, mainData, mainDataSize);
+    memcpy(jpeg, mExifBuf, exifSize);
+    return exifSize + mainDataSize;
+}
+
+/*
+ * encode: encodes the given buffer and creates the final JPEG file
+ * Input:  mainBuf  - buffer containing the main picture image
+ *         thumbBuf - buffer containing the thumbnail image (optional, can be NULL)
+ * Output: destBuf  - buffer containing the final JPEG image including EXIF header
+ *         screennailBuf - buffer containing the screennail JPEG (optional, can be NULL)
+ *         Note that, if present, thumbBuf will be included in EXIF header
+ * The main picture is encoded straight into an ashmem region behind the space
+ * reserved for EXIF, and destBuf maps the same region, so the picture stream
+ * is never copied.
+ */
+status_t PictureEncoder::encode(CameraBuffer *mainBuf, CameraBuffer *thumbBuf, CameraBuffer *destBuf,
+        CameraBuffer *screennailBuf)
+{
+    LOG1("@%s", __FUNCTION__);
+    status_t status = NO_ERROR;
+
+    if (mConfig.picture.width == 0 ||
+        mConfig.picture.height == 0 ||
+        mConfig.picture.format == 0) {
+        ALOGE("Picture information not set yet!");
+        return UNKNOWN_ERROR;
+    }
+
+    nsecs_t startTime = systemTime();
+    nsecs_t endTime;
+
+    // no-op unless prepare() was not called for these sizes
+    allocateResources(mConfig.picture, mConfig.thumbnail, mConfig.screennail);
+
+    // normally made when the previous picture was done
+    if (mOutData == NULL && (status = createOutput()) != NO_ERROR)
+        return status;
+    unsigned char *jpeg = mOutData;
+
+    // Convert and encode the main picture image
+    // setup the JpegCompressor input and output buffers
+    mEncoderInBuf.clear();
+    mEncoderInBuf.buf = (unsigned char *) mainBuf->getData();
+
+    mEncoderInBuf.width = mConfig.picture.width;
+    mEncoderInBuf.height = mConfig.picture.height;
+    mEncoderInBuf.format = mConfig.picture.format;
+    mEncoderInBuf.size = frameSize(mConfig.picture.format,
+            mConfig.picture.width,
+            mConfig.picture.height);
+
+    // Turning the picture costs about nothing while encoding it, but only
+    // if none of it is lost, otherwise EXIF says how to show it
+    mRotation = 0;
+    if (mConfig.rotation > 0) {
+        if (compressor.canRotate(mEncoderInBuf, mConfig.rotation))
+            mRotation = mConfig.rotation;
+        else
+            ALOGW("Cannot rotate %dx%d picture by %d degrees, using EXIF orientation",
+                    mConfig.picture.width, mConfig.picture.height, mConfig.rotation);
+    }
+
+    // The thumbnail, screennail and EXIF header are made while the main
+    // picture encodes
+    WorkerPool *pool = WorkerPool::getInstance();
+    mScreennailJob.mEncoder = this;
+    mScreennailJob.mStarted = false;
+    mScreennailJob.mSize = 0;
+    mExifJob.mEncoder = this;
+    mExifJob.mMainBuf = mainBuf;
+    mExifJob.mThumbBuf = thumbBuf;
+    mExifJob.mExifSize = 0;
+    startStream();
+    pool->submit(&mExifJob, 1);
+
+    mEncoderOutBuf.clear();
+    // the SOI marker of the main picture gets overwritten by EXIF
+    mEncoderOutBuf.buf = jpeg + mExifReserve - sizeof(JPEG_MARKER_SOI);
+    mEncoderOutBuf.width = mConfig.picture.width;
+    mEncoderOutBuf.height = mConfig.picture.height;
+    mEncoderOutBuf.quality = mConfig.picture.quality;
+    mEncoderOutBuf.rotation = mRotation;
+    mEncoderOutBuf.size = mMaxOutDataSize;
+    if (mStreaming)
+        mEncoderOutBuf.listener = this;
+    endTime = systemTime();
+    int mainSize = compressor.encode(mEncoderInBuf, mEncoderOutBuf);
+    LOG1("Picture JPEG size: %d (time to encode: %ums)", mainSize, (unsigned)((systemTime() - endTime) / 1000000));
+
+    // join the EXIF job before touching its output
+    endTime = systemTime();
+    pool->wait(&mExifJob);
+    int exifSize = mExifJob.mExifSize;
+    LOG1("EXIF size: %d (time to encode: %ums, waited %ums)", exifSize,
+            (unsigned)(mExifJob.mTime / 1000000),
+            (unsigned)((systemTime() - endTime) / 1000000));
+
+    // started by the EXIF job, which is done now
+    int screennailSize = 0;
+    if (mScreennailJob.mStarted) {
+        pool->wait(&mScreennailJob);
+        screennailSize = mScreennailJob.mSize;
+        LOG1("Screennail JPEG size: %d (time to encode: %ums)", screennailSize,
+                (unsigned)(mScreennailJob.mTime / 1000000));
+    }
+
+    if (mainSize <= 0) {
+        ALOGE("Could not encode picture stream!");
+        status = UNKNOWN_ERROR;
+    } else if (exifSize <= 0) {
+        ALOGE("Could not make EXIF header!");
+        status = UNKNOWN_ERROR;
+    }
+
+    // before the main picture can move to make room for EXIF
+    endStream(status == NO_ERROR);
+
+    if (status == NO_ERROR) {
+        int totalSize = placeExif(jpeg, exifSize, mainSize);
+        mCallbacks->allocateMemory(destBuf, mOutFd, totalSize);
+        if (destBuf->getData() == NULL) {
+            ALOGE("No memory for final JPEG file!");
+            status = NO_MEMORY;
+        } else {
+            LOG1("Total JPEG size: %d (time to encode: %ums)", totalSize, (unsigned)((systemTime() - startTime) / 1000000));
+        }
+
+        // not critical, the picture is delivered without it
+        if (screennailSize > 0 && screennailBuf != NULL) {
+            mCallbacks->allocateMemory(screennailBuf, screennailSize);
+            if (screennailBuf->getData() != NULL)
+                memcpy(screennailBuf->getData(), mScreennailOutData, screennailSize);
+            else
+                ALOGE("No memory for screennail JPEG!");
+        }
+
+        // next time leave a little more than this EXIF took, the thumbnail
+        // size changes with the scene
+        mExifReserve = exifSize + exifSize / 16;
+        if (mExifReserve > MAX_EXIF_RESERVE)
+            mExifReserve = MAX_EXIF_RESERVE;
+    }
+
+    // destBuf holds its own mapping of the region, the next picture gets a new one
+    releaseOutput();
+    createOutput();
+    return status;
+}
+
+/*
+ * allocateResources: makes sure the buffers and encoder scratch fit pictures,
+ * thumbnails and screennails of the given sizes and formats. Nothing is done
+ * if they already do, so this is cheap to call for every picture.
+ */
+void PictureEncoder::allocateResources(const Image &picture, const Image &thumbnail,
+        const Image &screennail)
+{
+    if (picture.width != mPreparedPicture.width ||
+        picture.height != mPreparedPicture.height ||
+        picture.format != mPreparedPicture.format) {
+        LOG1("@%s: picture %dx%d", __FUNCTION__, picture.width, picture.height);
+        mMaxOutDataSize = picture.width * picture.height * 2;
+        releaseOutput();
+        // thumbnails and screennails are scaled down from the picture, or
+        // from the narrower screennail of the same format
+        delete[] mScaleScratch;
+        mScaleScratch = new unsigned short[scaleDownScratchSize(picture.format, picture.width)];
+
+        JpegCompressor::InputBuffer inBuf;
+        inBuf.clear();
+        inBuf.width = picture.width;
+        inBuf.height = picture.height;
+        inBuf.format = picture.format;
+        compressor.prepare(inBuf);
+        mPreparedPicture = picture;
+    }
+
+    if (thumbnail.width != mPreparedThumbnail.width ||
+        thumbnail.height != mPreparedThumbnail.height ||
+        thumbnail.format != mPreparedThumbnail.format) {
+        LOG1("@%s: thumbnail %dx%d", __FUNCTION__, thumbnail.width, thumbnail.height);
+        if (mThumbInData != NULL) {
+            delete[] mThumbInData;
+            mThumbInData = NULL;
+        }
+        if (mThumbOutData != NULL) {
+            delete[] mThumbOutData;
+            mThumbOutData = NULL;
+        }
+        delete[] mThumbRotated;
+        mThumbRotated = NULL;
+        mMaxThumbOutDataSize = 0;
+        if (thumbnail.width > 0 && thumbnail.height > 0) {
+            mThumbInData = new unsigned char[frameSize(thumbnail.format,
+                    thumbnail.width, thumbnail.height)];
+            mMaxThumbOutDataSize = thumbnail.width * thumbnail.height * 2 + JPEG_HEADER_SIZE;
+            mThumbOutData = new unsigned char[mMaxThumbOutDataSize];
+
+            JpegCompressor::InputBuffer inBuf;
+            inBuf.clear();
+            inBuf.width = thumbnail.width;
+            inBuf.height = thumbnail.height;
+            inBuf.format = thumbnail.format;
+            mThumbCompressor.prepare(inBuf);
+        }
+
+        // first guess of the EXIF size, corrected after every picture. A
+        // thumbnail JPEG takes about a quarter byte per pixel, twice that at
+        // high quality.
+        int thumbnailSize = thumbnail.width * thumbnail.height / 4;
+        if (thumbnail.quality > 80)
+            thumbnailSize *= 2;
+        mExifReserve = EXIF_BASE_SIZE + thumbnailSize;
+        if (mExifReserve > MAX_EXIF_RESERVE)
+            mExifReserve = MAX_EXIF_RESERVE;
+        mPreparedThumbnail = thumbnail;
+    }
+
+    if (screennail.width != mPreparedScreennail.width ||
+        screennail.height != mPreparedScreennail.height ||
+        screennail.format != mPreparedScreennail.format) {
+        LOG1("@%s: screennail %dx%d", __FUNCTION__, screennail.width, screennail.height);
+        if (mScreennailInData != NULL) {
+            delete[] mScreennailInData;
+            mScreennailInData = NULL;
+        }
+        if (mScreennailOutData != NULL) {
+            delete[] mScreennailOutData;
+            mScreennailOutData = NULL;
+        }
+        delete[] mScreennailRotated;
+        mScreennailRotated = NULL;
+        mMaxScreennailOutDataSize = 0;
+        if (screennail.width > 0 && screennail.height > 0) {
+            mScreennailInData = new unsigned char[frameSize(screennail.format,
+                    screennail.width, screennail.height)];
+            mMaxScreennailOutDataSize = screennail.width * screennail.height * 2 + JPEG_HEADER_SIZE;
+            mScreennailOutData = new unsigned char[mMaxScreennailOutDataSize];
+
+            JpegCompressor::InputBuffer inBuf;
+            inBuf.clear();
+            inBuf.width = screennail.width;
+            inBuf.height = screennail.height;
+            inBuf.format = screennail.format;
+            mScreennailCompressor.prepare(inBuf);
+        }
+        mPreparedScreennail = screennail;
+    }
+
+    if (mMaxOutDataSize > 0 && mOutData == NULL)
+        createOutput();
+}
+
+/*
+ * createOutput: creates the ashmem region the next final JPEG file is
+ * encoded into. Its pages are only backed once written to.
+ */
+status_t PictureEncoder::createOutput()
+{
+    LOG1("@%s", __FUNCTION__);
+    // The reserve may be too small for EXIF, so there is room to move the picture
+    int capacity = MAX_EXIF_RESERVE + mMaxOutDataSize;
+    int fd = ashmem_create_region("Camera_JPEG", capacity);
+    if (fd < 0) {
+        ALOGE("Could not create ashmem region for final JPEG file!");
+        return NO_MEMORY;
+    }
+    void *data = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        ALOGE("Could not map ashmem region for final JPEG file!");
+        close(fd);
+        return NO_MEMORY;
+    }
+    mOutFd = fd;
+    mOutData = (unsigned char*) data;
+    mOutCapacity = capacity;
+    return NO_ERROR;
+}
+
+void PictureEncoder::releaseOutput()
+{
+    if (mOutData != NULL) {
+        munmap(mOutData, mOutCapacity);
+        close(mOutFd);
+        mOutData = NULL;
+        mOutFd = -1;
+        mOutCapacity = 0;
+    }
+}
+
+} // namespace android
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_PICTURE_ENCODER_H
+#define ANDROID_LIBCAMERA_PICTURE_ENCODER_H
+
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+#include "CameraCommon.h"
+#include "JpegCompressor.h"
+#include "IJpegSink.h"
+#include "JpegEncoder.h" // for EXIF
+#include "ExifTemplate.h"
+#include "WorkerPool.h"
+
+namespace android {
+
+class Callbacks;
+
+/**
+ * Makes the final JPEG file of one picture: the main picture, the thumbnail
+ * and the EXIF header, and optionally a screennail JPEG for display. Holds
+ * everything a picture needs, so that several pictures can be encoded at the
+ * same time by separate PictureEncoders. The file can also be streamed to a
+ * sink while the main picture encodes.
+ */
+class PictureEncoder : public JpegCompressor::OutputListener {
+
+// constructor destructor
+public:
+    PictureEncoder();
+    ~PictureEncoder();
+
+// public types
+public:
+
+    struct Image {
+        int format;
+        int quality;
+        int width;
+        int height;
+    };
+
+    struct Config {
+        Image picture;
+        Image thumbnail;
+        Image screennail; // none if 0x0
+        exif_attribute_t exif;
+        int rotation; // turn the picture by this instead of only setting EXIF orientation
+    };
+
+// public methods
+public:
+
+    void setConfig(const Config &config) { mConfig = config; }
+    // the final JPEG file also goes to sink while it is encoded, optional
+    void setSink(IJpegSink *sink) { mSink = sink; }
+    status_t encode(CameraBuffer *mainBuf, CameraBuffer *thumbBuf, CameraBuffer *destBuf,
+            CameraBuffer *screennailBuf = NULL);
+
+    // capture resources, kept from shot to shot while the sizes stay the same
+    void allocateResources(const Image &picture, const Image &thumbnail,
+            const Image &screennail);
+
+// JpegCompressor::OutputListener overrides
+public:
+    virtual void outputReady(int size);
+    virtual void outputDiscarded();
+
+// private types
+private:
+
+    // builds the EXIF header, including the thumbnail, next to the main encode
+    class ExifJob : public WorkerPool::Job {
+    public:
+        ExifJob() : mEncoder(NULL), mMainBuf(NULL), mThumbBuf(NULL), mExifSize(0), mTime(0) {}
+        virtual void processStripe(int index, int count);
+
+        PictureEncoder *mEncoder;
+        CameraBuffer *mMainBuf;
+        CameraBuffer *mThumbBuf;
+        int mExifSize;
+        nsecs_t mTime;
+    };
+
+    // encodes the screennail next to the main picture and the thumbnail
+    class ScreennailJob : public WorkerPool::Job {
+    public:
+        ScreennailJob() : mEncoder(NULL), mStarted(false), mSize(0), mTime(0) {}
+        virtual void processStripe(int index, int count);
+
+        PictureEncoder *mEncoder;
+        bool mStarted;
+        int mSize;
+        nsecs_t mTime;
+    };
+
+// private methods
+private:
+
+    int encodeExif(CameraBuffer *mainBuf, CameraBuffer *thumbBuf);
+    bool startScreennail(CameraBuffer *mainBuf);
+    int encodeScreennail();
+    int placeExif(unsigned char *jpeg, int exifSize, int mainSize);
+    int rotateInput(JpegCompressor &jpeg, JpegCompressor::InputBuffer *in,
+            unsigned char **rotated);
+    void startStream();
+    void streamExif(int exifSize);
+    void streamMain();  // called with mStreamLock held
+    void endStream(bool ok);
+    status_t createOutput();
+    void releaseOutput();
+
+// private data
+private:
+
+    JpegEncoder encoder; // for EXIF
+    Callbacks *mCallbacks;
+    JpegCompressor compressor;
+    JpegCompressor mThumbCompressor;
+    JpegCompressor::InputBuffer mEncoderInBuf;
+    JpegCompressor::OutputBuffer mEncoderOutBuf;
+    int mOutFd; // ashmem region for the next final JPEG file
+    unsigned char* mOutData;
+    int mOutCapacity;
+    int mMaxOutDataSize;
+    int mExifReserve; // bytes left in front of the main picture for SOI and EXIF
+    unsigned char* mThumbInData; // thumbnail scaled down from the main picture
+    unsigned char* mThumbOutData; //temporary buffer to hold the thumbnail
+    int mMaxThumbOutDataSize;
+    unsigned char* mThumbRotated; // thumbnail turned for an encoder that cannot turn it
+    JpegCompressor mScreennailCompressor;
+    unsigned char* mScreennailInData; // screennail scaled down from the main picture
+    unsigned char* mScreennailOutData;
+    int mMaxScreennailOutDataSize;
+    unsigned char* mScreennailRotated;
+    unsigned short* mScaleScratch; // column sums for scaleDown, sized for the picture
+    unsigned char* mExifBuf;//temporary buffer to hold exif data
+    ExifTemplate mExifTemplate;
+    ExifJob mExifJob;
+    ScreennailJob mScreennailJob;
+    Config mConfig;
+    int mRotation; // the picture being encoded is turned by, 0 if EXIF orientation is used
+    Image mPreparedPicture; // sizes the capture resources were allocated for
+    Image mPreparedThumbnail;
+    Image mPreparedScreennail;
+    IJpegSink *mSink;
+    Mutex mStreamLock;      // the stream is fed from the encoder threads
+    bool mStreaming;        // the sink takes the picture being encoded
+    bool mStreamFailed;     // the sink gets an incomplete file
+    int mStreamExifSize;    // streamed from mExifBuf, 0 until EXIF is ready
+    int mMainReady;         // bytes of the main picture stream that are final
+    int mMainStreamed;      // of those, passed to the sink
+
+}; // class PictureEncoder
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_PICTURE_ENCODER_H
@@ -18,149 +18,211 @@
 #include "PictureThread.h"
 #include "LogHelper.h"
 #include "Callbacks.h"
-#include "ColorConverter.h"
+#include "IntelParameters.h"
+#include "WorkerPool.h"
+#include "FileJpegSink.h"
 #include <utils/Timers.h>
+#include <unistd.h>
+#include <cutils/properties.h>
 
 namespace android {
 
-static const int MAX_EXIF_SIZE = 0xFFFF;
-static const unsigned char JPEG_MARKER_SOI[2] = {0xFF, 0xD8}; // JPEG StartOfImage marker
-static const unsigned char JPEG_MARKER_EOI[2] = {0xFF, 0xD9}; // JPEG EndOfImage marker
+// upper bound for the number of pictures encoded at the same time
+static const int MAX_ENCODE_JOBS = 4;
+// pictures in flight may hold up to this fraction of the memory
+static const int ENCODE_MEMORY_SHARE = 8;
+// pictures delivered less than this apart belong to the same burst
+static const nsecs_t BURST_GAP = 1000000000LL;
+// directory the JPEG files are stored in as they are encoded, for measuring
+// how much of the storing hides behind the compression
+static const char *PROP_JPEG_SINK_DIR = "camera.jpeg.sink.dir";
 
 PictureThread::PictureThread() :
     Thread(true) // callbacks may call into java
     ,mMessageQueue("PictureThread", MESSAGE_ID_MAX)
     ,mThreadRunning(false)
     ,mCallbacks(Callbacks::getInstance())
-    ,mOutData(NULL)
-    ,mExifBuf(NULL)
+    ,mMaxJobs(1)
+    ,mSequence(0)
+    ,mBurstPictures(0)
+    ,mBurstStart(0)
+    ,mLastDelivery(0)
 {
     LOG1("@%s", __FUNCTION__);
+    memset(&mConfig, 0, sizeof(mConfig));
+    memset(&mPreparedPicture, 0, sizeof(mPreparedPicture));
+    memset(&mPreparedThumbnail, 0, sizeof(mPreparedThumbnail));
 }
 
 PictureThread::~PictureThread()
 {
     LOG1("@%s", __FUNCTION__);
-    if (mOutData != NULL) {
-        delete[] mOutData;
+    for (size_t i = 0; i < mJobs.size(); i++)
+        delete mJobs[i];
+}
+
+void PictureThread::EncodeJob::processStripe(int index, int count)
+{
+    nsecs_t startTime = systemTime();
+    if (mFrameBuf != NULL) {
+        memcpy(mMainBuf->getData(), mFrameBuf->getData(), mFrameBuf->getCameraMem()->size);
+        mFrameBuf->decrementReader();
+        LOG1("Picture %d copied in %ums", mSequence,
+                (unsigned)((systemTime() - startTime) / 1000000));
     }
-    if (mExifBuf != NULL) {
-        delete[] mExifBuf;
+    mStatus = mEncoder.encode(mMainBuf, mThumbBuf, &mJpegBuf, &mScreennailBuf);
+    mTime = systemTime() - startTime;
+
+    Message msg;
+    msg.id = MESSAGE_ID_ENCODE_DONE;
+    msg.data.encodeDone.sequence = mSequence;
+    mThread->mMessageQueue.send(&msg);
+}
+
+/*
+ * getMaxJobs: number of pictures encoded at the same time, one per core as
+ * long as their frames and JPEG files fit in a share of the memory
+ */
+int PictureThread::getMaxJobs(const Image &picture)
+{
+    int maxJobs = WorkerPool::getInstance()->getNumWorkers();
+    if (maxJobs > MAX_ENCODE_JOBS)
+        maxJobs = MAX_ENCODE_JOBS;
+
+    long long jobMemory = (long long) frameSize(picture.format, picture.width, picture.height)
+            + picture.width * picture.height * 2;
+    long long memory = (long long) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE)
+            / ENCODE_MEMORY_SHARE;
+    if (jobMemory > 0 && memory > 0 && memory / jobMemory < maxJobs)
+        maxJobs = memory / jobMemory;
+    if (maxJobs < 1)
+        maxJobs = 1;
+    return maxJobs;
+}
+
+// a job streams its pictures to a file sink if the property names a directory
+PictureThread::EncodeJob* PictureThread::createJob()
+{
+    EncodeJob *job = new EncodeJob();
+    job->mThread = this;
+
+    char dir[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_JPEG_SINK_DIR, dir, NULL) > 0) {
+        job->mSink = new FileJpegSink(dir);
+        job->mEncoder.setSink(job->mSink);
     }
+    mJobs.push(job);
+    return job;
 }
 
 /*
- * encodeToJpeg: encodes the given buffer and creates the final JPEG file
- * Input:  mainBuf  - buffer containing the main picture image
- *         thumbBuf - buffer containing the thumbnail image (optional, can be NULL)
- * Output: destBuf  - buffer containing the final JPEG image including EXIF header
- *         Note that, if present, thumbBuf will be included in EXIF header
+ * getFreeJob: returns a job for the next picture. If all of them are busy
+ * this waits for the oldest picture and delivers it.
  */
-status_t PictureThread::encodeToJpeg(CameraBuffer *mainBuf, CameraBuffer *thumbBuf, CameraBuffer *destBuf)
+PictureThread::EncodeJob* PictureThread::getFreeJob()
 {
-    LOG1("@%s", __FUNCTION__);
-    status_t status = NO_ERROR;
+    EncodeJob *job;
+    if (mFreeJobs.isEmpty() && (int) mJobs.size() < mMaxJobs)
+        return createJob();
+
+    if (mFreeJobs.isEmpty()) {
+        LOG1("All %d encode jobs busy, waiting for the oldest picture", mJobs.size());
+        finishJob(mPendingJobs[0]);
+        deliverPictures();
+    }
+    job = mFreeJobs.top();
+    mFreeJobs.pop();
+    return job;
+}
 
-    nsecs_t startTime = systemTime();
-    nsecs_t endTime;
-
-    // Convert and encode the thumbnail, if present and EXIF maker is initialized
-
-    if (mConfig.exif.enableThumb) {
-
-        LOG1("Encoding thumbnail");
-
-        // setup the JpegCompressor input and output buffers
-        mEncoderInBuf.clear();
-        mEncoderInBuf.buf = (unsigned char*)thumbBuf->getData();
-        mEncoderInBuf.width = mConfig.thumbnail.width;
-        mEncoderInBuf.height = mConfig.thumbnail.height;
-        mEncoderInBuf.format = mConfig.thumbnail.format;
-        mEncoderInBuf.size = frameSize(mConfig.thumbnail.format,
-                mConfig.thumbnail.width,
-                mConfig.thumbnail.height);
-        mEncoderOutBuf.clear();
-        mEncoderOutBuf.buf = mOutData;
-        mEncoderOutBuf.width = mConfig.thumbnail.width;
-        mEncoderOutBuf.height = mConfig.thumbnail.height;
-        mEncoderOutBuf.quality = mConfig.thumbnail.quality;
-        mEncoderOutBuf.size = mMaxOutDataSize;
-        endTime = systemTime();
-        int size = compressor.encode(mEncoderInBuf, mEncoderOutBuf);
-        LOG1("Thumbnail JPEG size: %d (time to encode: %ums)", size, (unsigned)((systemTime() - endTime) / 1000000));
-        if (size > 0) {
-            encoder.setThumbData(mEncoderOutBuf.buf, size);
+/*
+ * finishJob: waits until the picture of job is encoded and gives its frames
+ * back, even if earlier pictures are still encoding
+ */
+void PictureThread::finishJob(EncodeJob *job)
+{
+    // joins the worker, so its results can be read
+    WorkerPool::getInstance()->wait(job);
+    LOG1("Picture %d encoded in %ums", job->mSequence, (unsigned)(job->mTime / 1000000));
+    job->mFinished = true;
+    job->mFrameBuf = NULL; // given back by the worker
+    job->mMainBuf->decrementReader();
+    if (job->mThumbBuf != 0)
+        job->mThumbBuf->decrementReader();
+}
+
+// delivers the encoded pictures at the front, so callbacks keep capture order
+void PictureThread::deliverPictures()
+{
+    while (!mPendingJobs.isEmpty() && mPendingJobs[0]->mFinished) {
+        EncodeJob *job = mPendingJobs[0];
+        mPendingJobs.removeAt(0);
+
+        if (job->mStatus == NO_ERROR) {
+            if (job->mScreennailBuf.getData() != NULL)
+                mCallbacks->screennailDone(&job->mScreennailBuf);
+            mCallbacks->compressedFrameDone(&job->mJpegBuf);
+            updateBurst();
         } else {
-            // This is not critical, we can continue with main picture image
-            ALOGE("Could not encode thumbnail stream!");
+            ALOGE("Error generating JPEG image!");
         }
-    } else {
-        LOG1("Skipping thumbnail");
-    }
-    int totalSize = 0;
-    unsigned int exifSize = 0;
-    // Copy the SOI marker
-    unsigned char* currentPtr = mExifBuf;
-    memcpy(currentPtr, JPEG_MARKER_SOI, sizeof(JPEG_MARKER_SOI));
-    totalSize += sizeof(JPEG_MARKER_SOI);
-    currentPtr += sizeof(JPEG_MARKER_SOI);
-    if (encoder.makeExif(currentPtr, &mConfig.exif, &exifSize, false) != JPG_SUCCESS)
-        ALOGE("Error making EXIF");
-    currentPtr += exifSize;
-    totalSize += exifSize;
-    // Copy the EOI marker
-    memcpy(currentPtr, (void*)JPEG_MARKER_EOI, sizeof(JPEG_MARKER_EOI));
-    totalSize += sizeof(JPEG_MARKER_EOI);
-    currentPtr += sizeof(JPEG_MARKER_EOI);
-    exifSize = totalSize;
-
-    // Convert and encode the main picture image
-    // setup the JpegCompressor input and output buffers
-    mEncoderInBuf.clear();
-    mEncoderInBuf.buf = (unsigned char *) mainBuf->getData();
-
-    mEncoderInBuf.width = mConfig.picture.width;
-    mEncoderInBuf.height = mConfig.picture.height;
-    mEncoderInBuf.format = mConfig.picture.format;
-    mEncoderInBuf.size = frameSize(mConfig.picture.format,
-            mConfig.picture.width,
-            mConfig.picture.height);
-    mEncoderOutBuf.clear();
-    mEncoderOutBuf.buf = (unsigned char*)mOutData;
-    mEncoderOutBuf.width = mConfig.picture.width;
-    mEncoderOutBuf.height = mConfig.picture.height;
-    mEncoderOutBuf.quality = mConfig.picture.quality;
-    mEncoderOutBuf.size = mMaxOutDataSize;
-    endTime = systemTime();
-    int mainSize = compressor.encode(mEncoderInBuf, mEncoderOutBuf);
-    LOG1("Picture JPEG size: %d (time to encode: %ums)", mainSize, (unsigned)((systemTime() - endTime) / 1000000));
-    if (mainSize > 0) {
-        // We will skip SOI marker from final file
-        totalSize += (mainSize - sizeof(JPEG_MARKER_SOI));
-    } else {
-        ALOGE("Could not encode picture stream!");
-        status = UNKNOWN_ERROR;
+        LOG1("Releasing jpegBuf @%p", job->mJpegBuf.getData());
+        job->mJpegBuf.releaseMemory();
+        job->mScreennailBuf.releaseMemory();
+        releaseJob(job);
     }
+}
 
-    if (status == NO_ERROR) {
-        mCallbacks->allocateMemory(destBuf, totalSize);
-        if (destBuf->getData() == NULL) {
-            ALOGE("No memory for final JPEG file!");
-            status = NO_MEMORY;
+// keeps job for the next picture, unless there are more jobs than needed
+void PictureThread::releaseJob(EncodeJob *job)
+{
+    if ((int) mJobs.size() <= mMaxJobs) {
+        mFreeJobs.push(job);
+        return;
+    }
+    for (size_t i = 0; i < mJobs.size(); i++) {
+        if (mJobs[i] == job) {
+            mJobs.removeAt(i);
+            break;
         }
     }
-    if (status == NO_ERROR) {
-        // Copy EXIF (it will also have the SOI and EOI markers
-        memcpy(destBuf->getData(), mExifBuf, exifSize);
-        // Copy the final JPEG stream into the final destination buffer, but exclude the SOI marker
-        char *copyTo = (char*)destBuf->getData() + exifSize;
-        char *copyFrom = (char*)mOutData + sizeof(JPEG_MARKER_SOI);
-        memcpy(copyTo, copyFrom, mainSize - sizeof(JPEG_MARKER_SOI));
+    delete job;
+}
+
+// waits for all pictures in flight and delivers them
+void PictureThread::finishAllJobs()
+{
+    for (size_t i = 0; i < mPendingJobs.size(); i++) {
+        if (!mPendingJobs[i]->mFinished)
+            finishJob(mPendingJobs[i]);
     }
-    LOG1("Total JPEG size: %d (time to encode: %ums)", totalSize, (unsigned)((systemTime() - startTime) / 1000000));
-    return status;
+    deliverPictures();
 }
 
+// counts a delivered picture in the current burst or starts a new burst
+void PictureThread::updateBurst()
+{
+    nsecs_t now = systemTime();
+    if (mBurstPictures > 0 && now - mLastDelivery > BURST_GAP)
+        endBurst();
+    if (mBurstPictures == 0)
+        mBurstStart = now;
+    mBurstPictures++;
+    mLastDelivery = now;
+
+    if (mBurstPictures > 1)
+        LOG1("Burst: %d pictures at %.2f shots/s", mBurstPictures,
+                (mBurstPictures - 1) * 1000000000.0 / (now - mBurstStart));
+}
+
+void PictureThread::endBurst()
+{
+    if (mBurstPictures > 1) {
+        ALOGD("Burst of %d pictures at %.2f shots/s with %d encode jobs", mBurstPictures,
+                (mBurstPictures - 1) * 1000000000.0 / (mLastDelivery - mBurstStart), mMaxJobs);
+    }
+    mBurstPictures = 0;
+}
 
 status_t PictureThread::encode(CameraBuffer *snaphotBuf, CameraBuffer *postviewBuf)
 {
@@ -169,6 +231,7 @@ status_t PictureThread::encode(CameraBuffer *snaphotBuf, CameraBuffer *postviewB
     msg.id = MESSAGE_ID_ENCODE;
     msg.data.encode.snaphotBuf = snaphotBuf;
     msg.data.encode.postviewBuf = postviewBuf;
+    msg.data.encode.frameBuf = 0;
     status_t ret = INVALID_OPERATION;
     if ((ret = mMessageQueue.send(&msg)) == NO_ERROR) {
         if (snaphotBuf != 0)
@@ -179,6 +242,26 @@ status_t PictureThread::encode(CameraBuffer *snaphotBuf, CameraBuffer *postviewB
     return ret;
 }
 
+/*
+ * encodeCopy: for video snapshots, the caller's thread only sends the
+ * buffers, the full frame copy is made by the encode job
+ */
+status_t PictureThread::encodeCopy(CameraBuffer *frame, CameraBuffer *copyBuf)
+{
+    LOG1("@%s", __FUNCTION__);
+    Message msg;
+    msg.id = MESSAGE_ID_ENCODE;
+    msg.data.encode.snaphotBuf = copyBuf;
+    msg.data.encode.postviewBuf = 0;
+    msg.data.encode.frameBuf = frame;
+    status_t ret = INVALID_OPERATION;
+    if ((ret = mMessageQueue.send(&msg)) == NO_ERROR) {
+        copyBuf->incrementReader();
+        frame->incrementReader();
+    }
+    return ret;
+}
+
 void PictureThread::getDefaultParameters(CameraParameters *params)
 {
     LOG1("@%s", __FUNCTION__);
@@ -192,20 +275,40 @@ void PictureThread::getDefaultParameters(CameraParameters *params)
             CameraParameters::PIXEL_FORMAT_JPEG);
     params->set(CameraParameters::KEY_JPEG_QUALITY, "80");
     params->set(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY, "50");
+    params->set(IntelCameraParameters::KEY_PREVIEW_AFTER_CAPTURE, CameraParameters::FALSE);
+    params->set(IntelCameraParameters::KEY_PREVIEW_AFTER_CAPTURE_SUPPORTED, CameraParameters::TRUE);
+    params->set(IntelCameraParameters::KEY_LOSSLESS_ROTATION, CameraParameters::FALSE);
+    params->set(IntelCameraParameters::KEY_LOSSLESS_ROTATION_SUPPORTED, CameraParameters::TRUE);
+    params->set(IntelCameraParameters::KEY_SCREENNAIL_SIZE, "0x0");
+    params->set(IntelCameraParameters::KEY_SUPPORTED_SCREENNAIL_SIZES, "0x0,640x480,960x720,1280x960");
 }
 
-void PictureThread::setConfig(Config *config)
+/*
+ * setConfig: applies to the pictures sent after it, pictures still being
+ * encoded keep their configuration (asynchronous)
+ */
+status_t PictureThread::setConfig(Config *config)
 {
-    mConfig = *config;
-    if(mOutData != NULL)
-        delete mOutData;
-    mMaxOutDataSize = (mConfig.picture.width * mConfig.picture.height * 2);
-    mOutData = new unsigned char[mMaxOutDataSize];
-
+    LOG1("@%s", __FUNCTION__);
+    Message msg;
+    msg.id = MESSAGE_ID_CONFIG;
+    msg.data.config = *config;
+    return mMessageQueue.send(&msg);
+}
 
-    if (mExifBuf != NULL)
-        delete mExifBuf;
-    mExifBuf = new unsigned char[MAX_EXIF_SIZE];
+/*
+ * prepare: allocates the capture resources for config ahead of the first
+ * picture, so that no shot has to allocate them (asynchronous)
+ */
+status_t PictureThread::prepare(const Config *config)
+{
+    LOG1("@%s", __FUNCTION__);
+    Message msg;
+    msg.id = MESSAGE_ID_PREPARE;
+    msg.data.prepare.picture = config->picture;
+    msg.data.prepare.thumbnail = config->thumbnail;
+    msg.data.prepare.screennail = config->screennail;
+    return mMessageQueue.send(&msg);
 }
 
 status_t PictureThread::flushBuffers()
@@ -217,10 +320,24 @@ status_t PictureThread::flushBuffers()
     return mMessageQueue.send(&msg, MESSAGE_ID_FLUSH);
 }
 
+/*
+ * waitForCopies: the frames being copied belong to the driver, so it must
+ * not stop before they are copied (synchronous)
+ */
+status_t PictureThread::waitForCopies()
+{
+    LOG1("@%s", __FUNCTION__);
+    Message msg;
+    msg.id = MESSAGE_ID_WAIT_FOR_COPIES;
+    return mMessageQueue.send(&msg, MESSAGE_ID_WAIT_FOR_COPIES);
+}
+
 status_t PictureThread::handleMessageExit()
 {
     LOG1("@%s", __FUNCTION__);
     status_t status = NO_ERROR;
+    finishAllJobs();
+    endBurst();
     mThreadRunning = false;
     return status;
 }
@@ -228,46 +345,92 @@ status_t PictureThread::handleMessageExit()
 status_t PictureThread::handleMessageEncode(MessageEncode *msg)
 {
     LOG1("@%s: snapshot ID = %d", __FUNCTION__, msg->snaphotBuf->getID());
-    status_t status = NO_ERROR;
-    int exifSize = 0;
-    int totalSize = 0;
-    CameraBuffer jpegBuf;
-
-    if (mConfig.picture.width == 0 ||
-        mConfig.picture.height == 0 ||
-        mConfig.picture.format == 0) {
-        ALOGE("Picture information not set yet!");
-        return UNKNOWN_ERROR;
-    }
-
-    // Encode the image
-    CameraBuffer *postviewBuf = msg->postviewBuf == NULL ? NULL : msg->postviewBuf;
-    if ((status = encodeToJpeg(msg->snaphotBuf, postviewBuf, &jpegBuf)) == NO_ERROR) {
-        mCallbacks->compressedFrameDone(&jpegBuf);
-    } else {
-        ALOGE("Error generating JPEG image!");
-    }
+    EncodeJob *job = getFreeJob();
+    job->mEncoder.setConfig(mConfig);
+    job->mMainBuf = msg->snaphotBuf;
+    job->mThumbBuf = msg->postviewBuf;
+    job->mFrameBuf = msg->frameBuf;
+    job->mSequence = ++mSequence;
+    job->mFinished = false;
+    mPendingJobs.push(job);
+
+    // without worker threads the picture is encoded right here
+    WorkerPool *pool = WorkerPool::getInstance();
+    if (pool->getNumWorkers() > 1)
+        return pool->submit(job, 1);
+    return pool->run(job, 1);
+}
 
+status_t PictureThread::handleMessageEncodeDone(MessageEncodeDone *msg)
+{
+    LOG2("@%s", __FUNCTION__);
 
-    LOG1("Releasing jpegBuf @%p", jpegBuf.getData());
-    jpegBuf.releaseMemory();
+    // the picture may have been finished while waiting for a free job, and
+    // its job deleted since
+    for (size_t i = 0; i < mPendingJobs.size(); i++) {
+        EncodeJob *job = mPendingJobs[i];
+        if (job->mSequence == msg->sequence) {
+            if (!job->mFinished) {
+                finishJob(job);
+                deliverPictures();
+            }
+            break;
+        }
+    }
+    return NO_ERROR;
+}
 
-    // When the encoding is done, send back the buffers to camera
-    msg->snaphotBuf->decrementReader();
-    if (msg->postviewBuf != 0)
-        msg->postviewBuf->decrementReader();
+status_t PictureThread::handleMessageConfig(Config *config)
+{
+    LOG1("@%s", __FUNCTION__);
+    mConfig = *config;
+    mMaxJobs = getMaxJobs(mConfig.picture);
+    return NO_ERROR;
+}
 
-    return status;
+status_t PictureThread::handleMessagePrepare(MessagePrepare *msg)
+{
+    LOG1("@%s", __FUNCTION__);
+    nsecs_t startTime = systemTime();
+    mMaxJobs = getMaxJobs(msg->picture);
+    while ((int) mJobs.size() < mMaxJobs)
+        mFreeJobs.push(createJob());
+
+    // busy jobs get ready when they encode their next picture
+    for (size_t i = 0; i < mFreeJobs.size(); i++)
+        mFreeJobs[i]->mEncoder.allocateResources(msg->picture, msg->thumbnail,
+                msg->screennail);
+    LOG1("Capture resources of %d encode jobs ready in %ums", mMaxJobs,
+            (unsigned)((systemTime() - startTime) / 1000000));
+    return NO_ERROR;
 }
 
 status_t PictureThread::handleMessageFlush()
 {
     LOG1("@%s", __FUNCTION__);
     status_t status = NO_ERROR;
+    // the frames of the pictures in flight go away with the driver
+    finishAllJobs();
+    endBurst();
     mMessageQueue.reply(MESSAGE_ID_FLUSH, status);
     return status;
 }
 
+status_t PictureThread::handleMessageWaitForCopies()
+{
+    LOG1("@%s", __FUNCTION__);
+    status_t status = NO_ERROR;
+    // a job gives its frame back early, but only the whole picture can be
+    // waited for
+    for (size_t i = 0; i < mPendingJobs.size(); i++) {
+        if (!mPendingJobs[i]->mFinished && mPendingJobs[i]->mFrameBuf != NULL)
+            finishJob(mPendingJobs[i]);
+    }
+    deliverPictures();
+    mMessageQueue.reply(MESSAGE_ID_WAIT_FOR_COPIES, status);
+    return status;
+}
+
 status_t PictureThread::waitForAndExecuteMessage()
 {
     LOG2("@%s", __FUNCTION__);
@@ -285,10 +448,26 @@ status_t PictureThread::waitForAndExecuteMessage()
             status = handleMessageEncode(&msg.data.encode);
             break;
 
+        case MESSAGE_ID_ENCODE_DONE:
+            status = handleMessageEncodeDone(&msg.data.encodeDone);
+            break;
+
+        case MESSAGE_ID_CONFIG:
+            status = handleMessageConfig(&msg.data.config);
+            break;
+
+        case MESSAGE_ID_PREPARE:
+            status = handleMessagePrepare(&msg.data.prepare);
+            break;
+
         case MESSAGE_ID_FLUSH:
             status = handleMessageFlush();
             break;
 
+        case MESSAGE_ID_WAIT_FOR_COPIES:
+            status = handleMessageWaitForCopies();
+            break;
+
         default:
             status = BAD_VALUE;
             break;
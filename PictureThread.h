@@ -18,12 +18,13 @@
 #define ANDROID_LIBCAMERA_PICTURE_THREAD_H
 
 #include <utils/threads.h>
+#include <utils/Vector.h>
 #include <camera.h>
 #include <camera/CameraParameters.h>
 #include "MessageQueue.h"
 #include "CameraCommon.h"
-#include "JpegCompressor.h"
-#include "JpegEncoder.h" // for EXIF
+#include "PictureEncoder.h"
+#include "WorkerPool.h"
 
 namespace android {
 
@@ -43,36 +44,59 @@ public:
 // public types
 public:
 
-    struct Image {
-        int format;
-        int quality;
-        int width;
-        int height;
-    };
-
-    struct Config {
-        Image picture;
-        Image thumbnail;
-        exif_attribute_t exif;
-    };
+    typedef PictureEncoder::Image Image;
+    typedef PictureEncoder::Config Config;
 
 // public methods
 public:
 
     status_t encode(CameraBuffer *snaphotBuf, CameraBuffer *postviewBuf = NULL);
+    // copies frame into copyBuf on a worker and encodes the copy, frame is
+    // given back as soon as it is copied
+    status_t encodeCopy(CameraBuffer *frame, CameraBuffer *copyBuf);
+    // waits until the frames given to encodeCopy are copied
+    status_t waitForCopies();
     void getDefaultParameters(CameraParameters *params);
-    void setConfig(Config *config);
+    status_t setConfig(Config *config);
+    status_t prepare(const Config *config);
     status_t flushBuffers();
 
 // private types
 private:
 
+    // encodes one picture on the worker pool, so pictures of a burst are
+    // encoded in parallel
+    class EncodeJob : public WorkerPool::Job {
+    public:
+        EncodeJob() : mThread(NULL), mSink(NULL), mMainBuf(NULL), mThumbBuf(NULL),
+            mFrameBuf(NULL), mStatus(NO_ERROR), mSequence(0), mFinished(true), mTime(0) {}
+        virtual ~EncodeJob() { delete mSink; }
+        virtual void processStripe(int index, int count);
+
+        PictureThread *mThread;
+        IJpegSink *mSink;   // stores the JPEG file while it is encoded, optional
+        PictureEncoder mEncoder;
+        CameraBuffer *mMainBuf;
+        CameraBuffer *mThumbBuf;
+        CameraBuffer *mFrameBuf;    // copied into mMainBuf before encoding, optional
+        CameraBuffer mJpegBuf;
+        CameraBuffer mScreennailBuf;
+        status_t mStatus;
+        int mSequence;      // of the picture, unique among all jobs
+        bool mFinished;     // frames given back, picture waits for delivery
+        nsecs_t mTime;
+    };
+
     // thread message id's
     enum MessageId {
 
         MESSAGE_ID_EXIT = 0,            // call requestExitAndWait
         MESSAGE_ID_ENCODE,
+        MESSAGE_ID_ENCODE_DONE,
+        MESSAGE_ID_CONFIG,
+        MESSAGE_ID_PREPARE,
         MESSAGE_ID_FLUSH,
+        MESSAGE_ID_WAIT_FOR_COPIES,
 
         // max number of messages
         MESSAGE_ID_MAX
@@ -85,6 +109,18 @@ private:
     struct MessageEncode {
         CameraBuffer *snaphotBuf;
         CameraBuffer *postviewBuf;
+        CameraBuffer *frameBuf;     // copied into snaphotBuf first, 0 if none
+    };
+
+    // the job may be gone when this arrives, so it is looked up by sequence
+    struct MessageEncodeDone {
+        int sequence;
+    };
+
+    struct MessagePrepare {
+        Image picture;
+        Image thumbnail;
+        Image screennail;
     };
 
     // union of all message data
@@ -92,6 +128,15 @@ private:
 
         // MESSAGE_ID_ENCODE
         MessageEncode encode;
+
+        // MESSAGE_ID_ENCODE_DONE
+        MessageEncodeDone encodeDone;
+
+        // MESSAGE_ID_CONFIG
+        Config config;
+
+        // MESSAGE_ID_PREPARE
+        MessagePrepare prepare;
     };
 
     // message id and message data
@@ -106,12 +151,25 @@ private:
     // thread message execution functions
     status_t handleMessageExit();
     status_t handleMessageEncode(MessageEncode *encode);
+    status_t handleMessageEncodeDone(MessageEncodeDone *msg);
+    status_t handleMessageConfig(Config *config);
+    status_t handleMessagePrepare(MessagePrepare *msg);
     status_t handleMessageFlush();
+    status_t handleMessageWaitForCopies();
 
     // main message function
     status_t waitForAndExecuteMessage();
 
-    status_t encodeToJpeg(CameraBuffer *mainBuf, CameraBuffer *thumbBuf, CameraBuffer *destBuf);
+    // encode jobs, one for every picture that may be encoded at the same time
+    int getMaxJobs(const Image &picture);
+    EncodeJob* createJob();
+    EncodeJob* getFreeJob();
+    void releaseJob(EncodeJob *job);
+    void finishJob(EncodeJob *job);
+    void finishAllJobs();
+    void deliverPictures();
+    void updateBurst();
+    void endBurst();
 
 // inherited from Thread
 private:
@@ -120,17 +178,22 @@ private:
 // private data
 private:
 
-    JpegEncoder encoder; // for EXIF
     MessageQueue<Message, MessageId> mMessageQueue;
     bool mThreadRunning;
     Callbacks *mCallbacks;
-    JpegCompressor compressor;
-    JpegCompressor::InputBuffer mEncoderInBuf;
-    JpegCompressor::OutputBuffer mEncoderOutBuf;
-    unsigned char* mOutData; //temporary buffer to hold output data
-    int mMaxOutDataSize;
-    unsigned char* mExifBuf;//temporary buffer to hold exif data
     Config mConfig;
+    Image mPreparedPicture; // sizes the encode jobs were prepared for
+    Image mPreparedThumbnail;
+    Vector<EncodeJob *> mJobs;          // all encode jobs
+    Vector<EncodeJob *> mFreeJobs;      // jobs without a picture
+    Vector<EncodeJob *> mPendingJobs;   // pictures in capture order
+    int mMaxJobs;
+    int mSequence;      // of the last picture sent to a job
+
+    // burst statistics
+    int mBurstPictures;
+    nsecs_t mBurstStart;
+    nsecs_t mLastDelivery;
 
 // public data
 public:
@@ -20,6 +20,7 @@
 #include "LogHelper.h"
 #include "VideoThread.h"
 #include "PreviewThread.h"
+#include "IntelParameters.h"
 
 namespace android {
 
@@ -29,6 +30,8 @@ PipeThread::PipeThread() :
     ,mOutputFormat(0)
     ,mWidth(0)
     ,mHeight(0)
+    ,mDenoiseEnabled(false)
+    ,mStabilizeEnabled(false)
     ,mPreviewThread(NULL)
     ,mVideoThread(NULL)
     ,mMessageQueue("PipeThread", MESSAGE_ID_MAX)
@@ -58,6 +61,48 @@ void PipeThread::setConfig(int inputFormat, int outputFormat, int width, int hei
     mOutputFormat = outputFormat;
     mWidth = width;
     mHeight = height;
+
+    // the pipe is idle while being configured
+    if (mStabilizeEnabled &&
+            (mInputFormat != V4L2_PIX_FMT_YUYV || mStabilizer.setConfig(mWidth, mHeight) != NO_ERROR)) {
+        mStabilizer.release();
+        mStabilizeEnabled = false;
+    }
+}
+
+status_t PipeThread::setTemporalNoiseReduction(bool enable)
+{
+    LOG1("@%s: %s", __FUNCTION__, enable ? "on" : "off");
+    status_t status = NO_ERROR;
+    if (enable)
+        status = mDenoiser.setConfig(mOutputFormat, mWidth, mHeight);
+    else
+        mDenoiser.release();
+    mDenoiseEnabled = enable && status == NO_ERROR;
+    return status;
+}
+
+status_t PipeThread::setVideoStabilization(bool enable)
+{
+    LOG1("@%s: %s", __FUNCTION__, enable ? "on" : "off");
+    Message msg;
+    msg.id = MESSAGE_ID_SET_STABILIZATION;
+    msg.data.setStabilization.enable = enable;
+    return mMessageQueue.send(&msg);
+}
+
+void PipeThread::getDefaultParameters(CameraParameters *params)
+{
+    LOG1("@%s", __FUNCTION__);
+    if (!params) {
+        ALOGE("null params");
+        return;
+    }
+
+    params->set(IntelCameraParameters::KEY_TEMPORAL_NOISE_REDUCTION, CameraParameters::FALSE);
+    params->set(IntelCameraParameters::KEY_TEMPORAL_NOISE_REDUCTION_SUPPORTED, CameraParameters::TRUE);
+    params->set(CameraParameters::KEY_VIDEO_STABILIZATION, CameraParameters::FALSE);
+    params->set(CameraParameters::KEY_VIDEO_STABILIZATION_SUPPORTED, CameraParameters::TRUE);
 }
 
 status_t PipeThread::preview(CameraBuffer *input, CameraBuffer *output)
@@ -95,6 +140,24 @@ status_t PipeThread::previewVideo(CameraBuffer *input, CameraBuffer *output, nse
     return ret;
 }
 
+status_t PipeThread::video(CameraBuffer *input, CameraBuffer *output, nsecs_t timestamp)
+{
+    LOG2("@%s", __FUNCTION__);
+    Message msg;
+    status_t ret = INVALID_OPERATION;
+    msg.id = MESSAGE_ID_VIDEO;
+    msg.data.video.input = input;
+    msg.data.video.output = output;
+    msg.data.video.timestamp = timestamp;
+    if ((ret = mMessageQueue.send(&msg)) == NO_ERROR) {
+        if (input != 0)
+            input->incrementReader();
+        if (output != 0)
+            output->incrementReader();
+    }
+    return ret;
+}
+
 status_t PipeThread::flushBuffers()
 {
     LOG1("@%s", __FUNCTION__);
@@ -102,6 +165,7 @@ status_t PipeThread::flushBuffers()
     msg.id = MESSAGE_ID_FLUSH;
     mMessageQueue.remove(MESSAGE_ID_PREVIEW);
     mMessageQueue.remove(MESSAGE_ID_PREVIEW_VIDEO);
+    mMessageQueue.remove(MESSAGE_ID_VIDEO);
     return mMessageQueue.send(&msg, MESSAGE_ID_FLUSH);
 }
 
@@ -121,6 +185,13 @@ status_t PipeThread::handleMessagePreview(MessagePreview *msg)
     status = colorConvert(mInputFormat, mOutputFormat, mWidth, mHeight,
             msg->input->getData(), msg->output->getData());
 
+    // motion can only be tracked and frames only be blended across
+    // consecutive video frames
+    if (mStabilizeEnabled)
+        mStabilizer.reset();
+    if (mDenoiseEnabled)
+        mDenoiser.reset();
+
     if (status == NO_ERROR) {
         CameraBuffer *previewIn = msg->input;
         CameraBuffer *previewOut = msg->output;
@@ -140,8 +211,7 @@ status_t PipeThread::handleMessagePreviewVideo(MessagePreviewVideo *msg)
     LOG2("@%s", __FUNCTION__);
     status_t status = NO_ERROR;
 
-    status = colorConvert(mInputFormat, mOutputFormat, mWidth, mHeight,
-            msg->input->getData(), msg->output->getData());
+    status = convertVideoFrame(msg->input, msg->output);
 
     if (status == NO_ERROR) {
         CameraBuffer *previewIn = msg->input;
@@ -164,6 +234,71 @@ status_t PipeThread::handleMessagePreviewVideo(MessagePreviewVideo *msg)
     return status;
 }
 
+status_t PipeThread::handleMessageVideo(MessagePreviewVideo *msg)
+{
+    LOG2("@%s", __FUNCTION__);
+    status_t status = NO_ERROR;
+
+    status = convertVideoFrame(msg->input, msg->output);
+
+    if (status == NO_ERROR) {
+        status = mVideoThread->video(msg->output, msg->timestamp);
+        if (status != NO_ERROR) {
+            ALOGE("failed to send video buffer");
+        }
+    }
+    //we are done with the buffer
+    msg->input->decrementReader();
+    msg->output->decrementReader();
+    return status;
+}
+
+status_t PipeThread::handleMessageSetStabilization(MessageSetStabilization *msg)
+{
+    LOG1("@%s", __FUNCTION__);
+    status_t status = NO_ERROR;
+
+    if (msg->enable == mStabilizeEnabled)
+        return status;
+
+    if (msg->enable && mInputFormat != V4L2_PIX_FMT_YUYV) {
+        ALOGE("Video stabilization needs YUYV input");
+        return INVALID_OPERATION;
+    }
+
+    if (msg->enable)
+        status = mStabilizer.setConfig(mWidth, mHeight);
+    else
+        mStabilizer.release();
+    mStabilizeEnabled = msg->enable && status == NO_ERROR;
+    return status;
+}
+
+status_t PipeThread::convertVideoFrame(CameraBuffer *input, CameraBuffer *output)
+{
+    status_t status = NO_ERROR;
+
+    if (mStabilizeEnabled) {
+        int cropX = 0;
+        int cropY = 0;
+        if (mStabilizer.process(input->getData(), &cropX, &cropY) == NO_ERROR)
+            status = colorConvertCropped(mInputFormat, mOutputFormat, mWidth, mHeight,
+                    cropX, cropY, mStabilizer.getCropWidth(), mStabilizer.getCropHeight(),
+                    input->getData(), output->getData());
+        else
+            status = colorConvert(mInputFormat, mOutputFormat, mWidth, mHeight,
+                    input->getData(), output->getData());
+    } else {
+        status = colorConvert(mInputFormat, mOutputFormat, mWidth, mHeight,
+                input->getData(), output->getData());
+    }
+
+    if (status == NO_ERROR && mDenoiseEnabled)
+        status = mDenoiser.process(output->getData());
+
+    return status;
+}
+
 status_t PipeThread::handleMessageFlush()
 {
     LOG1("@%s", __FUNCTION__);
@@ -193,6 +328,14 @@ status_t PipeThread::waitForAndExecuteMessage()
             status = handleMessagePreviewVideo(&msg.data.previewVideo);
             break;
 
+        case MESSAGE_ID_VIDEO:
+            status = handleMessageVideo(&msg.data.video);
+            break;
+
+        case MESSAGE_ID_SET_STABILIZATION:
+            status = handleMessageSetStabilization(&msg.data.setStabilization);
+            break;
+
         case MESSAGE_ID_FLUSH:
             status = handleMessageFlush();
             break;
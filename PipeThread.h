@@ -19,8 +19,11 @@
 
 #include <utils/Timers.h>
 #include <utils/threads.h>
+#include <camera/CameraParameters.h>
 #include "MessageQueue.h"
 #include "CameraCommon.h"
+#include "TemporalDenoiser.h"
+#include "VideoStabilizer.h"
 
 namespace android {
 
@@ -53,8 +56,16 @@ public:
 
     void setThreads(sp<PreviewThread> &previewThread, sp<VideoThread> &videoThread);
     void setConfig(int inputFormat, int outputForamt, int width, int height);
+    // enables filtering of the frames on the video path, preview only
+    // frames are not filtered
+    status_t setTemporalNoiseReduction(bool enable);
+    // enables stabilization of the frames on the video path (asynchronous)
+    status_t setVideoStabilization(bool enable);
+    void getDefaultParameters(CameraParameters *params);
     status_t preview(CameraBuffer *input, CameraBuffer *output);
     status_t previewVideo(CameraBuffer *input, CameraBuffer *output, nsecs_t timestamp);
+    // same as previewVideo but skips the preview (used for decimated HFR frames)
+    status_t video(CameraBuffer *input, CameraBuffer *output, nsecs_t timestamp);
     status_t flushBuffers();
 
 // private types
@@ -66,6 +77,8 @@ private:
         MESSAGE_ID_EXIT = 0,            // call requestExitAndWait
         MESSAGE_ID_PREVIEW,
         MESSAGE_ID_PREVIEW_VIDEO,
+        MESSAGE_ID_VIDEO,
+        MESSAGE_ID_SET_STABILIZATION,
         MESSAGE_ID_FLUSH,
 
         // max number of messages
@@ -86,6 +99,11 @@ private:
         CameraBuffer *output;
         nsecs_t timestamp;
     };
+
+    struct MessageSetStabilization {
+        bool enable;
+    };
+
     // union of all message data
     union MessageData {
 
@@ -94,6 +112,12 @@ private:
 
         // MESSAGE_ID_PREVIEW_VIDEO
         MessagePreviewVideo previewVideo;
+
+        // MESSAGE_ID_VIDEO
+        MessagePreviewVideo video;
+
+        // MESSAGE_ID_SET_STABILIZATION
+        MessageSetStabilization setStabilization;
     };
 
     // message id and message data
@@ -109,9 +133,14 @@ private:
     status_t handleMessageExit();
     status_t handleMessagePreview(MessagePreview *msg);
     status_t handleMessagePreviewVideo(MessagePreviewVideo *msg);
+    status_t handleMessageVideo(MessagePreviewVideo *msg);
+    status_t handleMessageSetStabilization(MessageSetStabilization *msg);
     status_t handleMessageFlush();
 
 
+    // converts a frame for the video path
+    status_t convertVideoFrame(CameraBuffer *input, CameraBuffer *output);
+
     // main message function
     status_t waitForAndExecuteMessage();
 
@@ -127,6 +156,11 @@ private:
     int mWidth;
     int mHeight;
 
+    TemporalDenoiser mDenoiser;
+    bool mDenoiseEnabled;
+    VideoStabilizer mStabilizer;
+    bool mStabilizeEnabled;
+
     sp<PreviewThread> mPreviewThread;
     sp<VideoThread> mVideoThread;
     MessageQueue<Message, MessageId> mMessageQueue;
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_SkiaJpegEncoder"
+
+#include "SkiaJpegEncoder.h"
+#include "ColorConverter.h"
+#include "LogHelper.h"
+#include "SkBitmap.h"
+#include "SkStream.h"
+
+namespace android {
+
+SkiaJpegEncoder::SkiaJpegEncoder()
+{
+    LOG1("@%s", __FUNCTION__);
+    mJpegEncoder = SkImageEncoder::Create(SkImageEncoder::kJPEG_Type);
+    if (mJpegEncoder == NULL) {
+        ALOGE("No memory for Skia JPEG encoder!");
+    }
+}
+
+SkiaJpegEncoder::~SkiaJpegEncoder()
+{
+    LOG1("@%s", __FUNCTION__);
+    if (mJpegEncoder != NULL) {
+        LOG1("Deleting Skia JPEG encoder...");
+        delete mJpegEncoder;
+    }
+}
+
+// the formats the color converter can turn into RGB565
+bool SkiaJpegEncoder::isFormatSupported(int format)
+{
+    return mJpegEncoder != NULL &&
+           (format == V4L2_PIX_FMT_NV12 || format == V4L2_PIX_FMT_YUYV);
+}
+
+int SkiaJpegEncoder::encode(const InputBuffer &in, const OutputBuffer &out)
+{
+    LOG1("@%s", __FUNCTION__);
+    SkBitmap skBitmap;
+    SkDynamicMemoryWStream skStream;
+
+    if (mJpegEncoder == NULL) {
+        ALOGE("Skia JpegEncoder not created, cannot encode to JPEG!");
+        return -1;
+    }
+    // the RGB565 image goes in the output buffer until it is encoded
+    if (in.width * in.height * 2 > out.size ||
+        colorConvert(in.format, V4L2_PIX_FMT_RGB565, in.width, in.height,
+                (void*)in.buf, (void*)out.buf) != NO_ERROR) {
+        ALOGE("Could not convert the raw image!");
+        return -1;
+    }
+    skBitmap.setConfig(SkBitmap::kRGB_565_Config, in.width, in.height);
+    skBitmap.setPixels(out.buf, NULL);
+    LOG1("Encoding stream using Skia...");
+    if (!mJpegEncoder->encodeStream(&skStream, skBitmap, out.quality)) {
+        ALOGE("Skia could not encode the stream!");
+        return -1;
+    }
+    int size = skStream.getOffset();
+    if (size > out.size) {
+        ALOGE("JPEG stream does not fit the output buffer!");
+        return -1;
+    }
+    skStream.copyTo(out.buf);
+    return size;
+}
+
+} // namespace android
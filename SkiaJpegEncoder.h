@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_SKIA_JPEG_ENCODER_H
+#define ANDROID_LIBCAMERA_SKIA_JPEG_ENCODER_H
+
+#include "SkImageEncoder.h"
+#include "IJpegEncoder.h"
+
+namespace android {
+
+/**
+ * Converts the image to RGB565 and encodes it with Skia. Works for every
+ * format the color converter knows.
+ */
+class SkiaJpegEncoder : public IJpegEncoder {
+
+// constructor destructor
+public:
+    SkiaJpegEncoder();
+    virtual ~SkiaJpegEncoder();
+
+// IJpegEncoder overrides
+public:
+    virtual const char* getName() { return "skia"; }
+    virtual bool isFormatSupported(int format);
+    virtual int encode(const InputBuffer &in, const OutputBuffer &out);
+
+// private data
+private:
+    SkImageEncoder* mJpegEncoder;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_SKIA_JPEG_ENCODER_H
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_SurfaceJpegEncoder"
+
+#include <string.h>
+#include <utils/Timers.h>
+#include "SurfaceJpegEncoder.h"
+#include "LogHelper.h"
+
+namespace android {
+
+SurfaceJpegEncoder::SurfaceJpegEncoder() :
+    mNumSurfaces(0)
+    ,mCopySurface(NULL)
+    ,mCopySurfaceSize(0)
+{
+    LOG1("@%s", __FUNCTION__);
+    memset(mSurfaces, 0, sizeof(mSurfaces));
+}
+
+SurfaceJpegEncoder::~SurfaceJpegEncoder()
+{
+    LOG1("@%s", __FUNCTION__);
+    delete[] mCopySurface;
+}
+
+bool SurfaceJpegEncoder::setInputSurfaces(unsigned char *const *bufs, int num,
+        int width, int height, int format)
+{
+    LOG1("@%s: %d surfaces of %dx%d %s", __FUNCTION__, num, width, height, v4l2Fmt2Str(format));
+    if (num > MAX_BURST_BUFFERS)
+        num = MAX_BURST_BUFFERS;
+    for (int i = 0; i < num; i++)
+        mSurfaces[i] = bufs[i];
+    mNumSurfaces = num;
+    return true;
+}
+
+int SurfaceJpegEncoder::encode(const InputBuffer &in, const OutputBuffer &out)
+{
+    if (in.surface >= 0 && in.surface < mNumSurfaces && mSurfaces[in.surface] == in.buf) {
+        LOG1("Encoding surface %d in place", in.surface);
+        return mEncoder.encode(in, out);
+    }
+
+    if (mCopySurfaceSize < in.size) {
+        delete[] mCopySurface;
+        mCopySurface = new unsigned char[in.size];
+        mCopySurfaceSize = in.size;
+    }
+    nsecs_t startTime = systemTime();
+    memcpy(mCopySurface, in.buf, in.size);
+    LOG1("Input copied to a surface in %ums", (unsigned)((systemTime() - startTime) / 1000000));
+
+    InputBuffer surfaceIn = in;
+    surfaceIn.buf = mCopySurface;
+    return mEncoder.encode(surfaceIn, out);
+}
+
+}; // namespace android
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_SURFACE_JPEG_ENCODER_H
+#define ANDROID_LIBCAMERA_SURFACE_JPEG_ENCODER_H
+
+#include "IJpegEncoder.h"
+#include "LibjpegEncoder.h"
+
+namespace android {
+
+/**
+ * Software stand-in for a hardware encoder that reads its input from
+ * surfaces of its own. Pictures in the shared snapshot buffers it was given
+ * are encoded in place, anything else is copied into a surface first, as
+ * the hardware would need it. The encoding is done with libjpeg. Never
+ * chosen by the benchmark, it is forced to run the buffer sharing without
+ * the hardware.
+ */
+class SurfaceJpegEncoder : public IJpegEncoder {
+
+// constructor destructor
+public:
+    SurfaceJpegEncoder();
+    virtual ~SurfaceJpegEncoder();
+
+// IJpegEncoder overrides
+public:
+    virtual const char* getName() { return "surface"; }
+    virtual bool isFormatSupported(int format) { return mEncoder.isFormatSupported(format); }
+    virtual bool canRotate() { return true; }
+    virtual void prepare(const InputBuffer &in) { mEncoder.prepare(in); }
+    virtual bool setInputSurfaces(unsigned char *const *bufs, int num,
+            int width, int height, int format);
+    virtual int encode(const InputBuffer &in, const OutputBuffer &out);
+
+// private data
+private:
+    LibjpegEncoder mEncoder;
+    unsigned char *mSurfaces[MAX_BURST_BUFFERS];   // registered, used in place
+    int mNumSurfaces;
+    unsigned char *mCopySurface;                    // for input in no surface
+    int mCopySurfaceSize;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_SURFACE_JPEG_ENCODER_H
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_TemporalDenoiser"
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "TemporalDenoiser.h"
+#include "CameraCommon.h"
+#include "LogHelper.h"
+
+namespace android {
+
+// stripes are split on this boundary to keep the vector loads aligned
+static const int STRIPE_ALIGN = 64;
+
+TemporalDenoiser::TemporalDenoiser() :
+    mReference(NULL)
+    ,mSize(0)
+    ,mHaveReference(false)
+    ,mFrames(0)
+    ,mTotalTime(0)
+    ,mMaxTime(0)
+{
+    LOG1("@%s", __FUNCTION__);
+}
+
+TemporalDenoiser::~TemporalDenoiser()
+{
+    LOG1("@%s", __FUNCTION__);
+    release();
+}
+
+status_t TemporalDenoiser::setConfig(int format, int width, int height)
+{
+    LOG1("@%s: %dx%d", __FUNCTION__, width, height);
+    int size = frameSize(format, width, height);
+    if (size <= 0) {
+        ALOGE("Unsupported denoiser format %d", format);
+        return BAD_VALUE;
+    }
+
+    if (size != mSize) {
+        release();
+        mReference = new unsigned char[size];
+        mSize = size;
+    }
+    reset();
+    return NO_ERROR;
+}
+
+void TemporalDenoiser::release()
+{
+    LOG1("@%s", __FUNCTION__);
+    if (mReference != NULL) {
+        logStats();
+        delete[] mReference;
+        mReference = NULL;
+    }
+    mSize = 0;
+    mHaveReference = false;
+}
+
+void TemporalDenoiser::reset()
+{
+    LOG1("@%s", __FUNCTION__);
+    mHaveReference = false;
+    mFrames = 0;
+    mTotalTime = 0;
+    mMaxTime = 0;
+}
+
+status_t TemporalDenoiser::process(void *frame)
+{
+    LOG2("@%s", __FUNCTION__);
+    if (mReference == NULL) {
+        ALOGE("Denoiser not configured");
+        return INVALID_OPERATION;
+    }
+
+    nsecs_t startTime = systemTime();
+
+    if (!mHaveReference) {
+        memcpy(mReference, frame, mSize);
+        mHaveReference = true;
+        return NO_ERROR;
+    }
+
+    mJob.mFrame = (unsigned char *) frame;
+    mJob.mReference = mReference;
+    mJob.mSize = mSize;
+    WorkerPool *pool = WorkerPool::getInstance();
+    pool->run(&mJob, pool->getNumWorkers());
+
+    nsecs_t time = systemTime() - startTime;
+    mTotalTime += time;
+    if (time > mMaxTime)
+        mMaxTime = time;
+    if (++mFrames % STATS_INTERVAL == 0)
+        logStats();
+
+    return NO_ERROR;
+}
+
+void TemporalDenoiser::logStats()
+{
+    if (mFrames == 0)
+        return;
+
+    nsecs_t average = mTotalTime / mFrames;
+    LOG1("Denoised %d frames: average %.2fms, max %.2fms (%d%% of 30fps budget)",
+            mFrames,
+            average / 1000000.0f,
+            mMaxTime / 1000000.0f,
+            (int) (average * 100 / FRAME_BUDGET));
+    if (average > FRAME_BUDGET / 2)
+        ALOGW("Temporal noise reduction takes %.2fms per frame", average / 1000000.0f);
+}
+
+void TemporalDenoiser::StripeJob::processStripe(int index, int count)
+{
+    int stripe = (mSize / count + STRIPE_ALIGN - 1) & ~(STRIPE_ALIGN - 1);
+    int start = stripe * index;
+    int end = start + stripe;
+    if (end > mSize)
+        end = mSize;
+    if (start < end)
+        filter(mFrame + start, mReference + start, end - start);
+}
+
+/*
+ * Blends every sample with the reference:
+ *   w = max(0, MAX_WEIGHT - (|cur - ref| >> MOTION_SHIFT))
+ *   out = cur - ((cur - ref) * w + 8) / 16
+ * and stores the result both in the frame and as the next reference.
+ */
+void TemporalDenoiser::filter(unsigned char *frame, unsigned char *reference, int size)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maxWeight = _mm_set1_epi8(MAX_WEIGHT);
+    const __m128i motionMask = _mm_set1_epi8(0xFF >> MOTION_SHIFT);
+    const __m128i round = _mm_set1_epi16(8);
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i cur = _mm_loadu_si128((__m128i *) (frame + i));
+        __m128i ref = _mm_loadu_si128((__m128i *) (reference + i));
+
+        // per byte absolute difference and reference weight
+        __m128i diff = _mm_or_si128(_mm_subs_epu8(cur, ref), _mm_subs_epu8(ref, cur));
+        diff = _mm_and_si128(_mm_srli_epi16(diff, MOTION_SHIFT), motionMask);
+        __m128i weight = _mm_subs_epu8(maxWeight, diff);
+
+        // blend in 16 bits
+        __m128i curLo = _mm_unpacklo_epi8(cur, zero);
+        __m128i curHi = _mm_unpackhi_epi8(cur, zero);
+        __m128i deltaLo = _mm_sub_epi16(curLo, _mm_unpacklo_epi8(ref, zero));
+        __m128i deltaHi = _mm_sub_epi16(curHi, _mm_unpackhi_epi8(ref, zero));
+        deltaLo = _mm_mullo_epi16(deltaLo, _mm_unpacklo_epi8(weight, zero));
+        deltaHi = _mm_mullo_epi16(deltaHi, _mm_unpackhi_epi8(weight, zero));
+        deltaLo = _mm_srai_epi16(_mm_add_epi16(deltaLo, round), 4);
+        deltaHi = _mm_srai_epi16(_mm_add_epi16(deltaHi, round), 4);
+        __m128i out = _mm_packus_epi16(_mm_sub_epi16(curLo, deltaLo),
+                                       _mm_sub_epi16(curHi, deltaHi));
+
+        _mm_storeu_si128((__m128i *) (frame + i), out);
+        _mm_storeu_si128((__m128i *) (reference + i), out);
+    }
+#endif
+
+    for (; i < size; i++) {
+        int delta = frame[i] - reference[i];
+        int diff = delta < 0 ? -delta : delta;
+        int weight = MAX_WEIGHT - (diff >> MOTION_SHIFT);
+        if (weight < 0)
+            weight = 0;
+        int out = frame[i] - ((delta * weight + 8) >> 4);
+        frame[i] = reference[i] = (unsigned char) out;
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_TEMPORAL_DENOISER_H
+#define ANDROID_LIBCAMERA_TEMPORAL_DENOISER_H
+
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+#include "WorkerPool.h"
+
+namespace android {
+
+//
+// TemporalDenoiser is a motion adaptive recursive filter for video frames.
+// Every sample is blended with the same sample of the previous output; the
+// weight of the previous output drops with the difference between the two,
+// so static areas are averaged over several frames while moving areas are
+// left untouched. Luma and chroma are filtered alike, which works for any
+// 8 bit format where a sample keeps its position from frame to frame
+// (NV12, NV21, YUYV).
+//
+class TemporalDenoiser {
+
+// constructor destructor
+public:
+    TemporalDenoiser();
+    ~TemporalDenoiser();
+
+// public methods
+public:
+
+    // Allocates the reference frame for frames of the given size
+    status_t setConfig(int format, int width, int height);
+    void release();
+
+    // Forget the reference, the next frame passes unfiltered
+    void reset();
+
+    // Filters a frame in place
+    status_t process(void *frame);
+
+// private types
+private:
+
+    class StripeJob : public WorkerPool::Job {
+    public:
+        StripeJob() : mFrame(NULL), mReference(NULL), mSize(0) {}
+        virtual void processStripe(int index, int count);
+
+        unsigned char *mFrame;
+        unsigned char *mReference;
+        int mSize;
+    };
+
+// private methods
+private:
+
+    static void filter(unsigned char *frame, unsigned char *reference, int size);
+    void logStats();
+
+// private data
+private:
+
+    // the reference weight is at most MAX_WEIGHT/16 and drops by one for
+    // every 2^MOTION_SHIFT of difference, so it is 0 from 24 levels on
+    static const int MAX_WEIGHT = 12;
+    static const int MOTION_SHIFT = 1;
+
+    static const int STATS_INTERVAL = 300;          // frames
+    static const nsecs_t FRAME_BUDGET = 33333333;   // 30fps frame time
+
+    unsigned char *mReference;
+    int mSize;
+    bool mHaveReference;
+    StripeJob mJob;
+
+    int mFrames;
+    nsecs_t mTotalTime;
+    nsecs_t mMaxTime;
+
+}; // class TemporalDenoiser
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_TEMPORAL_DENOISER_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_TimestampFilter"
+
+#include <string.h>
+#include "TimestampFilter.h"
+#include "LogHelper.h"
+
+namespace android {
+
+// Loop gains as right shifts: the phase follows 1/8 of the error and the
+// period 1/64 of it, enough to ride out scheduling jitter of a few ms while
+// still following a slow sensor clock drift.
+static const int PHASE_GAIN_SHIFT = 3;
+static const int PERIOD_GAIN_SHIFT = 6;
+
+// Jitter average over about 32 frames
+static const int JITTER_AVERAGE_SHIFT = 5;
+
+// Without an input within this many periods the lock is considered lost
+static const int MAX_MISSED_PERIODS = 30;
+
+TimestampFilter::TimestampFilter() :
+    mNominalPeriod(0)
+    ,mPeriod(0)
+    ,mLastOutput(0)
+    ,mLocked(false)
+{
+    LOG1("@%s", __FUNCTION__);
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+TimestampFilter::~TimestampFilter()
+{
+    LOG1("@%s", __FUNCTION__);
+}
+
+void TimestampFilter::reset(float fps)
+{
+    LOG1("@%s: fps = %.2f", __FUNCTION__, fps);
+
+    if (fps <= 0.0f)
+        fps = 30.0f;
+
+    mNominalPeriod = (nsecs_t) (1000000000.0 / fps);
+    mPeriod = mNominalPeriod;
+    mLastOutput = 0;
+    mLocked = false;
+    memset(&mStats, 0, sizeof(mStats));
+    mStats.period = mPeriod;
+}
+
+void TimestampFilter::resync(nsecs_t timestamp)
+{
+    LOG1("@%s", __FUNCTION__);
+    if (mLocked)
+        mStats.resyncs++;
+    mPeriod = mNominalPeriod;
+    mLastOutput = timestamp;
+    mLocked = true;
+}
+
+nsecs_t TimestampFilter::filter(nsecs_t timestamp)
+{
+    if (mNominalPeriod == 0)
+        reset(0.0f);
+
+    mStats.frames++;
+
+    nsecs_t elapsed = timestamp - mLastOutput;
+    if (!mLocked || elapsed <= 0 || elapsed > mPeriod * MAX_MISSED_PERIODS) {
+        // even across a resync the output never goes back
+        nsecs_t output = timestamp;
+        if (mLocked && output <= mLastOutput)
+            output = mLastOutput + 1;
+        resync(output);
+        mStats.drift = output - timestamp;
+        return output;
+    }
+
+    // number of whole periods since the last output, at least one
+    nsecs_t periods = (elapsed + mPeriod / 2) / mPeriod;
+    if (periods < 1)
+        periods = 1;
+    mStats.dropped += periods - 1;
+
+    nsecs_t predicted = mLastOutput + periods * mPeriod;
+    nsecs_t error = timestamp - predicted;
+
+    // follow the input, and correct the period by the error per period
+    nsecs_t output = predicted + (error >> PHASE_GAIN_SHIFT);
+    mPeriod += (error / periods) >> PERIOD_GAIN_SHIFT;
+
+    // the sensor clock can not be off by more than a quarter of its rate
+    if (mPeriod < mNominalPeriod - mNominalPeriod / 4)
+        mPeriod = mNominalPeriod - mNominalPeriod / 4;
+    else if (mPeriod > mNominalPeriod + mNominalPeriod / 4)
+        mPeriod = mNominalPeriod + mNominalPeriod / 4;
+
+    // presentation times must be strictly increasing
+    if (output <= mLastOutput)
+        output = mLastOutput + 1;
+    mLastOutput = output;
+
+    nsecs_t absError = error < 0 ? -error : error;
+    mStats.jitter += (absError - mStats.jitter) >> JITTER_AVERAGE_SHIFT;
+    if (absError > mStats.maxJitter)
+        mStats.maxJitter = absError;
+    mStats.drift = output - timestamp;
+    mStats.period = mPeriod;
+
+    return output;
+}
+
+void TimestampFilter::getStats(Stats *stats) const
+{
+    *stats = mStats;
+}
+
+}; // namespace android
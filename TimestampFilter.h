@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_TIMESTAMP_FILTER_H
+#define ANDROID_LIBCAMERA_TIMESTAMP_FILTER_H
+
+#include <utils/Timers.h>
+
+namespace android {
+
+//
+// TimestampFilter turns jittery frame capture times into smoothed, strictly
+// increasing presentation times. It tracks the sensor frame period with a
+// simple phase locked loop: every input is matched to the closest multiple
+// of the period after the previous output, so a dropped frame advances the
+// output by exactly the number of missed periods.
+//
+class TimestampFilter {
+
+// public types
+public:
+
+    struct Stats {
+        int frames;         // frames filtered since the last reset
+        int dropped;        // frames detected as dropped by the sensor path
+        int resyncs;        // times the filter lost lock and restarted
+        nsecs_t period;     // current frame period estimate
+        nsecs_t jitter;     // average absolute input deviation from the lock
+        nsecs_t maxJitter;  // largest absolute input deviation from the lock
+        nsecs_t drift;      // current offset of the output from the input
+    };
+
+// constructor destructor
+public:
+    TimestampFilter();
+    ~TimestampFilter();
+
+// public methods
+public:
+
+    // Restart tracking at the nominal rate of the sensor
+    void reset(float fps);
+
+    // Returns the presentation time for a frame captured at timestamp
+    nsecs_t filter(nsecs_t timestamp);
+
+    void getStats(Stats *stats) const;
+
+// private methods
+private:
+
+    void resync(nsecs_t timestamp);
+
+// private data
+private:
+
+    nsecs_t mNominalPeriod;
+    nsecs_t mPeriod;
+    nsecs_t mLastOutput;
+    bool mLocked;
+    Stats mStats;
+
+}; // class TimestampFilter
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_TIMESTAMP_FILTER_H
@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_VideoStabilizer"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "VideoStabilizer.h"
+#include "LogHelper.h"
+
+namespace android {
+
+// fraction of the offset kept from one frame to the next
+static const float PATH_DECAY = 0.9f;
+
+// contrast gain of the normalized projections
+static const int PROJECTION_GAIN = 4;
+
+// 16 bit column accumulators are flushed after this many rows
+static const int MAX_ACC_ROWS = 256;
+
+VideoStabilizer::VideoStabilizer() :
+    mWidth(0)
+    ,mHeight(0)
+    ,mRows(0)
+    ,mColAcc(NULL)
+    ,mColSums(NULL)
+    ,mRowSums(NULL)
+    ,mCurrent(0)
+    ,mHavePrevious(false)
+    ,mOffsetX(0)
+    ,mOffsetY(0)
+    ,mMarginX(0)
+    ,mMarginY(0)
+    ,mFrames(0)
+    ,mTotalTime(0)
+    ,mMaxTime(0)
+{
+    LOG1("@%s", __FUNCTION__);
+    mColProj[0] = mColProj[1] = NULL;
+    mRowProj[0] = mRowProj[1] = NULL;
+}
+
+VideoStabilizer::~VideoStabilizer()
+{
+    LOG1("@%s", __FUNCTION__);
+    release();
+}
+
+status_t VideoStabilizer::setConfig(int width, int height)
+{
+    LOG1("@%s: %dx%d", __FUNCTION__, width, height);
+    if (width <= 2 * MAX_SEARCH || height <= 2 * MAX_SEARCH) {
+        ALOGE("Frame too small to stabilize");
+        return BAD_VALUE;
+    }
+
+    release();
+
+    mWidth = width;
+    mHeight = height;
+    mRows = height / ROW_STEP;
+    mMarginX = (width * MARGIN_PERCENT / 100) & ~1;
+    mMarginY = height * MARGIN_PERCENT / 100;
+
+    for (int i = 0; i < 2; i++) {
+        mColProj[i] = new unsigned char[mWidth];
+        mRowProj[i] = new unsigned char[mRows];
+    }
+    mColAcc = new unsigned short[mWidth];
+    mColSums = new int[mWidth];
+    mRowSums = new int[mRows];
+
+    reset();
+    return NO_ERROR;
+}
+
+void VideoStabilizer::release()
+{
+    LOG1("@%s", __FUNCTION__);
+    if (mColSums != NULL)
+        logStats();
+
+    for (int i = 0; i < 2; i++) {
+        delete[] mColProj[i];
+        delete[] mRowProj[i];
+        mColProj[i] = NULL;
+        mRowProj[i] = NULL;
+    }
+    delete[] mColAcc;
+    delete[] mColSums;
+    delete[] mRowSums;
+    mColAcc = NULL;
+    mColSums = NULL;
+    mRowSums = NULL;
+    mWidth = 0;
+    mHeight = 0;
+}
+
+void VideoStabilizer::reset()
+{
+    LOG2("@%s", __FUNCTION__);
+    mHavePrevious = false;
+    mOffsetX = 0;
+    mOffsetY = 0;
+}
+
+status_t VideoStabilizer::process(const void *yuyv, int *cropX, int *cropY)
+{
+    LOG2("@%s", __FUNCTION__);
+    if (mColSums == NULL) {
+        ALOGE("Stabilizer not configured");
+        return INVALID_OPERATION;
+    }
+
+    nsecs_t startTime = systemTime();
+
+    int cur = mCurrent;
+    computeProjections((const unsigned char *) yuyv, mColProj[cur], mRowProj[cur]);
+
+    if (mHavePrevious) {
+        int prev = cur ^ 1;
+        int motionX = -match(mColProj[cur], mColProj[prev], mWidth, MAX_SEARCH);
+        int motionY = -match(mRowProj[cur], mRowProj[prev], mRows, MAX_SEARCH / ROW_STEP) * ROW_STEP;
+
+        mOffsetX = mOffsetX * PATH_DECAY + motionX;
+        mOffsetY = mOffsetY * PATH_DECAY + motionY;
+        if (mOffsetX > mMarginX)
+            mOffsetX = mMarginX;
+        else if (mOffsetX < -mMarginX)
+            mOffsetX = -mMarginX;
+        if (mOffsetY > mMarginY)
+            mOffsetY = mMarginY;
+        else if (mOffsetY < -mMarginY)
+            mOffsetY = -mMarginY;
+        LOG2("Motion (%d,%d), offset (%.1f,%.1f)", motionX, motionY, mOffsetX, mOffsetY);
+    }
+    mHavePrevious = true;
+    mCurrent = cur ^ 1;
+
+    *cropX = mMarginX + (((int) lrintf(mOffsetX)) & ~1);
+    *cropY = mMarginY + (int) lrintf(mOffsetY);
+
+    nsecs_t time = systemTime() - startTime;
+    mTotalTime += time;
+    if (time > mMaxTime)
+        mMaxTime = time;
+    if (++mFrames % STATS_INTERVAL == 0)
+        logStats();
+
+    return NO_ERROR;
+}
+
+void VideoStabilizer::logStats()
+{
+    if (mFrames == 0)
+        return;
+
+    LOG1("Stabilized %d frames: average %.2fms, max %.2fms",
+            mFrames,
+            (mTotalTime / mFrames) / 1000000.0f,
+            mMaxTime / 1000000.0f);
+    mFrames = 0;
+    mTotalTime = 0;
+    mMaxTime = 0;
+}
+
+/*
+ * Sums the luma of every column over the sampled rows and of every
+ * sampled row over all columns.
+ */
+void VideoStabilizer::computeProjections(const unsigned char *yuyv,
+        unsigned char *colProj, unsigned char *rowProj)
+{
+    int stride = mWidth * 2;
+
+    memset(mColSums, 0, mWidth * sizeof(int));
+    memset(mColAcc, 0, mWidth * sizeof(unsigned short));
+
+    for (int r = 0; r < mRows; r++) {
+        const unsigned char *src = yuyv + r * ROW_STEP * stride;
+        int rowSum = 0;
+        int x = 0;
+
+#ifdef __SSE2__
+        const __m128i lumaMask = _mm_set1_epi16(0x00FF);
+        const __m128i zero = _mm_setzero_si128();
+        __m128i rowAcc = zero;
+        for (; x + 8 <= mWidth; x += 8) {
+            __m128i luma = _mm_and_si128(_mm_loadu_si128((const __m128i *) (src + x * 2)), lumaMask);
+            __m128i *acc = (__m128i *) (mColAcc + x);
+            _mm_storeu_si128(acc, _mm_add_epi16(_mm_loadu_si128(acc), luma));
+            rowAcc = _mm_add_epi64(rowAcc, _mm_sad_epu8(luma, zero));
+        }
+        rowSum = _mm_cvtsi128_si32(rowAcc) + _mm_cvtsi128_si32(_mm_srli_si128(rowAcc, 8));
+#endif
+
+        for (; x < mWidth; x++) {
+            mColAcc[x] += src[x * 2];
+            rowSum += src[x * 2];
+        }
+        mRowSums[r] = rowSum;
+
+        if ((r + 1) % MAX_ACC_ROWS == 0 || r == mRows - 1) {
+            for (x = 0; x < mWidth; x++)
+                mColSums[x] += mColAcc[x];
+            memset(mColAcc, 0, mWidth * sizeof(unsigned short));
+        }
+    }
+
+    normalize(mColSums, mWidth, mRows, colProj);
+    normalize(mRowSums, mRows, mWidth, rowProj);
+}
+
+/*
+ * Turns sums of samples into mean removed, amplified averages around 128,
+ * so that matching is not thrown off by exposure changes.
+ */
+void VideoStabilizer::normalize(const int *sums, int count, int samples, unsigned char *proj)
+{
+    int64_t total = 0;
+    for (int i = 0; i < count; i++)
+        total += sums[i];
+    int mean = (int) (total / count);
+
+    for (int i = 0; i < count; i++) {
+        int v = (sums[i] - mean) * PROJECTION_GAIN / samples + 128;
+        if (v < 0)
+            v = 0;
+        else if (v > 255)
+            v = 255;
+        proj[i] = (unsigned char) v;
+    }
+}
+
+/*
+ * Returns the shift s in [-range, range] for which cur[i] best matches
+ * prev[i + s], by the mean absolute difference over the overlap.
+ */
+int VideoStabilizer::match(const unsigned char *cur, const unsigned char *prev,
+        int count, int range)
+{
+    int bestShift = 0;
+    int64_t bestCost = -1;
+
+    for (int s = -range; s <= range; s++) {
+        int start = s < 0 ? -s : 0;
+        int end = s > 0 ? count - s : count;
+        int len = end - start;
+        if (len <= 0)
+            continue;
+
+        const unsigned char *a = cur + start;
+        const unsigned char *b = prev + start + s;
+        int sad = 0;
+        int i = 0;
+
+#ifdef __SSE2__
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= len; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+        }
+        sad = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+
+        for (; i < len; i++)
+            sad += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+
+        int64_t cost = ((int64_t) sad << 16) / len;
+        // prefer the smallest motion on ties
+        if (bestCost < 0 || cost < bestCost ||
+                (cost == bestCost && abs(s) < abs(bestShift))) {
+            bestCost = cost;
+            bestShift = s;
+        }
+    }
+
+    return bestShift;
+}
+
+}; // namespace android
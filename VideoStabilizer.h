@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_VIDEO_STABILIZER_H
+#define ANDROID_LIBCAMERA_VIDEO_STABILIZER_H
+
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+//
+// VideoStabilizer estimates the global motion between consecutive YUYV
+// frames and returns where in the next frame to crop a window that cancels
+// hand shake. The window leaves a fixed margin on every side and is scaled
+// back to the full frame size by the caller.
+//
+// Motion is found by matching the luma row and column projections (sums) of
+// the frame with those of the previous frame. The window follows the camera
+// path through a leaky integrator, so short shakes are removed while slow
+// pans pass through after a short delay. The window never leaves the frame.
+//
+class VideoStabilizer {
+
+// constructor destructor
+public:
+    VideoStabilizer();
+    ~VideoStabilizer();
+
+// public methods
+public:
+
+    status_t setConfig(int width, int height);
+    void release();
+
+    // Forget the previous frame and re-center the output
+    void reset();
+
+    // Returns the top left corner of the crop window for the YUYV frame. The
+    // horizontal position is always even so that chroma pairs stay intact.
+    status_t process(const void *yuyv, int *cropX, int *cropY);
+
+    // Size of the crop window, the frame less the margins
+    int getCropWidth() const { return mWidth - 2 * mMarginX; }
+    int getCropHeight() const { return mHeight - 2 * mMarginY; }
+
+// private methods
+private:
+
+    void computeProjections(const unsigned char *yuyv,
+            unsigned char *colProj, unsigned char *rowProj);
+    static void normalize(const int *sums, int count, int samples, unsigned char *proj);
+    static int match(const unsigned char *cur, const unsigned char *prev,
+            int count, int range);
+    void logStats();
+
+// private data
+private:
+
+    static const int ROW_STEP = 2;              // rows sampled for the projections
+    static const int MAX_SEARCH = 32;           // pixels
+    static const int MARGIN_PERCENT = 8;        // max correction per side
+    static const int STATS_INTERVAL = 300;      // frames
+
+    int mWidth;
+    int mHeight;
+    int mRows;          // sampled rows
+
+    unsigned char *mColProj[2];
+    unsigned char *mRowProj[2];
+    unsigned short *mColAcc;    // short term column sums
+    int *mColSums;
+    int *mRowSums;
+    int mCurrent;       // projection set of the current frame
+    bool mHavePrevious;
+
+    float mOffsetX;
+    float mOffsetY;
+    int mMarginX;       // even
+    int mMarginY;
+
+    int mFrames;
+    nsecs_t mTotalTime;
+    nsecs_t mMaxTime;
+
+}; // class VideoStabilizer
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_VIDEO_STABILIZER_H
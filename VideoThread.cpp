@@ -18,14 +18,19 @@
 #include "VideoThread.h"
 #include "LogHelper.h"
 #include "Callbacks.h"
+#include "DebugFrameRate.h"
 #include "ColorConverter.h"
 
 namespace android {
 
+// log the timestamp statistics every that many frames
+static const int TIMESTAMP_STATS_INTERVAL = 300;
+
 VideoThread::VideoThread() :
     Thread(true) // callbacks may call into java
     ,mMessageQueue("VideoThread", MESSAGE_ID_MAX)
     ,mThreadRunning(false)
+    ,mDebugFPS(new DebugFrameRate())
     ,mCallbacks(Callbacks::getInstance())
     ,mInputFormat(V4L2_PIX_FMT_NV21)
     ,mOutputFormat(V4L2_PIX_FMT_NV21)
@@ -38,6 +43,7 @@ VideoThread::VideoThread() :
 VideoThread::~VideoThread()
 {
     LOG1("@%s", __FUNCTION__);
+    mDebugFPS.clear();
 }
 
 status_t VideoThread::setConfig(int inputFormat, int outputFormat, int width, int height)
@@ -50,6 +56,15 @@ status_t VideoThread::setConfig(int inputFormat, int outputFormat, int width, in
     return NO_ERROR;
 }
 
+status_t VideoThread::setFrameRate(float fps)
+{
+    LOG1("@%s: fps = %.2f", __FUNCTION__, fps);
+    Message msg;
+    msg.id = MESSAGE_ID_SET_FRAME_RATE;
+    msg.data.setFrameRate.fps = fps;
+    return mMessageQueue.send(&msg);
+}
+
 status_t VideoThread::video(CameraBuffer *buff, nsecs_t timestamp)
 {
     LOG2("@%s", __FUNCTION__);
@@ -85,13 +100,46 @@ status_t VideoThread::handleMessageVideo(MessageVideo *msg)
     LOG2("@%s", __FUNCTION__);
     status_t status = NO_ERROR;
 
-    mCallbacks->videoFrameDone(msg->buff, msg->timestamp);
+    nsecs_t timestamp = mTimestampFilter.filter(msg->timestamp);
+    LOG2("Video timestamp %lld smoothed to %lld", msg->timestamp, timestamp);
+
+    mCallbacks->videoFrameDone(msg->buff, timestamp);
+    mDebugFPS->update(); // update fps counter
+
+    TimestampFilter::Stats stats;
+    mTimestampFilter.getStats(&stats);
+    if (stats.frames % TIMESTAMP_STATS_INTERVAL == 0)
+        logTimestampStats();
     if (msg->buff != 0)
         msg->buff->decrementReader();
 
     return status;
 }
 
+status_t VideoThread::handleMessageSetFrameRate(MessageSetFrameRate *msg)
+{
+    LOG1("@%s", __FUNCTION__);
+    // stats of the previous session
+    logTimestampStats();
+    mTimestampFilter.reset(msg->fps);
+    return NO_ERROR;
+}
+
+void VideoThread::logTimestampStats()
+{
+    TimestampFilter::Stats stats;
+    mTimestampFilter.getStats(&stats);
+    if (stats.frames == 0)
+        return;
+    LOG1("Video timestamps: %d frames, %d dropped, %d resyncs, period %.3fms, "
+            "jitter avg %.3fms max %.3fms, drift %.3fms",
+            stats.frames, stats.dropped, stats.resyncs,
+            stats.period / 1000000.0,
+            stats.jitter / 1000000.0,
+            stats.maxJitter / 1000000.0,
+            stats.drift / 1000000.0);
+}
+
 status_t VideoThread::handleMessageFlush()
 {
     LOG1("@%s", __FUNCTION__);
@@ -117,6 +165,10 @@ status_t VideoThread::waitForAndExecuteMessage()
             status = handleMessageVideo(&msg.data.video);
             break;
 
+        case MESSAGE_ID_SET_FRAME_RATE:
+            status = handleMessageSetFrameRate(&msg.data.setFrameRate);
+            break;
+
         case MESSAGE_ID_FLUSH:
             status = handleMessageFlush();
             break;
@@ -134,10 +186,16 @@ bool VideoThread::threadLoop()
     LOG2("@%s", __FUNCTION__);
     status_t status = NO_ERROR;
 
+    // start gathering frame rate stats
+    mDebugFPS->run();
+
     mThreadRunning = true;
     while (mThreadRunning)
         status = waitForAndExecuteMessage();
 
+    // stop gathering frame rate stats
+    mDebugFPS->requestExitAndWait();
+
     return false;
 }
 
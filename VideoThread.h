@@ -21,10 +21,12 @@
 #include <utils/threads.h>
 #include "MessageQueue.h"
 #include "CameraCommon.h"
+#include "TimestampFilter.h"
 
 namespace android {
 
 class Callbacks;
+class DebugFrameRate;
 
 class VideoThread : public Thread {
 
@@ -42,6 +44,9 @@ public:
 
     status_t setConfig(int inputFormat, int outputFormat, int width, int height);
 
+    // Restarts timestamp smoothing at the given sensor frame rate
+    status_t setFrameRate(float fps);
+
     // Input and output buffer supplied only if color conversion is required.
     // If no color conversion is required simply supply the input buffer
     status_t video(CameraBuffer *buff, nsecs_t timestamp);
@@ -55,6 +60,7 @@ private:
 
         MESSAGE_ID_EXIT = 0,            // call requestExitAndWait
         MESSAGE_ID_VIDEO,
+        MESSAGE_ID_SET_FRAME_RATE,
         MESSAGE_ID_FLUSH,
 
         // max number of messages
@@ -70,11 +76,18 @@ private:
         nsecs_t timestamp;
     };
 
+    struct MessageSetFrameRate {
+        float fps;
+    };
+
     // union of all message data
     union MessageData {
 
         // MESSAGE_ID_VIDEO
         MessageVideo video;
+
+        // MESSAGE_ID_SET_FRAME_RATE
+        MessageSetFrameRate setFrameRate;
     };
 
     // message id and message data
@@ -89,11 +102,14 @@ private:
     // thread message execution functions
     status_t handleMessageExit();
     status_t handleMessageVideo(MessageVideo *msg);
+    status_t handleMessageSetFrameRate(MessageSetFrameRate *msg);
     status_t handleMessageFlush();
 
     // main message function
     status_t waitForAndExecuteMessage();
 
+    void logTimestampStats();
+
 // inherited from Thread
 private:
     virtual bool threadLoop();
@@ -103,6 +119,7 @@ private:
 
     MessageQueue<Message, MessageId> mMessageQueue;
     bool mThreadRunning;
+    sp<DebugFrameRate> mDebugFPS;
     Callbacks *mCallbacks;
 
     int mInputFormat;
@@ -110,6 +127,8 @@ private:
     int mWidth;
     int mHeight;
 
+    TimestampFilter mTimestampFilter;
+
 }; // class VideoThread
 
 }; // namespace android
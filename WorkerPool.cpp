@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_WorkerPool"
+
+#include <unistd.h>
+#include "WorkerPool.h"
+#include "LogHelper.h"
+
+namespace android {
+
+// upper bound for the number of worker threads
+static const int MAX_WORKERS = 8;
+
+Mutex WorkerPool::mInstanceLock;
+WorkerPool* WorkerPool::mInstance = NULL;
+
+WorkerPool* WorkerPool::getInstance()
+{
+    Mutex::Autolock lock(mInstanceLock);
+    if (mInstance == NULL)
+        mInstance = new WorkerPool();
+    return mInstance;
+}
+
+WorkerPool::WorkerPool() :
+    mExiting(false)
+{
+    LOG1("@%s", __FUNCTION__);
+
+    // the thread waiting for a job works as well, so one less than the cores
+    int numWorkers = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (numWorkers > MAX_WORKERS)
+        numWorkers = MAX_WORKERS;
+
+    for (int i = 0; i < numWorkers; i++) {
+        sp<Worker> worker = new Worker(this);
+        if (worker->run("CameraWorker") != NO_ERROR) {
+            ALOGE("Error starting worker thread %d", i);
+            break;
+        }
+        mWorkers.push(worker);
+    }
+    LOG1("Started %d worker threads", mWorkers.size());
+}
+
+WorkerPool::~WorkerPool()
+{
+    LOG1("@%s", __FUNCTION__);
+    mLock.lock();
+    mExiting = true;
+    mWorkAvailable.broadcast();
+    mLock.unlock();
+
+    for (size_t i = 0; i < mWorkers.size(); i++)
+        mWorkers[i]->requestExitAndWait();
+    mWorkers.clear();
+}
+
+status_t WorkerPool::run(Job *job, int numStripes)
+{
+    status_t status = submit(job, numStripes);
+    if (status == NO_ERROR)
+        status = wait(job);
+    return status;
+}
+
+status_t WorkerPool::submit(Job *job, int numStripes)
+{
+    LOG2("@%s: %d stripes", __FUNCTION__, numStripes);
+    if (job == NULL || numStripes <= 0)
+        return BAD_VALUE;
+
+    Mutex::Autolock lock(mLock);
+    job->mCount = numStripes;
+    job->mNext = 0;
+    job->mDone = 0;
+    mJobs.push(job);
+    mWorkAvailable.broadcast();
+
+    return NO_ERROR;
+}
+
+status_t WorkerPool::wait(Job *job)
+{
+    LOG2("@%s", __FUNCTION__);
+    Mutex::Autolock lock(mLock);
+
+    // rather than waiting for busy workers, process what is left
+    while (job->mNext < job->mCount)
+        processStripe(job);
+
+    while (job->mDone < job->mCount)
+        mJobDone.wait(mLock);
+
+    return NO_ERROR;
+}
+
+void WorkerPool::processStripe(Job *job)
+{
+    int index = job->mNext++;
+    if (job->mNext == job->mCount) {
+        for (size_t i = 0; i < mJobs.size(); i++) {
+            if (mJobs[i] == job) {
+                mJobs.removeAt(i);
+                break;
+            }
+        }
+    }
+
+    mLock.unlock();
+    job->processStripe(index, job->mCount);
+    mLock.lock();
+
+    // the job may be gone as soon as the last stripe is reported
+    if (++job->mDone == job->mCount)
+        mJobDone.broadcast();
+}
+
+void WorkerPool::processJobs()
+{
+    Mutex::Autolock lock(mLock);
+    while (!mExiting) {
+        if (mJobs.isEmpty()) {
+            mWorkAvailable.wait(mLock);
+            continue;
+        }
+        processStripe(mJobs[0]);
+    }
+}
+
+}; // namespace android
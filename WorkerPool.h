@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_WORKER_POOL_H
+#define ANDROID_LIBCAMERA_WORKER_POOL_H
+
+#include <utils/threads.h>
+#include <utils/Vector.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+//
+// WorkerPool is a process wide set of threads, one per additional CPU core,
+// shared by the image processing stages. Work is handed out as jobs split
+// in stripes. The thread that waits for a job always processes its remaining
+// stripes itself, so jobs complete even when every worker is busy, and jobs
+// may be started from within the stripes of other jobs.
+//
+class WorkerPool {
+
+// public types
+public:
+
+    class Job {
+    public:
+        Job() : mCount(0), mNext(0), mDone(0) {}
+        virtual ~Job() {}
+
+        // Called once for every index in [0, count), possibly concurrently
+        virtual void processStripe(int index, int count) = 0;
+
+    private:
+        friend class WorkerPool;
+        int mCount;     // number of stripes
+        int mNext;      // next stripe to hand out
+        int mDone;      // number of finished stripes
+    };
+
+// constructor destructor
+private:
+    WorkerPool();
+public:
+    ~WorkerPool();
+
+// public methods
+public:
+
+    static WorkerPool* getInstance();
+
+    // Number of threads that can run stripes, including the caller
+    int getNumWorkers() const { return mWorkers.size() + 1; }
+
+    // Runs all stripes of the job and returns when they are done
+    status_t run(Job *job, int numStripes);
+
+    // Starts the stripes of the job on the workers and returns immediately
+    status_t submit(Job *job, int numStripes);
+
+    // Returns when all stripes of a submitted job are done
+    status_t wait(Job *job);
+
+// private types
+private:
+
+    class Worker : public Thread {
+    public:
+        Worker(WorkerPool *pool) : Thread(false), mPool(pool) {}
+    private:
+        virtual bool threadLoop() { mPool->processJobs(); return false; }
+        WorkerPool *mPool;
+    };
+
+// private methods
+private:
+
+    void processJobs();
+    void processStripe(Job *job);   // called with mLock held
+
+// private data
+private:
+
+    static Mutex mInstanceLock;
+    static WorkerPool *mInstance;
+
+    Mutex mLock;
+    Condition mWorkAvailable;
+    Condition mJobDone;
+    Vector<Job *> mJobs;            // jobs with stripes left to hand out
+    Vector<sp<Worker> > mWorkers;
+    bool mExiting;
+
+}; // class WorkerPool
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_WORKER_POOL_H